@@ -138,7 +138,7 @@ int main(int argc, char **argv) {
     unsigned char *buf;
 
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <file.spc>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <file.spc> [--profile-out <file>]\n", argv[0]);
         return 1;
     }
 
@@ -154,6 +154,17 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (argc == 4 && strcmp(argv[2], "--profile-out") == 0) {
+        if (!is_safe_relative_path(argv[3])) {
+            fprintf(stderr, "[ERROR] invalid profile path\n");
+            return 1;
+        }
+        splice_profile_request(argv[3]);
+    } else if (argc != 2) {
+        fprintf(stderr, "Usage: %s <file.spc> [--profile-out <file>]\n", argv[0]);
+        return 1;
+    }
+
     path = argv[1];
     ext = strrchr(path, '.');
     if (!ext || strcmp(ext, ".spc") != 0) {
@@ -217,6 +228,8 @@ echo "Building spbuild (bytecode compiler)..."
     src/build/lexer.c \
     src/build/parser.c \
     src/build/optimizer.c \
+    src/build/ssa.c \
+    src/build/profile.c \
     src/build/codegen.c \
     ${MATH_LIBS[@]-} \
     "${LINK_FLAGS[@]}" \
@@ -1,22 +1,51 @@
 #include "build/builder.h"
 
 int main(int argc, char **argv) {
+    const char *prog_name = argv[0];
     const char *in_arg;
     const char *out_arg;
+    const char *profile_arg = NULL;
+    int want_stats = 0;
     char in_path[PATH_MAX];
     char out_path[PATH_MAX];
     char *src;
     TokVec tv = {0};
     ASTNode *root;
 
+    while (argc > 1 && argv[1][0] == '-') {
+        const char *opt = argv[1];
+
+        if (strcmp(opt, "--profile-in") == 0 && argc > 2) {
+            profile_arg = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(opt, "--pass-stats") == 0) {
+            want_stats = 1;
+        } else if (strcmp(opt, "-Os") == 0) {
+            g_opt_level = OPT_LEVEL_DEFAULT;
+            g_opt_size = 1;
+        } else if (opt[1] == 'O' && opt[2] >= '0' && opt[2] <= '3' && opt[3] == '\0') {
+            g_opt_level = opt[2] - '0';
+            g_opt_size = 0;
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
     if (argc != 3) {
-        fprintf(stderr, "Usage: %s <input.spl> <output.spc>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-O0|-O1|-O2|-O3|-Os] [--pass-stats] [--profile-in <file>] <input.spl> <output.spc>\n", prog_name);
         return 1;
     }
 
     in_arg = argv[1];
     out_arg = argv[2];
 
+    if (profile_arg && (!is_safe_relative_path(profile_arg) || !profile_load(profile_arg))) {
+        fprintf(stderr, "spbuild: cannot read profile '%s'\n", profile_arg);
+        return 1;
+    }
+
     if (!splice_getcwd(g_project_root, sizeof(g_project_root))) {
         fprintf(stderr, "spbuild: failed to resolve working directory\n");
         return 1;
@@ -55,12 +84,22 @@ int main(int argc, char **argv) {
     path_list_push(&g_imported_files, &g_imported_count, &g_imported_cap, in_path);
     path_list_push(&g_import_stack, &g_import_stack_count, &g_import_stack_cap, in_path);
 
-    root = parse_program(&tv);
+    root = resolve_constants(parse_program(&tv));
     path_list_pop(g_import_stack, &g_import_stack_count);
-    root = optimize_node(root);
+    if (profile_arg) {
+        /* The profile describes the plain build, so that build is made first to map it onto the program. */
+        ASTNode *plain = optimize_program(ast_clone(root));
+        if (!bind_profile(plain)) {
+            fprintf(stderr, "spbuild: profile '%s' was not recorded on this program's plain build; ignoring it\n", profile_arg);
+        }
+        free_ast(plain);
+    }
+    g_pass_stats = want_stats; /* the plain build above is not part of this build's statistics */
+    root = optimize_program(root);
 
     if (!write_spc(out_path, root)) {
         fprintf(stderr, "spbuild: failed to write %s\n", out_arg);
+        profile_free();
         free_ast(root);
         tv_free(&tv);
         free(src);
@@ -69,10 +108,13 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (g_pass_stats) print_pass_stats();
+
     free_ast(root);
     tv_free(&tv);
     free(src);
     path_list_free(g_imported_files, g_imported_count);
     path_list_free(g_import_stack, g_import_stack_count);
+    profile_free();
     return 0;
 }
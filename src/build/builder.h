@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef _WIN32
@@ -47,30 +48,32 @@ typedef enum {
     AST_ARRAY,
     AST_INDEX,
     AST_INDEX_ASSIGN,
-    AST_IMPORT_C
+    AST_IMPORT_C,
+    AST_COND
 } ASTNodeType;
 
 typedef struct ASTNode ASTNode;
 
 struct ASTNode {
     ASTNodeType type;
+    int site; /* parser-assigned id of an if, loop or call; 0 for nodes the optimizer builds */
     union {
         double number;
         char *string;
 
-        struct { char *op; ASTNode *left; ASTNode *right; } binop;
+        struct { char *op; ASTNode *left; ASTNode *right; int numeric; } binop;
         struct { char *name; ASTNode *value; } var;
         struct { ASTNode *expr; } print;
         struct { ASTNode *cond; ASTNode *body; } whilestmt;
-        struct { ASTNode *cond; ASTNode *then_b; ASTNode *else_b; } ifstmt;
+        struct { ASTNode *cond; ASTNode *then_b; ASTNode *else_b; } ifstmt; /* also AST_COND */
         struct { ASTNode **stmts; int count; } statements;
         struct { char *name; char **params; int param_count; ASTNode *body; } funcdef;
-        struct { char *name; ASTNode **args; int arg_count; } funccall;
+        struct { char *name; ASTNode **args; int arg_count; int frame; } funccall; /* frame: see arraylit */
         struct { ASTNode *expr; } retstmt;
         struct { char *var; ASTNode *start; ASTNode *end; ASTNode *body; } forstmt;
-        struct { ASTNode **items; int count; } arraylit;
-        struct { ASTNode *array; ASTNode *index; } index;
-        struct { ASTNode *array; ASTNode *index; ASTNode *value; } indexassign;
+        struct { ASTNode **items; int count; int frame; } arraylit; /* frame: never outlives its call */
+        struct { ASTNode *array; ASTNode *index; int unchecked; } index;
+        struct { ASTNode *array; ASTNode *index; ASTNode *value; char *op; int unchecked; } indexassign;
     };
 };
 
@@ -79,12 +82,13 @@ typedef enum {
     TK_IDENT, TK_NUMBER, TK_STRING,
 
     TK_LET, TK_PRINT, TK_IF, TK_ELSE, TK_WHILE, TK_FOR, TK_IN,
-    TK_FUNC, TK_RETURN, TK_BREAK, TK_CONTINUE, TK_IMPORT,
+    TK_FUNC, TK_RETURN, TK_BREAK, TK_CONTINUE, TK_IMPORT, TK_CONST,
 
     TK_LPAREN, TK_RPAREN, TK_LBRACE, TK_RBRACE,
     TK_LBRACKET, TK_RBRACKET,
     TK_COMMA, TK_SEMI,
     TK_ASSIGN,
+    TK_PLUS_ASSIGN, TK_MINUS_ASSIGN, TK_STAR_ASSIGN, TK_SLASH_ASSIGN, TK_MOD_ASSIGN,
 
     TK_PLUS, TK_MINUS, TK_STAR, TK_SLASH, TK_MOD,
     TK_LT, TK_GT, TK_LE, TK_GE, TK_EQ, TK_NEQ,
@@ -136,15 +140,69 @@ ASTNode *ast_return(ASTNode *e);
 ASTNode *ast_array(ASTNode **items, int count);
 ASTNode *ast_index(ASTNode *arr, ASTNode *idx);
 ASTNode *ast_index_assign(ASTNode *arr, ASTNode *idx, ASTNode *val);
+ASTNode *ast_index_compound(ASTNode *arr, ASTNode *idx, const char *op, ASTNode *val);
 ASTNode *ast_import_c(const char *path);
+ASTNode *ast_cond(ASTNode *c, ASTNode *t, ASTNode *e);
+ASTNode *ast_clone(const ASTNode *n);
 void free_ast(ASTNode *n);
 
 void lex(const char *src, TokVec *out);
 void tv_free(TokVec *v);
 
 ASTNode *parse_program(TokVec *v);
+ASTNode *resolve_constants(ASTNode *root);
 ASTNode *optimize_node(ASTNode *n);
+ASTNode *optimize_program(ASTNode *root);
+ASTNode *ssa_optimize(ASTNode *root);
+
+/* -O level (0-3) and -Os; optimize_program and the peephole pass read them. */
+#define OPT_LEVEL_DEFAULT 2
+extern int g_opt_level;
+extern int g_opt_size;
+
+/* Changes counted by the passes, attributed to each pass by the pass manager for --pass-stats. */
+typedef struct {
+    long folds;
+    long eliminations;
+    long inlines;
+    long rewrites;
+} PassCounts;
+
+typedef struct {
+    PassCounts counts;
+    clock_t start;
+} PassMark;
+
+extern PassCounts g_pass_counts;
+extern int g_pass_stats;
+void pass_mark(PassMark *m);
+int pass_record(const char *name, const PassMark *m);
+void print_pass_stats(void);
 int write_spc(const char *out_path, ASTNode *root);
+int bind_profile(ASTNode *root);
+
+#define PROFILE_BRANCH 1
+#define PROFILE_LOOP 2
+#define PROFILE_CALL 4
+
+/* What a --profile-in run recorded for one site; `known` has a PROFILE_* bit per kind of counter bound to it. */
+typedef struct {
+    int known;
+    unsigned long long executed;   /* the condition's jump ran ... */
+    unsigned long long taken;      /* ... and was taken (the `if` skipped its then-branch, the loop exited) */
+    unsigned long long iterations; /* backward jumps to the loop header */
+    unsigned long long calls;
+    int mixed_types;               /* some argument arrived with more than one type */
+} SiteProfile;
+
+int profile_load(const char *path);
+int profile_matches_code(const uint8_t *code, uint32_t size);
+void profile_bind_site(int kind, int site, uint32_t addr);
+void profile_mark_bound(void);
+const SiteProfile *profile_site(int site);
+int profile_func_calls(const char *name, unsigned long long *calls);
+int profile_is_hot(unsigned long long calls);
+void profile_free(void);
 
 char *read_file(const char *path);
 int is_safe_relative_path(const char *arg);
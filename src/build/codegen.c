@@ -40,6 +40,35 @@ typedef struct {
     int cap;
 } FuncPool;
 
+typedef struct {
+    const char *name;
+    int argc;
+    OpCode op;
+    int operand;
+} Intrinsic;
+
+static const Intrinsic g_intrinsics[] = {
+    { "len", 1, OP_LEN, -1 },
+    { "append", 2, OP_APPEND, -1 },
+    { "abs", 1, OP_ABS, -1 },
+    { "floor", 1, OP_FLOOR, -1 },
+    { "sqrt", 1, OP_SQRT, -1 },
+    { "sin", 1, OP_SIN, -1 },
+    { "cos", 1, OP_COS, -1 },
+    { "min", 2, OP_MINMAX, 0 },
+    { "max", 2, OP_MINMAX, 1 },
+    /* Emitted by the optimizer's bounds-check elimination; not nameable from source. */
+    { "$in_bounds", 3, OP_INDEX_GUARD, -1 },
+    /* Emitted by the optimizer's loop vectorization; the guard's operand counts the arrays. */
+    { "$vec_guard", 4, OP_VEC_GUARD, 1 },
+    { "$vec_guard", 5, OP_VEC_GUARD, 2 },
+    { "$reduce_sum", 4, OP_REDUCE_SUM, -1 },
+    { "$reduce_product", 4, OP_REDUCE_PRODUCT, -1 },
+    { "$reduce_min", 4, OP_REDUCE_MIN, -1 },
+    { "$reduce_max", 4, OP_REDUCE_MAX, -1 },
+    { "$dot", 5, OP_DOT, -1 }
+};
+
 typedef struct {
     uint32_t *break_sites;
     int break_count;
@@ -50,17 +79,65 @@ typedef struct {
     uint32_t continue_target;
 } LoopCtx;
 
+typedef struct {
+    uint32_t *sites;
+    int count;
+    int cap;
+} JumpList;
+
 typedef struct {
     LoopCtx *data;
     int count;
     int cap;
 } LoopStack;
 
+/* An instruction whose runtime counter belongs to a parser site; see bind_profile. */
+typedef struct {
+    int kind;
+    int site;
+    uint32_t addr;
+} SiteRec;
+
+typedef struct {
+    SiteRec *data;
+    int count;
+    int cap;
+} SiteRecs;
+
+/* An `if` arm the profile says rarely runs, emitted after the code of its function. */
+typedef struct {
+    ASTNode *body;
+    JumpList entry;
+    uint32_t resume;
+} ColdArm;
+
+typedef struct {
+    ColdArm *data;
+    int count;
+    int cap;
+} ColdArms;
+
+typedef struct {
+    ASTNode **data;
+    int count;
+    int cap;
+} DefList;
+
+#define COLD_ARM_MIN_RUNS 16
+#define COLD_ARM_SHARE 4
+
 static CodeBuf g_code = {0};
 static ConstPool g_consts = {0};
 static SymPool g_syms = {0};
 static FuncPool g_funcs = {0};
 static LoopStack g_loops = {0};
+static SymPool g_user_funcs = {0};
+static int g_func_depth = 0;
+static SiteRecs g_site_recs = {0};
+static int g_record_sites = 0;
+static ColdArms g_cold_arms = {0};
+static DefList g_hot_defs = {0};
+static DefList g_cold_defs = {0};
 
 static void wr_u8(FILE *f, uint8_t v) { fwrite(&v, 1, 1, f); }
 
@@ -155,7 +232,8 @@ static int sym_index(const char *s) {
 static int const_num_index(double n) {
     int i;
     for (i = 0; i < g_consts.count; i++) {
-        if (g_consts.data[i].type == 0 && g_consts.data[i].number == n) return i;
+        /* Bitwise, so 0 and -0 keep separate entries. */
+        if (g_consts.data[i].type == 0 && memcmp(&g_consts.data[i].number, &n, sizeof(n)) == 0) return i;
     }
     if (g_consts.count >= g_consts.cap) {
         g_consts.cap = g_consts.cap ? g_consts.cap * 2 : 64;
@@ -228,9 +306,449 @@ static void loop_patch_and_pop(uint32_t break_target) {
     g_loops.count--;
 }
 
+static int is_user_func(const char *name) {
+    int i;
+    for (i = 0; i < g_user_funcs.count; i++) {
+        if (strcmp(g_user_funcs.data[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void collect_user_funcs(ASTNode *node) {
+    int i;
+
+    if (!node) return;
+    switch (node->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < node->statements.count; i++) collect_user_funcs(node->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            if (!is_user_func(node->funcdef.name)) {
+                if (g_user_funcs.count >= g_user_funcs.cap) {
+                    g_user_funcs.cap = g_user_funcs.cap ? g_user_funcs.cap * 2 : 16;
+                    g_user_funcs.data = (char **)xrealloc(g_user_funcs.data, sizeof(char *) * (size_t)g_user_funcs.cap);
+                }
+                g_user_funcs.data[g_user_funcs.count++] = xstrdup(node->funcdef.name);
+            }
+            collect_user_funcs(node->funcdef.body);
+            break;
+        case AST_IF:
+            collect_user_funcs(node->ifstmt.then_b);
+            collect_user_funcs(node->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            collect_user_funcs(node->whilestmt.body);
+            break;
+        case AST_FOR:
+            collect_user_funcs(node->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void def_list_push(DefList *list, ASTNode *def) {
+    if (list->count >= list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 16;
+        list->data = (ASTNode **)xrealloc(list->data, sizeof(ASTNode *) * (size_t)list->cap);
+    }
+    list->data[list->count++] = def;
+}
+
+static void collect_defs(ASTNode *node, DefList *out) {
+    int i;
+
+    if (!node) return;
+    switch (node->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < node->statements.count; i++) collect_defs(node->statements.stmts[i], out);
+            break;
+        case AST_FUNC_DEF:
+            def_list_push(out, node);
+            collect_defs(node->funcdef.body, out);
+            break;
+        case AST_IF:
+            collect_defs(node->ifstmt.then_b, out);
+            collect_defs(node->ifstmt.else_b, out);
+            break;
+        case AST_WHILE:
+            collect_defs(node->whilestmt.body, out);
+            break;
+        case AST_FOR:
+            collect_defs(node->forstmt.body, out);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * With a profile, hot functions are emitted together ahead of the program,
+ * hottest first, and functions that never ran go after it. Where a body sits
+ * does not matter to the VM, but the function table order decides which of
+ * two same-named definitions wins, so only uniquely named ones move.
+ */
+static void plan_function_layout(ASTNode *root) {
+    DefList all = {0};
+    int i;
+    int j;
+
+    collect_defs(root, &all);
+    for (i = 0; i < all.count; i++) {
+        ASTNode *def = all.data[i];
+        unsigned long long calls;
+        int same = 0;
+
+        for (j = 0; j < all.count; j++) {
+            if (strcmp(all.data[j]->funcdef.name, def->funcdef.name) == 0) same++;
+        }
+        if (same != 1 || !profile_func_calls(def->funcdef.name, &calls)) continue;
+        if (calls == 0) {
+            def_list_push(&g_cold_defs, def);
+        } else if (profile_is_hot(calls)) {
+            def_list_push(&g_hot_defs, def);
+            for (j = g_hot_defs.count - 1; j > 0; j--) {
+                unsigned long long prev = 0;
+                profile_func_calls(g_hot_defs.data[j - 1]->funcdef.name, &prev);
+                if (prev >= calls) break;
+                g_hot_defs.data[j] = g_hot_defs.data[j - 1];
+                g_hot_defs.data[j - 1] = def;
+            }
+        }
+    }
+    free(all.data);
+}
+
+static int is_moved_def(ASTNode *node) {
+    int i;
+    for (i = 0; i < g_hot_defs.count; i++) {
+        if (g_hot_defs.data[i] == node) return 1;
+    }
+    for (i = 0; i < g_cold_defs.count; i++) {
+        if (g_cold_defs.data[i] == node) return 1;
+    }
+    return 0;
+}
+
+/* Builtins with a dedicated opcode, unless a user function of the same name shadows them. */
+static const Intrinsic *find_intrinsic(ASTNode *call) {
+    size_t i;
+
+    for (i = 0; i < sizeof(g_intrinsics) / sizeof(g_intrinsics[0]); i++) {
+        if (g_intrinsics[i].argc == call->funccall.arg_count &&
+            strcmp(g_intrinsics[i].name, call->funccall.name) == 0) {
+            return is_user_func(call->funccall.name) ? NULL : &g_intrinsics[i];
+        }
+    }
+    return NULL;
+}
+
+/* Maps an arithmetic operator to the opcode the in-place ops carry, or -1. */
+static int arith_opcode(const char *op) {
+    if (!op) return -1;
+    if (strcmp(op, "+") == 0) return OP_ADD;
+    if (strcmp(op, "-") == 0) return OP_SUB;
+    if (strcmp(op, "*") == 0) return OP_MUL;
+    if (strcmp(op, "/") == 0) return OP_DIV;
+    if (strcmp(op, "%") == 0) return OP_MOD;
+    return -1;
+}
+
+/* True if evaluating the expression may run user code (and so write variables). */
+static int has_user_call(ASTNode *node) {
+    int i;
+
+    if (!node) return 0;
+    switch (node->type) {
+        case AST_FUNCTION_CALL:
+            if (!find_intrinsic(node)) return 1;
+            for (i = 0; i < node->funccall.arg_count; i++) {
+                if (has_user_call(node->funccall.args[i])) return 1;
+            }
+            return 0;
+        case AST_BINARY_OP:
+            return has_user_call(node->binop.left) || has_user_call(node->binop.right);
+        case AST_ARRAY:
+            for (i = 0; i < node->arraylit.count; i++) {
+                if (has_user_call(node->arraylit.items[i])) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+            return has_user_call(node->index.array) || has_user_call(node->index.index);
+        case AST_COND:
+            return has_user_call(node->ifstmt.cond) || has_user_call(node->ifstmt.then_b) ||
+                   has_user_call(node->ifstmt.else_b);
+        default:
+            return 0;
+    }
+}
+
+/* Structural equality for call-free index operands, so `a[i] = a[i] op v` can be fused. */
+static int same_operand(ASTNode *a, ASTNode *b) {
+    if (!a || !b || a->type != b->type) return 0;
+    switch (a->type) {
+        case AST_NUMBER:
+            return a->number == b->number;
+        case AST_STRING:
+        case AST_IDENTIFIER:
+            return strcmp(a->string, b->string) == 0;
+        case AST_BINARY_OP:
+            return strcmp(a->binop.op, b->binop.op) == 0 &&
+                   same_operand(a->binop.left, b->binop.left) &&
+                   same_operand(a->binop.right, b->binop.right);
+        case AST_INDEX:
+            return same_operand(a->index.array, b->index.array) &&
+                   same_operand(a->index.index, b->index.index);
+        default:
+            return 0;
+    }
+}
+
 static void emit_node(ASTNode *node);
 static void emit_stmt(ASTNode *node);
 
+static int is_logical_op(ASTNode *node, const char *op) {
+    return node && node->type == AST_BINARY_OP && node->binop.op && strcmp(node->binop.op, op) == 0;
+}
+
+static void jump_list_patch(JumpList *list, uint32_t target) {
+    int i;
+    for (i = 0; i < list->count; i++) code_patch_u32(list->sites[i], target);
+    free(list->sites);
+    list->sites = NULL;
+    list->count = 0;
+    list->cap = 0;
+}
+
+static void note_site(int kind, int site, uint32_t addr) {
+    SiteRec *r;
+
+    if (!g_record_sites || site <= 0) return;
+    if (g_site_recs.count >= g_site_recs.cap) {
+        g_site_recs.cap = g_site_recs.cap ? g_site_recs.cap * 2 : 64;
+        g_site_recs.data = (SiteRec *)xrealloc(g_site_recs.data, sizeof(SiteRec) * (size_t)g_site_recs.cap);
+    }
+    r = &g_site_recs.data[g_site_recs.count++];
+    r->kind = kind;
+    r->site = site;
+    r->addr = addr;
+}
+
+/* Records a condition's jump when it is the only one, so its counters describe the whole test. */
+static void note_branch(int site, ASTNode *cond, const JumpList *jumps) {
+    while (is_logical_op(cond, "!")) cond = cond->binop.left;
+    if (jumps->count != 1 || is_logical_op(cond, "&&") || is_logical_op(cond, "||")) return;
+    note_site(PROFILE_BRANCH, site, jumps->sites[0] - 1u);
+}
+
+/* True if the statement breaks or continues a loop around it. */
+static int exits_loop(ASTNode *node) {
+    int i;
+
+    if (!node) return 0;
+    switch (node->type) {
+        case AST_BREAK:
+        case AST_CONTINUE:
+            return 1;
+        case AST_STATEMENTS:
+            for (i = 0; i < node->statements.count; i++) {
+                if (exits_loop(node->statements.stmts[i])) return 1;
+            }
+            return 0;
+        case AST_IF:
+            return exits_loop(node->ifstmt.then_b) || exits_loop(node->ifstmt.else_b);
+        default:
+            return 0;
+    }
+}
+
+/* 1 if the profile says the then-branch of `node` rarely runs, 2 if its else-branch does, else 0. */
+static int cold_arm(ASTNode *node) {
+    const SiteProfile *sp = profile_site(node->site);
+    unsigned long long then_runs;
+
+    if (!sp || !(sp->known & PROFILE_BRANCH) || sp->executed < COLD_ARM_MIN_RUNS) return 0;
+    then_runs = sp->executed - sp->taken;
+    /* Loop exits stay in place: the loop's jump lists are patched before cold arms are emitted. */
+    if (then_runs * COLD_ARM_SHARE <= sp->executed && node->ifstmt.then_b && !exits_loop(node->ifstmt.then_b)) return 1;
+    if (sp->taken * COLD_ARM_SHARE <= sp->executed && node->ifstmt.else_b && !exits_loop(node->ifstmt.else_b)) return 2;
+    return 0;
+}
+
+/* Queues `body` to be emitted later, entered through `entry` and resuming at the current position. */
+static void defer_cold_arm(ASTNode *body, JumpList *entry) {
+    ColdArm *arm;
+
+    if (g_cold_arms.count >= g_cold_arms.cap) {
+        g_cold_arms.cap = g_cold_arms.cap ? g_cold_arms.cap * 2 : 8;
+        g_cold_arms.data = (ColdArm *)xrealloc(g_cold_arms.data, sizeof(ColdArm) * (size_t)g_cold_arms.cap);
+    }
+    arm = &g_cold_arms.data[g_cold_arms.count++];
+    arm->body = body;
+    arm->entry = *entry;
+    arm->resume = code_pos();
+    memset(entry, 0, sizeof(*entry));
+}
+
+/* Emits the arms queued since `from`, including any their own bodies queue. */
+static void emit_cold_arms(int from) {
+    int i;
+
+    for (i = from; i < g_cold_arms.count; i++) {
+        ColdArm arm = g_cold_arms.data[i];
+        jump_list_patch(&arm.entry, code_pos());
+        emit_stmt(arm.body);
+        code_emit_op(OP_JMP);
+        code_emit_u32(arm.resume);
+    }
+    g_cold_arms.count = from;
+}
+
+/*
+ * Emits a jump, recorded in `out`, taken when `cond` is truthy (when_true)
+ * or falsy (!when_true); otherwise control falls through. `&&`, `||` and `!`
+ * become jump chains so the right operand only runs when it decides the result.
+ */
+static void emit_branch(ASTNode *cond, int when_true, JumpList *out) {
+    if (is_logical_op(cond, "!")) {
+        emit_branch(cond->binop.left, !when_true, out);
+        return;
+    }
+    if (is_logical_op(cond, "&&") || is_logical_op(cond, "||")) {
+        int is_and = is_logical_op(cond, "&&");
+        if (is_and != when_true) {
+            /* a && b jumps on false, a || b on true, as soon as either side does. */
+            emit_branch(cond->binop.left, when_true, out);
+            emit_branch(cond->binop.right, when_true, out);
+        } else {
+            JumpList skip = {0};
+            emit_branch(cond->binop.left, !when_true, &skip);
+            emit_branch(cond->binop.right, when_true, out);
+            jump_list_patch(&skip, code_pos());
+        }
+        return;
+    }
+    emit_node(cond);
+    code_emit_op(when_true ? OP_JMP_IF_TRUE : OP_JMP_IF_FALSE);
+    vec_u32_push(&out->sites, &out->count, &out->cap, code_emit_u32_placeholder());
+}
+
+/* Lowers `x = x op e` (and `x = e op x` for commutative numeric ops) to an in-place op. */
+static int emit_compound_assign(ASTNode *node, int si) {
+    ASTNode *v = node->var.value;
+    ASTNode *rhs;
+    int aop;
+
+    if (!v || v->type != AST_BINARY_OP || !v->binop.left || !v->binop.right) return 0;
+    aop = arith_opcode(v->binop.op);
+    if (aop < 0) return 0;
+    if (v->binop.left->type == AST_IDENTIFIER && strcmp(v->binop.left->string, node->var.name) == 0) {
+        rhs = v->binop.right;
+    } else if ((aop == OP_ADD || aop == OP_MUL) &&
+               v->binop.left->type == AST_NUMBER &&
+               v->binop.right->type == AST_IDENTIFIER &&
+               strcmp(v->binop.right->string, node->var.name) == 0) {
+        rhs = v->binop.left;
+    } else {
+        return 0;
+    }
+
+    if (rhs->type == AST_NUMBER && rhs->number == 1.0 && (aop == OP_ADD || aop == OP_SUB)) {
+        code_emit_op(aop == OP_ADD ? OP_INC : OP_DEC);
+        code_emit_u16((uint16_t)si);
+    } else if (rhs->type == AST_NUMBER || rhs->type == AST_STRING) {
+        int ci = rhs->type == AST_NUMBER ? const_num_index(rhs->number) : const_str_index(rhs->string);
+        code_emit_op(OP_IOP_CONST);
+        code_emit_u16((uint16_t)si);
+        code_emit_u8((uint8_t)aop);
+        code_emit_u16((uint16_t)ci);
+    } else if (rhs->type == AST_IDENTIFIER) {
+        code_emit_op(OP_IOP_VAR);
+        code_emit_u16((uint16_t)si);
+        code_emit_u8((uint8_t)aop);
+        code_emit_u16((uint16_t)sym_index(rhs->string));
+    } else if (!has_user_call(rhs)) {
+        /* The target is read after `rhs` runs, which is only safe if `rhs` cannot write it. */
+        emit_node(rhs);
+        code_emit_op(OP_IOP);
+        code_emit_u16((uint16_t)si);
+        code_emit_u8((uint8_t)aop);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void emit_index_assign(ASTNode *node) {
+    ASTNode *v = node->indexassign.value;
+    int aop = -1;
+
+    if (node->indexassign.op) {
+        aop = arith_opcode(node->indexassign.op);
+        if (aop < 0) die("spbuild: unsupported compound assignment");
+    } else if (v && v->type == AST_BINARY_OP && v->binop.left && v->binop.left->type == AST_INDEX &&
+               same_operand(v->binop.left->index.array, node->indexassign.array) &&
+               same_operand(v->binop.left->index.index, node->indexassign.index) &&
+               !has_user_call(v->binop.right)) {
+        aop = arith_opcode(v->binop.op);
+        if (aop >= 0) v = v->binop.right;
+    }
+
+    emit_node(node->indexassign.array);
+    emit_node(node->indexassign.index);
+    emit_node(v);
+    if (aop >= 0) {
+        code_emit_op(OP_INDEX_IOP);
+        code_emit_u8((uint8_t)aop);
+    } else if (node->indexassign.unchecked) {
+        code_emit_op(OP_INDEX_SET_UNCHECKED);
+    } else {
+        code_emit_op(OP_INDEX_SET);
+        code_emit_op(OP_POP);
+    }
+}
+
+static void emit_call(ASTNode *node, int tail) {
+    int i;
+    int si;
+    const Intrinsic *in = find_intrinsic(node);
+
+    for (i = 0; i < node->funccall.arg_count; i++) emit_node(node->funccall.args[i]);
+    if (strcmp(node->funccall.name, "$vec_map") == 0) {
+        /* Emitted by the optimizer's map-loop vectorization; the program string is the last argument. */
+        code_emit_op(OP_VEC_MAP);
+        if (tail) code_emit_op(OP_RET);
+        return;
+    }
+    if (node->funccall.frame && !tail) {
+        /* A builtin slice() whose result mark_frame_allocations kept in this frame. */
+        code_emit_op(OP_SLICE_FRAME);
+        return;
+    }
+    if (in) {
+        code_emit_op(in->op);
+        if (in->operand >= 0) code_emit_u8((uint8_t)in->operand);
+        if (tail) code_emit_op(OP_RET);
+        return;
+    }
+    si = sym_index(node->funccall.name);
+    note_site(PROFILE_CALL, node->site, code_pos());
+    if (tail) {
+        /* Builtins and natives fall through to the OP_RET that follows. */
+        code_emit_op(OP_TAILCALL);
+        code_emit_u16((uint16_t)si);
+        code_emit_u16((uint16_t)node->funccall.arg_count);
+        code_emit_op(OP_RET);
+    } else if (node->funccall.arg_count == 1) {
+        code_emit_op(OP_CALL1);
+        code_emit_u16((uint16_t)si);
+    } else {
+        code_emit_op(OP_CALL);
+        code_emit_u16((uint16_t)si);
+        code_emit_u16((uint16_t)node->funccall.arg_count);
+    }
+}
+
 static void emit_node(ASTNode *node) {
     int i;
 
@@ -254,52 +772,70 @@ static void emit_node(ASTNode *node) {
         }
         case AST_BINARY_OP: {
             const char *op = node->binop.op ? node->binop.op : "";
+            if (strcmp(op, "&&") == 0 || strcmp(op, "||") == 0) {
+                JumpList is_false = {0};
+                uint32_t end_site;
+                emit_branch(node, 0, &is_false);
+                emit_push_number(1.0);
+                code_emit_op(OP_JMP);
+                end_site = code_emit_u32_placeholder();
+                jump_list_patch(&is_false, code_pos());
+                emit_push_number(0.0);
+                code_patch_u32(end_site, code_pos());
+                break;
+            }
+            if (strcmp(op, "*") == 0 && node->binop.right &&
+                node->binop.right->type == AST_NUMBER && node->binop.right->number == -1.0) {
+                /* Unary minus parses as `-1 * e`; the optimizer moves the -1 to the right. */
+                emit_node(node->binop.left);
+                code_emit_op(OP_NEG);
+                break;
+            }
             emit_node(node->binop.left);
             if (strcmp(op, "!") == 0) {
                 code_emit_op(OP_NOT);
                 break;
             }
             emit_node(node->binop.right);
-            if (strcmp(op, "+") == 0) code_emit_op(OP_ADD);
+            if (strcmp(op, "+") == 0) code_emit_op(node->binop.numeric ? OP_ADD_NUM : OP_ADD);
             else if (strcmp(op, "-") == 0) code_emit_op(OP_SUB);
             else if (strcmp(op, "*") == 0) code_emit_op(OP_MUL);
             else if (strcmp(op, "/") == 0) code_emit_op(OP_DIV);
             else if (strcmp(op, "%") == 0) code_emit_op(OP_MOD);
-            else if (strcmp(op, "==") == 0) code_emit_op(OP_EQ);
-            else if (strcmp(op, "!=") == 0) code_emit_op(OP_NEQ);
+            else if (strcmp(op, "==") == 0) code_emit_op(node->binop.numeric ? OP_EQ_NUM : OP_EQ);
+            else if (strcmp(op, "!=") == 0) code_emit_op(node->binop.numeric ? OP_NEQ_NUM : OP_NEQ);
             else if (strcmp(op, "<") == 0) code_emit_op(OP_LT);
             else if (strcmp(op, ">") == 0) code_emit_op(OP_GT);
             else if (strcmp(op, "<=") == 0) code_emit_op(OP_LTE);
             else if (strcmp(op, ">=") == 0) code_emit_op(OP_GTE);
-            else if (strcmp(op, "&&") == 0) code_emit_op(OP_AND);
-            else if (strcmp(op, "||") == 0) code_emit_op(OP_OR);
             else die("spbuild: unsupported binary op");
             break;
         }
-        case AST_FUNCTION_CALL: {
-            int si;
-            for (i = 0; i < node->funccall.arg_count; i++) emit_node(node->funccall.args[i]);
-            si = sym_index(node->funccall.name);
-            if (node->funccall.arg_count == 1) {
-                code_emit_op(OP_CALL1);
-                code_emit_u16((uint16_t)si);
-            } else {
-                code_emit_op(OP_CALL);
-                code_emit_u16((uint16_t)si);
-                code_emit_u16((uint16_t)node->funccall.arg_count);
-            }
+        case AST_FUNCTION_CALL:
+            emit_call(node, 0);
             break;
-        }
         case AST_ARRAY:
             for (i = 0; i < node->arraylit.count; i++) emit_node(node->arraylit.items[i]);
-            code_emit_op(OP_ARRAY_NEW);
+            code_emit_op(node->arraylit.frame ? OP_ARRAY_NEW_FRAME : OP_ARRAY_NEW);
             code_emit_u16((uint16_t)node->arraylit.count);
             break;
         case AST_INDEX:
             emit_node(node->index.array);
             emit_node(node->index.index);
-            code_emit_op(OP_INDEX_GET);
+            code_emit_op(node->index.unchecked ? OP_INDEX_GET_UNCHECKED : OP_INDEX_GET);
             break;
+        case AST_COND: {
+            JumpList is_false = {0};
+            uint32_t end_site;
+            emit_branch(node->ifstmt.cond, 0, &is_false);
+            emit_node(node->ifstmt.then_b);
+            code_emit_op(OP_JMP);
+            end_site = code_emit_u32_placeholder();
+            jump_list_patch(&is_false, code_pos());
+            emit_node(node->ifstmt.else_b);
+            code_patch_u32(end_site, code_pos());
+            break;
+        }
         default:
             die("spbuild: unsupported expression node");
     }
@@ -308,6 +844,7 @@ static void emit_node(ASTNode *node) {
 static void emit_function(ASTNode *node) {
     BCFunc *f;
     uint32_t skip_site;
+    int arms;
     int i;
 
     code_emit_op(OP_JMP);
@@ -330,9 +867,13 @@ static void emit_function(ASTNode *node) {
         }
     }
 
+    g_func_depth++;
+    arms = g_cold_arms.count;
     emit_stmt(node->funcdef.body);
     emit_push_number(0.0);
     code_emit_op(OP_RET);
+    emit_cold_arms(arms);
+    g_func_depth--;
 
     code_patch_u32(skip_site, code_pos());
 }
@@ -347,7 +888,7 @@ static void emit_stmt(ASTNode *node) {
             for (i = 0; i < node->statements.count; i++) emit_stmt(node->statements.stmts[i]);
             break;
         case AST_FUNC_DEF:
-            emit_function(node);
+            if (!is_moved_def(node)) emit_function(node);
             break;
         case AST_PRINT:
             emit_node(node->print.expr);
@@ -356,69 +897,48 @@ static void emit_stmt(ASTNode *node) {
         case AST_LET:
         case AST_ASSIGN: {
             int si = sym_index(node->var.name);
-            if (node->type == AST_ASSIGN &&
-                node->var.value &&
-                node->var.value->type == AST_BINARY_OP &&
-                node->var.value->binop.left &&
-                node->var.value->binop.left->type == AST_IDENTIFIER &&
-                strcmp(node->var.value->binop.left->string, node->var.name) == 0 &&
-                node->var.value->binop.right) {
-                if (node->var.value->binop.right->type == AST_NUMBER &&
-                    node->var.value->binop.right->number == 1.0) {
-                    if (strcmp(node->var.value->binop.op, "+") == 0) {
-                        code_emit_op(OP_INC);
-                        code_emit_u16((uint16_t)si);
-                        break;
-                    }
-                    if (strcmp(node->var.value->binop.op, "-") == 0) {
-                        code_emit_op(OP_DEC);
-                        code_emit_u16((uint16_t)si);
-                        break;
-                    }
-                }
-                if (strcmp(node->var.value->binop.op, "+") == 0 &&
-                    node->var.value->binop.right->type == AST_IDENTIFIER) {
-                    int rhs = sym_index(node->var.value->binop.right->string);
-                    code_emit_op(OP_IADD_VAR);
-                    code_emit_u16((uint16_t)si);
-                    code_emit_u16((uint16_t)rhs);
-                    break;
-                }
-            }
+            if (node->type == AST_ASSIGN && emit_compound_assign(node, si)) break;
             emit_node(node->var.value);
             code_emit_op(OP_STORE);
             code_emit_u16((uint16_t)si);
             break;
         }
         case AST_IF: {
-            uint32_t jf_site;
-            emit_node(node->ifstmt.cond);
-            code_emit_op(OP_JMP_IF_FALSE);
-            jf_site = code_emit_u32_placeholder();
+            JumpList jf = {0};
+            int cold = cold_arm(node);
+            if (cold) {
+                /* The likely arm falls through; the cold one is entered by the jump. */
+                emit_branch(node->ifstmt.cond, cold == 1, &jf);
+                emit_stmt(cold == 1 ? node->ifstmt.else_b : node->ifstmt.then_b);
+                defer_cold_arm(cold == 1 ? node->ifstmt.then_b : node->ifstmt.else_b, &jf);
+                break;
+            }
+            emit_branch(node->ifstmt.cond, 0, &jf);
+            note_branch(node->site, node->ifstmt.cond, &jf);
             emit_stmt(node->ifstmt.then_b);
             if (node->ifstmt.else_b) {
                 uint32_t jend_site;
                 code_emit_op(OP_JMP);
                 jend_site = code_emit_u32_placeholder();
-                code_patch_u32(jf_site, code_pos());
+                jump_list_patch(&jf, code_pos());
                 emit_stmt(node->ifstmt.else_b);
                 code_patch_u32(jend_site, code_pos());
             } else {
-                code_patch_u32(jf_site, code_pos());
+                jump_list_patch(&jf, code_pos());
             }
             break;
         }
         case AST_WHILE: {
             uint32_t loop_start = code_pos();
-            uint32_t jf_site;
-            emit_node(node->whilestmt.cond);
-            code_emit_op(OP_JMP_IF_FALSE);
-            jf_site = code_emit_u32_placeholder();
+            JumpList jf = {0};
+            note_site(PROFILE_LOOP, node->site, loop_start);
+            emit_branch(node->whilestmt.cond, 0, &jf);
+            note_branch(node->site, node->whilestmt.cond, &jf);
             loop_push(loop_start);
             emit_stmt(node->whilestmt.body);
             code_emit_op(OP_JMP);
             code_emit_u32(loop_start);
-            code_patch_u32(jf_site, code_pos());
+            jump_list_patch(&jf, code_pos());
             loop_patch_and_pop(code_pos());
             break;
         }
@@ -433,10 +953,12 @@ static void emit_stmt(ASTNode *node) {
             code_emit_u16((uint16_t)v);
 
             loop_start = code_pos();
+            note_site(PROFILE_LOOP, node->site, loop_start);
             code_emit_op(OP_LOAD);
             code_emit_u16((uint16_t)v);
             emit_node(node->forstmt.end);
             code_emit_op(OP_LTE);
+            note_site(PROFILE_BRANCH, node->site, code_pos());
             code_emit_op(OP_JMP_IF_FALSE);
             jf_site = code_emit_u32_placeholder();
 
@@ -473,16 +995,16 @@ static void emit_stmt(ASTNode *node) {
             break;
         }
         case AST_RETURN:
+            if (g_func_depth > 0 && node->retstmt.expr && node->retstmt.expr->type == AST_FUNCTION_CALL) {
+                emit_call(node->retstmt.expr, 1);
+                break;
+            }
             if (node->retstmt.expr) emit_node(node->retstmt.expr);
             else emit_push_number(0.0);
             code_emit_op(OP_RET);
             break;
         case AST_INDEX_ASSIGN:
-            emit_node(node->indexassign.array);
-            emit_node(node->indexassign.index);
-            emit_node(node->indexassign.value);
-            code_emit_op(OP_INDEX_SET);
-            code_emit_op(OP_POP);
+            emit_index_assign(node);
             break;
         case AST_IMPORT_C: {
             int si = sym_index(node->string);
@@ -501,6 +1023,279 @@ static void emit_stmt(ASTNode *node) {
     }
 }
 
+/*
+ * Peephole pass over the finished code. Jumps are threaded through
+ * unconditional jumps (and a jump to OP_RET/OP_HALT becomes that op), code
+ * that no path from the entry or a function reaches is dropped, jumps to the
+ * next instruction go away, and `OP_STORE x; OP_LOAD x` becomes
+ * OP_STORE_KEEP unless the load is a jump target. The code is then re-emitted
+ * with every jump operand and BCFunc.addr relocated.
+ */
+typedef struct {
+    uint32_t addr;
+    uint8_t op;
+    int len;
+    int target;     /* jumps: index of the target instruction */
+    int live;
+    uint32_t new_addr;
+} Insn;
+
+/* Operand bytes after each opcode, mirroring the fetches in the runtime's dispatch loop. */
+static int op_operand_bytes(uint8_t op) {
+    switch ((OpCode)op) {
+        case OP_PUSH_CONST:
+        case OP_LOAD:
+        case OP_STORE:
+        case OP_STORE_KEEP:
+        case OP_CALL1:
+        case OP_ARRAY_NEW:
+        case OP_ARRAY_NEW_FRAME:
+        case OP_IMPORT:
+        case OP_INC:
+        case OP_DEC:
+            return 2;
+        case OP_MINMAX:
+        case OP_VEC_GUARD:
+        case OP_INDEX_IOP:
+            return 1;
+        case OP_IOP:
+            return 3;
+        case OP_CALL:
+        case OP_TAILCALL:
+        case OP_IADD_VAR:
+        case OP_JMP:
+        case OP_JMP_IF_FALSE:
+        case OP_JMP_IF_TRUE:
+            return 4;
+        case OP_IOP_CONST:
+        case OP_IOP_VAR:
+            return 5;
+        default:
+            return 0;
+    }
+}
+
+static int is_jump_op(uint8_t op) {
+    return op == OP_JMP || op == OP_JMP_IF_FALSE || op == OP_JMP_IF_TRUE;
+}
+
+static uint32_t code_read_u32(uint32_t at) {
+    return (uint32_t)g_code.data[at] | ((uint32_t)g_code.data[at + 1] << 8) |
+           ((uint32_t)g_code.data[at + 2] << 16) | ((uint32_t)g_code.data[at + 3] << 24);
+}
+
+/* Splits g_code into instructions; 0 if the stream or a jump target does not decode. */
+static int decode_code(Insn **out, int *out_count, int **out_at) {
+    Insn *insns = NULL;
+    int count = 0;
+    int cap = 0;
+    int *at = (int *)xmalloc(sizeof(int) * (size_t)(g_code.count + 1));
+    uint32_t pc = 0;
+    int i;
+
+    for (i = 0; i <= g_code.count; i++) at[i] = -1;
+    while ((int)pc < g_code.count) {
+        Insn *in;
+        if (count >= cap) {
+            cap = cap ? cap * 2 : 256;
+            insns = (Insn *)xrealloc(insns, sizeof(Insn) * (size_t)cap);
+        }
+        in = &insns[count];
+        memset(in, 0, sizeof(*in));
+        in->addr = pc;
+        in->op = g_code.data[pc];
+        in->len = 1 + op_operand_bytes(in->op);
+        in->target = -1;
+        if ((int)pc + in->len > g_code.count) break;
+        at[pc] = count++;
+        pc += (uint32_t)in->len;
+    }
+    for (i = 0; i < count && (int)pc == g_code.count; i++) {
+        uint32_t t;
+        if (!is_jump_op(insns[i].op)) continue;
+        t = code_read_u32(insns[i].addr + 1);
+        if ((int)t >= g_code.count || at[t] < 0) break;
+        insns[i].target = at[t];
+    }
+    if ((int)pc != g_code.count || i < count) {
+        free(insns);
+        free(at);
+        return 0;
+    }
+    *out = insns;
+    *out_count = count;
+    *out_at = at;
+    return 1;
+}
+
+/* Follows a chain of unconditional jumps to where it ends. */
+static int thread_target(Insn *insns, int count, int t) {
+    int hops = 0;
+    while (insns[t].op == OP_JMP && hops++ < count) t = insns[t].target;
+    return t;
+}
+
+static void mark_reachable(Insn *insns, int count, int start) {
+    int *stack = (int *)xmalloc(sizeof(int) * (size_t)count);
+    int sp = 0;
+
+    if (insns[start].live) {
+        free(stack);
+        return;
+    }
+    insns[start].live = 1;
+    stack[sp++] = start;
+    while (sp > 0) {
+        int i = stack[--sp];
+        int next[2];
+        int n = 0;
+        int k;
+        uint8_t op = insns[i].op;
+        if (is_jump_op(op)) next[n++] = insns[i].target;
+        if (op != OP_JMP && op != OP_RET && op != OP_HALT && i + 1 < count) next[n++] = i + 1;
+        for (k = 0; k < n; k++) {
+            if (insns[next[k]].live) continue;
+            insns[next[k]].live = 1;
+            stack[sp++] = next[k];
+        }
+    }
+    free(stack);
+}
+
+/* One round of the peephole pass; returns 1 if the code changed. */
+static int optimize_code_round(void) {
+    Insn *insns;
+    int count;
+    int *at;
+    int *is_target;
+    uint8_t *out;
+    uint32_t pos = 0;
+    int changed = 0;
+    int i;
+
+    if (g_code.count == 0 || !decode_code(&insns, &count, &at)) return 0;
+
+    for (i = 0; i < count; i++) {
+        int t;
+        if (!is_jump_op(insns[i].op)) continue;
+        t = thread_target(insns, count, insns[i].target);
+        if (insns[t].op == OP_JMP) continue; /* a cycle of jumps: leave it */
+        if (t != insns[i].target) {
+            g_pass_counts.rewrites++;
+            changed = 1;
+        }
+        insns[i].target = t;
+        if (insns[i].op == OP_JMP && (insns[t].op == OP_RET || insns[t].op == OP_HALT)) {
+            insns[i].op = insns[t].op;
+            insns[i].len = 1;
+            insns[i].target = -1;
+            g_pass_counts.rewrites++;
+            changed = 1;
+        }
+    }
+    for (i = 0; i < g_funcs.count; i++) {
+        int e = at[g_funcs.data[i].addr];
+        if (insns[e].op == OP_JMP) e = thread_target(insns, count, e);
+        if (insns[e].op != OP_JMP) g_funcs.data[i].addr = insns[e].addr;
+    }
+
+    mark_reachable(insns, count, 0);
+    for (i = 0; i < g_funcs.count; i++) mark_reachable(insns, count, at[g_funcs.data[i].addr]);
+
+    /* A jump to the next live instruction: unconditional ones vanish, conditional ones just pop. */
+    for (i = 0; i < count; i++) {
+        int next = i + 1;
+        if (!insns[i].live || !is_jump_op(insns[i].op)) continue;
+        while (next < count && !insns[next].live) next++;
+        if (insns[i].target != next) continue;
+        if (insns[i].op == OP_JMP) {
+            insns[i].live = 0;
+        } else {
+            insns[i].op = OP_POP;
+            insns[i].len = 1;
+            insns[i].target = -1;
+            g_pass_counts.rewrites++;
+        }
+        changed = 1;
+    }
+
+    is_target = (int *)xmalloc(sizeof(int) * (size_t)count);
+    memset(is_target, 0, sizeof(int) * (size_t)count);
+    for (i = 0; i < count; i++) {
+        if (insns[i].live && insns[i].target >= 0) is_target[insns[i].target] = 1;
+    }
+    for (i = 0; i < g_funcs.count; i++) is_target[at[g_funcs.data[i].addr]] = 1;
+    for (i = 0; i < count; i++) {
+        int next = i + 1;
+        if (!insns[i].live || insns[i].op != OP_STORE) continue;
+        while (next < count && !insns[next].live) next++;
+        if (next >= count || insns[next].op != OP_LOAD || is_target[next]) continue;
+        if (memcmp(&g_code.data[insns[i].addr + 1], &g_code.data[insns[next].addr + 1], 2) != 0) continue;
+        insns[i].op = OP_STORE_KEEP;
+        insns[next].live = 0;
+        changed = 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (insns[i].live) continue;
+        g_pass_counts.eliminations++;
+        changed = 1;
+    }
+    if (!changed) {
+        free(is_target);
+        free(insns);
+        free(at);
+        return 0;
+    }
+
+    /* A dropped instruction relocates to the next one kept. */
+    for (i = 0; i < count; i++) {
+        insns[i].new_addr = pos;
+        if (insns[i].live) pos += (uint32_t)insns[i].len;
+    }
+    out = (uint8_t *)xmalloc(pos ? pos : 1);
+    for (i = 0; i < count; i++) {
+        uint8_t *p;
+        if (!insns[i].live) continue;
+        p = out + insns[i].new_addr;
+        memcpy(p, &g_code.data[insns[i].addr], (size_t)insns[i].len);
+        p[0] = insns[i].op;
+        if (insns[i].target >= 0) {
+            uint32_t t = insns[insns[i].target].new_addr;
+            p[1] = (uint8_t)(t & 0xFF);
+            p[2] = (uint8_t)((t >> 8) & 0xFF);
+            p[3] = (uint8_t)((t >> 16) & 0xFF);
+            p[4] = (uint8_t)((t >> 24) & 0xFF);
+        }
+    }
+    for (i = 0; i < g_funcs.count; i++) g_funcs.data[i].addr = insns[at[g_funcs.data[i].addr]].new_addr;
+    for (i = 0; i < g_site_recs.count; i++) {
+        /* A counter whose instruction went away, or stopped being a conditional jump, has nothing to bind. */
+        SiteRec *r = &g_site_recs.data[i];
+        int k = r->site > 0 ? at[r->addr] : -1;
+        if (k < 0 || !insns[k].live || (r->kind == PROFILE_BRANCH && (!is_jump_op(insns[k].op) || insns[k].op == OP_JMP))) {
+            r->site = 0;
+        } else {
+            r->addr = insns[k].new_addr;
+        }
+    }
+
+    free(g_code.data);
+    g_code.data = out;
+    g_code.count = (int)pos;
+    g_code.cap = (int)(pos ? pos : 1);
+    free(is_target);
+    free(insns);
+    free(at);
+    return 1;
+}
+
+static void optimize_code(void) {
+    int rounds = 0;
+    while (rounds++ < 8 && optimize_code_round()) {
+    }
+}
+
 static void free_codegen_state(void) {
     int i;
 
@@ -526,16 +1321,79 @@ static void free_codegen_state(void) {
     free(g_loops.data);
     g_loops.data = NULL;
     g_loops.count = g_loops.cap = 0;
+
+    for (i = 0; i < g_user_funcs.count; i++) free(g_user_funcs.data[i]);
+    free(g_user_funcs.data);
+    g_user_funcs.data = NULL;
+    g_user_funcs.count = g_user_funcs.cap = 0;
+    g_func_depth = 0;
+
+    free(g_site_recs.data);
+    memset(&g_site_recs, 0, sizeof(g_site_recs));
+    free(g_cold_arms.data);
+    memset(&g_cold_arms, 0, sizeof(g_cold_arms));
+    free(g_hot_defs.data);
+    memset(&g_hot_defs, 0, sizeof(g_hot_defs));
+    free(g_cold_defs.data);
+    memset(&g_cold_defs, 0, sizeof(g_cold_defs));
 }
 
-int write_spc(const char *out_path, ASTNode *root) {
-    int fd;
-    FILE *f;
+static void generate_code(ASTNode *root) {
     int i;
 
     free_codegen_state();
+    collect_user_funcs(root);
+    plan_function_layout(root);
+    if (g_hot_defs.count > 0) {
+        uint32_t skip_site;
+        code_emit_op(OP_JMP);
+        skip_site = code_emit_u32_placeholder();
+        for (i = 0; i < g_hot_defs.count; i++) emit_function(g_hot_defs.data[i]);
+        code_patch_u32(skip_site, code_pos());
+    }
     emit_stmt(root);
     code_emit_op(OP_HALT);
+    emit_cold_arms(0);
+    for (i = 0; i < g_cold_defs.count; i++) emit_function(g_cold_defs.data[i]);
+    if (g_opt_level > 0) {
+        PassMark m;
+        pass_mark(&m);
+        optimize_code();
+        pass_record("peephole", &m);
+    }
+}
+
+/*
+ * Generates code for `root` as a build without a profile would, checks it is
+ * the code the loaded profile was recorded on, and binds each counter to the
+ * site that produced it. Returns 0, binding nothing, if the code differs.
+ */
+int bind_profile(ASTNode *root) {
+    int ok;
+    int i;
+
+    g_record_sites = 1;
+    generate_code(root);
+    g_record_sites = 0;
+    ok = profile_matches_code(g_code.data, (uint32_t)g_code.count);
+    if (ok) {
+        for (i = 0; i < g_site_recs.count; i++) {
+            if (g_site_recs.data[i].site > 0) {
+                profile_bind_site(g_site_recs.data[i].kind, g_site_recs.data[i].site, g_site_recs.data[i].addr);
+            }
+        }
+        profile_mark_bound();
+    }
+    free_codegen_state();
+    return ok;
+}
+
+int write_spc(const char *out_path, ASTNode *root) {
+    int fd;
+    FILE *f;
+    int i;
+
+    generate_code(root);
 
     fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
     if (fd < 0) return 0;
@@ -159,12 +159,126 @@ ASTNode *ast_index_assign(ASTNode *arr, ASTNode *idx, ASTNode *val) {
     return n;
 }
 
+ASTNode *ast_index_compound(ASTNode *arr, ASTNode *idx, const char *op, ASTNode *val) {
+    ASTNode *n = ast_index_assign(arr, idx, val);
+    n->indexassign.op = xstrdup(op);
+    return n;
+}
+
 ASTNode *ast_import_c(const char *path) {
     ASTNode *n = ast_new(AST_IMPORT_C);
     n->string = xstrdup(path);
     return n;
 }
 
+/* Expression form of an if/else, produced by the optimizer; there is no surface syntax for it. */
+ASTNode *ast_cond(ASTNode *c, ASTNode *t, ASTNode *e) {
+    ASTNode *n = ast_if(c, t, e);
+    n->type = AST_COND;
+    return n;
+}
+
+static ASTNode **clone_list(ASTNode **items, int count) {
+    ASTNode **out;
+    int i;
+
+    if (count <= 0) return NULL;
+    out = (ASTNode **)xmalloc(sizeof(ASTNode *) * (size_t)count);
+    for (i = 0; i < count; i++) out[i] = ast_clone(items[i]);
+    return out;
+}
+
+ASTNode *ast_clone(const ASTNode *n) {
+    ASTNode *c;
+    int i;
+
+    if (!n) return NULL;
+    c = ast_new(n->type);
+    c->site = n->site;
+    switch (n->type) {
+        case AST_NUMBER:
+            c->number = n->number;
+            break;
+        case AST_STRING:
+        case AST_IDENTIFIER:
+        case AST_IMPORT_C:
+            c->string = xstrdup(n->string);
+            break;
+        case AST_BINARY_OP:
+            c->binop.op = xstrdup(n->binop.op);
+            c->binop.left = ast_clone(n->binop.left);
+            c->binop.right = ast_clone(n->binop.right);
+            c->binop.numeric = n->binop.numeric;
+            break;
+        case AST_PRINT:
+            c->print.expr = ast_clone(n->print.expr);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            c->var.name = xstrdup(n->var.name);
+            c->var.value = ast_clone(n->var.value);
+            break;
+        case AST_STATEMENTS:
+            c->statements.stmts = clone_list(n->statements.stmts, n->statements.count);
+            c->statements.count = n->statements.count;
+            break;
+        case AST_WHILE:
+            c->whilestmt.cond = ast_clone(n->whilestmt.cond);
+            c->whilestmt.body = ast_clone(n->whilestmt.body);
+            break;
+        case AST_IF:
+        case AST_COND:
+            c->ifstmt.cond = ast_clone(n->ifstmt.cond);
+            c->ifstmt.then_b = ast_clone(n->ifstmt.then_b);
+            c->ifstmt.else_b = ast_clone(n->ifstmt.else_b);
+            break;
+        case AST_FOR:
+            c->forstmt.var = xstrdup(n->forstmt.var);
+            c->forstmt.start = ast_clone(n->forstmt.start);
+            c->forstmt.end = ast_clone(n->forstmt.end);
+            c->forstmt.body = ast_clone(n->forstmt.body);
+            break;
+        case AST_FUNC_DEF:
+            c->funcdef.name = xstrdup(n->funcdef.name);
+            c->funcdef.param_count = n->funcdef.param_count;
+            if (n->funcdef.param_count > 0) {
+                c->funcdef.params = (char **)xmalloc(sizeof(char *) * (size_t)n->funcdef.param_count);
+                for (i = 0; i < n->funcdef.param_count; i++) c->funcdef.params[i] = xstrdup(n->funcdef.params[i]);
+            }
+            c->funcdef.body = ast_clone(n->funcdef.body);
+            break;
+        case AST_FUNCTION_CALL:
+            c->funccall.name = xstrdup(n->funccall.name);
+            c->funccall.args = clone_list(n->funccall.args, n->funccall.arg_count);
+            c->funccall.arg_count = n->funccall.arg_count;
+            c->funccall.frame = n->funccall.frame;
+            break;
+        case AST_RETURN:
+            c->retstmt.expr = ast_clone(n->retstmt.expr);
+            break;
+        case AST_ARRAY:
+            c->arraylit.items = clone_list(n->arraylit.items, n->arraylit.count);
+            c->arraylit.count = n->arraylit.count;
+            c->arraylit.frame = n->arraylit.frame;
+            break;
+        case AST_INDEX:
+            c->index.array = ast_clone(n->index.array);
+            c->index.index = ast_clone(n->index.index);
+            c->index.unchecked = n->index.unchecked;
+            break;
+        case AST_INDEX_ASSIGN:
+            c->indexassign.array = ast_clone(n->indexassign.array);
+            c->indexassign.index = ast_clone(n->indexassign.index);
+            c->indexassign.value = ast_clone(n->indexassign.value);
+            c->indexassign.op = n->indexassign.op ? xstrdup(n->indexassign.op) : NULL;
+            c->indexassign.unchecked = n->indexassign.unchecked;
+            break;
+        default:
+            break;
+    }
+    return c;
+}
+
 void free_ast(ASTNode *n) {
     int i;
 
@@ -197,6 +311,7 @@ void free_ast(ASTNode *n) {
             free_ast(n->whilestmt.body);
             break;
         case AST_IF:
+        case AST_COND:
             free_ast(n->ifstmt.cond);
             free_ast(n->ifstmt.then_b);
             free_ast(n->ifstmt.else_b);
@@ -233,6 +348,7 @@ void free_ast(ASTNode *n) {
             free_ast(n->indexassign.array);
             free_ast(n->indexassign.index);
             free_ast(n->indexassign.value);
+            free(n->indexassign.op);
             break;
         default:
             break;
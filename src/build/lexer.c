@@ -21,6 +21,7 @@ static TokType kw_type(const char *id) {
     if (!strcmp(id, "break")) return TK_BREAK;
     if (!strcmp(id, "continue")) return TK_CONTINUE;
     if (!strcmp(id, "import")) return TK_IMPORT;
+    if (!strcmp(id, "const")) return TK_CONST;
     if (!strcmp(id, "not")) return TK_NOT;
     if (!strcmp(id, "and")) return TK_AND;
     if (!strcmp(id, "or")) return TK_OR;
@@ -124,6 +125,11 @@ void lex(const char *src, TokVec *out) {
         if (p[0] == '&' && p[1] == '&') { tv_push(out, (Tok){ .t = TK_AND, .line = line }); p += 2; continue; }
         if (p[0] == '|' && p[1] == '|') { tv_push(out, (Tok){ .t = TK_OR, .line = line }); p += 2; continue; }
         if (p[0] == '.' && p[1] == '.') { tv_push(out, (Tok){ .t = TK_DOTDOT, .line = line }); p += 2; continue; }
+        if (p[0] == '+' && p[1] == '=') { tv_push(out, (Tok){ .t = TK_PLUS_ASSIGN, .line = line }); p += 2; continue; }
+        if (p[0] == '-' && p[1] == '=') { tv_push(out, (Tok){ .t = TK_MINUS_ASSIGN, .line = line }); p += 2; continue; }
+        if (p[0] == '*' && p[1] == '=') { tv_push(out, (Tok){ .t = TK_STAR_ASSIGN, .line = line }); p += 2; continue; }
+        if (p[0] == '/' && p[1] == '=') { tv_push(out, (Tok){ .t = TK_SLASH_ASSIGN, .line = line }); p += 2; continue; }
+        if (p[0] == '%' && p[1] == '=') { tv_push(out, (Tok){ .t = TK_MOD_ASSIGN, .line = line }); p += 2; continue; }
 
         switch (*p) {
             case '(':
@@ -1,5 +1,7 @@
 #include "builder.h"
 
+#include <math.h>
+
 static int is_number_lit(ASTNode *n, double *out) {
     if (n && n->type == AST_NUMBER) {
         if (out) *out = n->number;
@@ -60,6 +62,39 @@ static int is_pure_expr(ASTNode *n) {
             return 1;
         case AST_INDEX:
             return is_pure_expr(n->index.array) && is_pure_expr(n->index.index);
+        case AST_COND:
+            return is_pure_expr(n->ifstmt.cond) && is_pure_expr(n->ifstmt.then_b) && is_pure_expr(n->ifstmt.else_b);
+        default:
+            return 0;
+    }
+}
+
+/* Structural equality of two expressions that have no side effects. */
+static int same_pure_expr(ASTNode *a, ASTNode *b) {
+    int i;
+
+    if (!a || !b) return a == b;
+    if (a->type != b->type) return 0;
+    switch (a->type) {
+        case AST_NUMBER:
+            return memcmp(&a->number, &b->number, sizeof(double)) == 0;
+        case AST_STRING:
+        case AST_IDENTIFIER:
+            return strcmp(a->string, b->string) == 0;
+        case AST_BINARY_OP:
+            return strcmp(a->binop.op, b->binop.op) == 0 && same_pure_expr(a->binop.left, b->binop.left) &&
+                   same_pure_expr(a->binop.right, b->binop.right);
+        case AST_COND:
+            return same_pure_expr(a->ifstmt.cond, b->ifstmt.cond) && same_pure_expr(a->ifstmt.then_b, b->ifstmt.then_b) &&
+                   same_pure_expr(a->ifstmt.else_b, b->ifstmt.else_b);
+        case AST_INDEX:
+            return same_pure_expr(a->index.array, b->index.array) && same_pure_expr(a->index.index, b->index.index);
+        case AST_FUNCTION_CALL:
+            if (strcmp(a->funccall.name, b->funccall.name) != 0 || a->funccall.arg_count != b->funccall.arg_count) return 0;
+            for (i = 0; i < a->funccall.arg_count; i++) {
+                if (!same_pure_expr(a->funccall.args[i], b->funccall.args[i])) return 0;
+            }
+            return 1;
         default:
             return 0;
     }
@@ -75,6 +110,7 @@ static int is_noop_stmt(ASTNode *n) {
         case AST_BINARY_OP:
         case AST_ARRAY:
         case AST_INDEX:
+        case AST_COND:
             return is_pure_expr(n);
         case AST_STATEMENTS:
             return n->statements.count == 0;
@@ -85,12 +121,14 @@ static int is_noop_stmt(ASTNode *n) {
 
 static ASTNode *replace_with_number(ASTNode *n, double out) {
     ASTNode *r = ast_number(out);
+    g_pass_counts.folds++;
     free_ast(n);
     return r;
 }
 
 static ASTNode *replace_with_string(ASTNode *n, const char *s) {
     ASTNode *r = ast_string(s);
+    g_pass_counts.folds++;
     free_ast(n);
     return r;
 }
@@ -100,6 +138,7 @@ static ASTNode *take_left_binary(ASTNode *n) {
     ASTNode *r = n->binop.right;
     n->binop.left = NULL;
     n->binop.right = NULL;
+    g_pass_counts.folds++;
     free_ast(r);
     free(n->binop.op);
     free(n);
@@ -111,6 +150,7 @@ static ASTNode *take_right_binary(ASTNode *n) {
     ASTNode *r = n->binop.right;
     n->binop.left = NULL;
     n->binop.right = NULL;
+    g_pass_counts.folds++;
     free_ast(l);
     free(n->binop.op);
     free(n);
@@ -157,6 +197,7 @@ static ASTNode *optimize_statements(ASTNode *n) {
             if (s->type == AST_RETURN || s->type == AST_BREAK || s->type == AST_CONTINUE) {
                 for (j = i + 1; j < n->statements.count; j++) {
                     free_ast(n->statements.stmts[j]);
+                    g_pass_counts.eliminations++;
                 }
                 break;
             }
@@ -178,6 +219,172 @@ static ASTNode *optimize_statements(ASTNode *n) {
     return ast_statements(out, out_count);
 }
 
+static int is_add_op(ASTNode *n) {
+    return n && n->type == AST_BINARY_OP && n->binop.op && n->binop.right &&
+           (strcmp(n->binop.op, "+") == 0 || strcmp(n->binop.op, "-") == 0);
+}
+
+static int is_mul_op(ASTNode *n) {
+    return n && n->type == AST_BINARY_OP && n->binop.op && strcmp(n->binop.op, "*") == 0;
+}
+
+/* Rebuilds `n` as `left op right`, reusing the node. */
+static ASTNode *rebuild_binary(ASTNode *n, const char *op, ASTNode *left, ASTNode *right) {
+    free(n->binop.op);
+    n->binop.op = xstrdup(op);
+    n->binop.left = left;
+    n->binop.right = right;
+    return optimize_node(n);
+}
+
+/* Detaches the operands of a binary node and frees the node itself. */
+static void split_binary(ASTNode *n, ASTNode **left, ASTNode **right) {
+    *left = n->binop.left;
+    *right = n->binop.right;
+    free(n->binop.op);
+    free(n);
+}
+
+/* True if dividing by `d` is the same as multiplying by 1/d, i.e. d is a power of two. */
+static int has_exact_reciprocal(double d) {
+    int steps = 0;
+
+    if (d < 0.0) d = -d;
+    if (d == 0.0 || d != d || d - d != 0.0) return 0;
+    /* Scaling by two is exact, so this lands on 1.0 only for powers of two. */
+    while (d >= 2.0 && steps++ < 1000) d *= 0.5;
+    while (d < 1.0 && steps++ < 1000) d *= 2.0;
+    return d == 1.0 && steps < 1000;
+}
+
+/*
+ * True if `n` always evaluates to a number, by the same rules type inference
+ * uses: only two strings concatenate, so `+` with a number operand adds, and
+ * every other operator yields a number. Variables are not known here; their
+ * types only exist once infer_types has seen the whole program.
+ */
+static int is_numeric_expr(ASTNode *n) {
+    if (!n) return 0;
+    if (n->type == AST_NUMBER) return 1;
+    if (n->type == AST_COND) return is_numeric_expr(n->ifstmt.then_b) && is_numeric_expr(n->ifstmt.else_b);
+    if (n->type != AST_BINARY_OP || !n->binop.right) return 0;
+    if (strcmp(n->binop.op, "+") == 0) return is_numeric_expr(n->binop.left) || is_numeric_expr(n->binop.right);
+    return 1;
+}
+
+/* An integer constant below 2^53, so merging two of them is exact. */
+static int is_exact_int(double c) {
+    return c == floor(c) && fabs(c) < 9007199254740992.0;
+}
+
+/*
+ * Moves integer constants to the right of `+`, `-` and `*` chains and merges
+ * them, so `1 + x + 2` becomes `x + 3` and `x * 2 * 3` becomes `x * 6`.
+ * A constant operand already makes the arithmetic numeric, so merging two of
+ * them is safe for any `e`; moving one past another term is only done when
+ * every operand is known to be a number, since two strings would concatenate
+ * where they did not before. A merge that lands on 0 (or 1 for `*`) is left
+ * alone: the identity folds would strip it and hand back an operand that was
+ * never converted to a number.
+ */
+static ASTNode *reassociate(ASTNode *n) {
+    const char *op = n->binop.op;
+    ASTNode *l = n->binop.left;
+    ASTNode *r = n->binop.right;
+    double c1;
+    double c2;
+    double k;
+
+    if (!l || !r) return n;
+
+    if ((strcmp(op, "+") == 0 || strcmp(op, "*") == 0) && is_number_lit(l, NULL) && !is_number_lit(r, NULL)) {
+        n->binop.left = r;
+        n->binop.right = l;
+        return reassociate(n);
+    }
+
+    if (strcmp(op, "/") == 0 && is_number_lit(r, &c2) && has_exact_reciprocal(c2)) {
+        r->number = 1.0 / c2;
+        return rebuild_binary(n, "*", l, r);
+    }
+
+    if (is_add_op(n)) {
+        int minus = strcmp(op, "-") == 0;
+
+        /* (e +- c1) +- c2  ->  e + k */
+        if (is_number_lit(r, &c2) && is_add_op(l) && is_number_lit(l->binop.right, &c1) &&
+            is_exact_int(c1) && is_exact_int(c2) &&
+            is_exact_int(k = (strcmp(l->binop.op, "-") == 0 ? -c1 : c1) + (minus ? -c2 : c2)) && k != 0.0) {
+            ASTNode *e;
+            ASTNode *lc;
+            split_binary(l, &e, &lc);
+            lc->number = k;
+            free_ast(r);
+            return rebuild_binary(n, "+", e, lc);
+        }
+        /* (e +- c) +- f  ->  (e +- f) +- c */
+        if (!is_number_lit(r, NULL) && is_add_op(l) && is_number_lit(l->binop.right, &c1) && is_exact_int(c1) &&
+            is_numeric_expr(l->binop.left) && is_numeric_expr(r)) {
+            ASTNode *e;
+            ASTNode *c;
+            char *inner_op = xstrdup(l->binop.op);
+            split_binary(l, &e, &c);
+            n->binop.left = optimize_node(ast_binop(op, e, r));
+            n->binop.right = c;
+            free(n->binop.op);
+            n->binop.op = inner_op;
+            return optimize_node(n);
+        }
+        /* e +- (f +- c)  ->  (e +- f) +- c, flipping the sign of c under `-` */
+        if (!is_number_lit(l, NULL) && is_add_op(r) && is_number_lit(r->binop.right, &c2) && is_exact_int(c2) &&
+            is_numeric_expr(l) && is_numeric_expr(r->binop.left)) {
+            ASTNode *f;
+            ASTNode *c;
+            int inner_minus = strcmp(r->binop.op, "-") == 0;
+            split_binary(r, &f, &c);
+            n->binop.left = optimize_node(ast_binop(op, l, f));
+            n->binop.right = c;
+            free(n->binop.op);
+            n->binop.op = xstrdup(minus != inner_minus ? "-" : "+");
+            return optimize_node(n);
+        }
+    }
+
+    if (is_mul_op(n)) {
+        /* (e * c1) * c2  ->  e * k */
+        if (is_number_lit(r, &c2) && is_mul_op(l) && is_number_lit(l->binop.right, &c1) &&
+            is_exact_int(c1) && is_exact_int(c2) && is_exact_int(c1 * c2) && c1 * c2 != 1.0) {
+            ASTNode *e;
+            ASTNode *lc;
+            split_binary(l, &e, &lc);
+            lc->number = c1 * c2;
+            free_ast(r);
+            return rebuild_binary(n, "*", e, lc);
+        }
+        /* (e * c) * f  ->  (e * f) * c */
+        if (!is_number_lit(r, NULL) && is_mul_op(l) && is_number_lit(l->binop.right, &c1) && is_exact_int(c1) &&
+            is_numeric_expr(l->binop.left) && is_numeric_expr(r)) {
+            ASTNode *e;
+            ASTNode *c;
+            split_binary(l, &e, &c);
+            n->binop.left = optimize_node(ast_binop("*", e, r));
+            n->binop.right = c;
+            return optimize_node(n);
+        }
+        /* e * (f * c)  ->  (e * f) * c */
+        if (!is_number_lit(l, NULL) && is_mul_op(r) && is_number_lit(r->binop.right, &c2) && is_exact_int(c2) &&
+            is_numeric_expr(l) && is_numeric_expr(r->binop.left)) {
+            ASTNode *f;
+            ASTNode *c;
+            split_binary(r, &f, &c);
+            n->binop.left = optimize_node(ast_binop("*", l, f));
+            n->binop.right = c;
+            return optimize_node(n);
+        }
+    }
+    return n;
+}
+
 ASTNode *optimize_node(ASTNode *n) {
     if (!n) return NULL;
 
@@ -191,8 +398,8 @@ ASTNode *optimize_node(ASTNode *n) {
             return n;
 
         case AST_BINARY_OP: {
-            double a;
-            double b;
+            double a = 0.0;
+            double b = 0.0;
             const char *sa = NULL;
             const char *sb = NULL;
             int lnum;
@@ -232,6 +439,17 @@ ASTNode *optimize_node(ASTNode *n) {
                 return n;
             }
 
+            if (lbool && rbool && (!strcmp(op, "&&") || !strcmp(op, "||"))) {
+                int out = !strcmp(op, "&&") ? (ltrue && rtrue) : (ltrue || rtrue);
+                return replace_with_number(n, out ? 1.0 : 0.0);
+            }
+
+            /* Strings compare by content, so this must come before the numeric fold. */
+            if ((lstr && rstr) && (!strcmp(op, "==") || !strcmp(op, "!="))) {
+                int eq = strcmp(sa, sb) == 0;
+                return replace_with_number(n, (!strcmp(op, "==") ? eq : !eq) ? 1.0 : 0.0);
+            }
+
             if ((lnum || lstr) && (rnum || rstr)) {
                 double la = lnum ? a : 0.0;
                 double rb = rnum ? b : 0.0;
@@ -250,32 +468,42 @@ ASTNode *optimize_node(ASTNode *n) {
                 else if (!strcmp(op, ">=")) out = la >= rb ? 1.0 : 0.0;
                 else if (!strcmp(op, "==")) out = la == rb ? 1.0 : 0.0;
                 else if (!strcmp(op, "!=")) out = la != rb ? 1.0 : 0.0;
-                else if (!strcmp(op, "&&")) out = (la != 0.0 && rb != 0.0) ? 1.0 : 0.0;
-                else if (!strcmp(op, "||")) out = (la != 0.0 || rb != 0.0) ? 1.0 : 0.0;
                 else out = 0.0;
 
                 return replace_with_number(n, out);
             }
 
-            if ((lstr && rstr) && (!strcmp(op, "==") || !strcmp(op, "!="))) {
-                int eq = strcmp(sa, sb) == 0;
-                return replace_with_number(n, (!strcmp(op, "==") ? eq : !eq) ? 1.0 : 0.0);
+            /*
+             * Identities only drop a literal when the other operand is a number, since a string
+             * operand would come back unconverted, and only when the sign of a zero survives:
+             * x + -0 and x - 0 are x for every number, x + 0 is not (-0 + 0 is 0), and neither
+             * x * 0 nor 0 / x is always 0 (either gives -0 for a negative x).
+             */
+            if (lnum && !strcmp(op, "+") && a == 0.0 && signbit(a) && is_numeric_expr(n->binop.right) &&
+                is_pure_expr(n->binop.right)) {
+                return take_right_binary(n);
+            }
+            if (rnum && !strcmp(op, "+") && b == 0.0 && signbit(b) && is_numeric_expr(n->binop.left) &&
+                is_pure_expr(n->binop.left)) {
+                return take_left_binary(n);
+            }
+            if (rnum && !strcmp(op, "-") && b == 0.0 && !signbit(b) && is_numeric_expr(n->binop.left) &&
+                is_pure_expr(n->binop.left)) {
+                return take_left_binary(n);
+            }
+            if (lnum && !strcmp(op, "*") && a == 1.0 && is_numeric_expr(n->binop.right) && is_pure_expr(n->binop.right)) {
+                return take_right_binary(n);
+            }
+            if (rnum && (!strcmp(op, "*") || !strcmp(op, "/")) && b == 1.0 && is_numeric_expr(n->binop.left) &&
+                is_pure_expr(n->binop.left)) {
+                return take_left_binary(n);
             }
-
-            if (lnum && !strcmp(op, "+") && a == 0.0 && is_pure_expr(n->binop.right)) return take_right_binary(n);
-            if (rnum && !strcmp(op, "+") && b == 0.0 && is_pure_expr(n->binop.left)) return take_left_binary(n);
-            if (rnum && !strcmp(op, "-") && b == 0.0 && is_pure_expr(n->binop.left)) return take_left_binary(n);
-            if (lnum && !strcmp(op, "*") && a == 1.0 && is_pure_expr(n->binop.right)) return take_right_binary(n);
-            if (rnum && !strcmp(op, "*") && b == 1.0 && is_pure_expr(n->binop.left)) return take_left_binary(n);
-            if (lnum && !strcmp(op, "*") && a == 0.0 && is_pure_expr(n->binop.right)) return replace_with_number(n, 0.0);
-            if (rnum && !strcmp(op, "*") && b == 0.0 && is_pure_expr(n->binop.left)) return replace_with_number(n, 0.0);
-            if (rnum && !strcmp(op, "/") && b == 1.0 && is_pure_expr(n->binop.left)) return take_left_binary(n);
-            if (lnum && !strcmp(op, "/") && a == 0.0 && is_pure_expr(n->binop.right)) return replace_with_number(n, 0.0);
             if (rnum && !strcmp(op, "%") && b == 1.0 && is_pure_expr(n->binop.left)) return replace_with_number(n, 0.0);
             if (lnum && !strcmp(op, "%") && a == 0.0 && is_pure_expr(n->binop.right)) return replace_with_number(n, 0.0);
-            if (lbool && !strcmp(op, "&&") && !ltrue && is_pure_expr(n->binop.right)) return replace_with_number(n, 0.0);
+            /* `&&` and `||` short-circuit, so a constant left side decides without running the right. */
+            if (lbool && !strcmp(op, "&&") && !ltrue) return replace_with_number(n, 0.0);
             if (rbool && !strcmp(op, "&&") && !rtrue && is_pure_expr(n->binop.left)) return replace_with_number(n, 0.0);
-            if (lbool && !strcmp(op, "||") && ltrue && is_pure_expr(n->binop.right)) return replace_with_number(n, 1.0);
+            if (lbool && !strcmp(op, "||") && ltrue) return replace_with_number(n, 1.0);
             if (rbool && !strcmp(op, "||") && rtrue && is_pure_expr(n->binop.left)) return replace_with_number(n, 1.0);
 
             if (!strcmp(op, "==") && n->binop.left && n->binop.right &&
@@ -288,7 +516,7 @@ ASTNode *optimize_node(ASTNode *n) {
                 strcmp(n->binop.left->string, n->binop.right->string) == 0) {
                 return replace_with_number(n, 0.0);
             }
-            return n;
+            return reassociate(n);
         }
 
         case AST_PRINT:
@@ -307,8 +535,9 @@ ASTNode *optimize_node(ASTNode *n) {
             n->whilestmt.cond = optimize_node(n->whilestmt.cond);
             n->whilestmt.body = optimize_node(n->whilestmt.body);
             {
-                double cval;
-                if (is_numeric_literal(n->whilestmt.cond, &cval) && cval == 0.0) {
+                int truthy;
+                if (literal_truthy(n->whilestmt.cond, &truthy) && !truthy) {
+                    g_pass_counts.eliminations++;
                     free_ast(n);
                     return ast_statements(NULL, 0);
                 }
@@ -316,16 +545,18 @@ ASTNode *optimize_node(ASTNode *n) {
             return n;
 
         case AST_IF: {
-            double cval;
+            int truthy;
             ASTNode *chosen;
 
             n->ifstmt.cond = optimize_node(n->ifstmt.cond);
             n->ifstmt.then_b = optimize_node(n->ifstmt.then_b);
             n->ifstmt.else_b = optimize_node(n->ifstmt.else_b);
 
-            if (!is_numeric_literal(n->ifstmt.cond, &cval)) return n;
+            /* A string condition is true unless empty, as in the VM; it is not read as a number. */
+            if (!literal_truthy(n->ifstmt.cond, &truthy)) return n;
 
-            chosen = cval != 0.0
+            g_pass_counts.eliminations++;
+            chosen = truthy
                 ? n->ifstmt.then_b
                 : (n->ifstmt.else_b ? n->ifstmt.else_b : ast_statements(NULL, 0));
             if (n->ifstmt.cond) free_ast(n->ifstmt.cond);
@@ -345,8 +576,13 @@ ASTNode *optimize_node(ASTNode *n) {
             if (is_numeric_literal(n->forstmt.start, &s) &&
                 is_numeric_literal(n->forstmt.end, &e) &&
                 (int)s > (int)e) {
+                /* The body never runs, but the variable is still left holding the start. */
+                ASTNode *init = ast_var(AST_ASSIGN, n->forstmt.var, n->forstmt.start);
+
+                g_pass_counts.eliminations++;
+                n->forstmt.start = NULL;
                 free_ast(n);
-                return ast_statements(NULL, 0);
+                return init;
             }
             return n;
         }
@@ -380,6 +616,22 @@ ASTNode *optimize_node(ASTNode *n) {
             n->index.index = optimize_node(n->index.index);
             return n;
 
+        case AST_COND: {
+            int truthy;
+            ASTNode *chosen;
+
+            n->ifstmt.cond = optimize_node(n->ifstmt.cond);
+            n->ifstmt.then_b = optimize_node(n->ifstmt.then_b);
+            n->ifstmt.else_b = optimize_node(n->ifstmt.else_b);
+            if (!literal_truthy(n->ifstmt.cond, &truthy)) return n;
+            g_pass_counts.eliminations++;
+            chosen = truthy ? n->ifstmt.then_b : n->ifstmt.else_b;
+            if (truthy) n->ifstmt.then_b = NULL;
+            else n->ifstmt.else_b = NULL;
+            free_ast(n);
+            return chosen;
+        }
+
         case AST_INDEX_ASSIGN:
             n->indexassign.array = optimize_node(n->indexassign.array);
             n->indexassign.index = optimize_node(n->indexassign.index);
@@ -390,3 +642,4235 @@ ASTNode *optimize_node(ASTNode *n) {
             return n;
     }
 }
+
+/*
+ * Constant and copy propagation.
+ *
+ * Variables resolve dynamically at run time: a load inside a function reads
+ * the frame slot, then the global. Any user-defined or native call can
+ * therefore rebind any variable the caller might see, so such calls drop every
+ * fact except program-wide constants. A program-wide constant is a name
+ * assigned exactly once in the whole program, by a top-level `let` of a
+ * literal that runs before any user code can.
+ */
+
+typedef struct {
+    char **data;
+    int *counts;
+    int count;
+    int cap;
+} NameTable;
+
+typedef struct {
+    char *name;
+    ASTNode *value;
+    int is_const;
+} Fact;
+
+typedef struct {
+    Fact *data;
+    int count;
+    int cap;
+} FactSet;
+
+static const char *const g_builtin_names[] = {
+    "print", "input", "sleep", "noop", "len", "append", "sin", "cos", "tan",
+    "sqrt", "pow", "mod", "abs", "floor", "ceil", "round", "min", "max",
+    "clamp", "to_number", "lerp", "slice", "split"
+};
+
+static NameTable g_user_funcs = {0};
+static NameTable g_assign_counts = {0};
+static FactSet g_global_consts = {0};
+
+static int name_table_find(const NameTable *t, const char *name) {
+    int i;
+    for (i = 0; i < t->count; i++) {
+        if (strcmp(t->data[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static void name_table_add(NameTable *t, const char *name) {
+    int i = name_table_find(t, name);
+    if (i >= 0) {
+        t->counts[i]++;
+        return;
+    }
+    if (t->count >= t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 16;
+        t->data = (char **)xrealloc(t->data, sizeof(char *) * (size_t)t->cap);
+        t->counts = (int *)xrealloc(t->counts, sizeof(int) * (size_t)t->cap);
+    }
+    t->data[t->count] = xstrdup(name);
+    t->counts[t->count++] = 1;
+}
+
+static int name_table_count(const NameTable *t, const char *name) {
+    int i = name_table_find(t, name);
+    return i >= 0 ? t->counts[i] : 0;
+}
+
+static void name_table_free(NameTable *t) {
+    int i;
+    for (i = 0; i < t->count; i++) free(t->data[i]);
+    free(t->data);
+    free(t->counts);
+    memset(t, 0, sizeof(*t));
+}
+
+/* Records function names and how often each variable name is bound anywhere in the program. */
+static void collect_program_names(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) collect_program_names(n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            name_table_add(&g_user_funcs, n->funcdef.name);
+            for (i = 0; i < n->funcdef.param_count; i++) name_table_add(&g_assign_counts, n->funcdef.params[i]);
+            collect_program_names(n->funcdef.body);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            name_table_add(&g_assign_counts, n->var.name);
+            break;
+        case AST_FOR:
+            name_table_add(&g_assign_counts, n->forstmt.var);
+            collect_program_names(n->forstmt.body);
+            break;
+        case AST_IF:
+            collect_program_names(n->ifstmt.then_b);
+            collect_program_names(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            collect_program_names(n->whilestmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+/* True if the call may run Splice or native code, which can rebind variables. */
+static int call_runs_user_code(ASTNode *call) {
+    size_t i;
+
+    if (name_table_find(&g_user_funcs, call->funccall.name) >= 0) return 1;
+    for (i = 0; i < sizeof(g_builtin_names) / sizeof(g_builtin_names[0]); i++) {
+        if (strcmp(g_builtin_names[i], call->funccall.name) == 0) return 0;
+    }
+    return 1;
+}
+
+/* True if executing the subtree may run user code; function bodies are not entered. */
+static int runs_user_code(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_FUNCTION_CALL:
+            if (call_runs_user_code(n)) return 1;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (runs_user_code(n->funccall.args[i])) return 1;
+            }
+            return 0;
+        case AST_IMPORT_C:
+            return 1;
+        case AST_BINARY_OP:
+            return runs_user_code(n->binop.left) || runs_user_code(n->binop.right);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (runs_user_code(n->arraylit.items[i])) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+            return runs_user_code(n->index.array) || runs_user_code(n->index.index);
+        case AST_COND:
+        case AST_IF:
+            return runs_user_code(n->ifstmt.cond) || runs_user_code(n->ifstmt.then_b) ||
+                   runs_user_code(n->ifstmt.else_b);
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                if (runs_user_code(n->statements.stmts[i])) return 1;
+            }
+            return 0;
+        case AST_LET:
+        case AST_ASSIGN:
+            return runs_user_code(n->var.value);
+        case AST_PRINT:
+            return runs_user_code(n->print.expr);
+        case AST_RETURN:
+            return runs_user_code(n->retstmt.expr);
+        case AST_WHILE:
+            return runs_user_code(n->whilestmt.cond) || runs_user_code(n->whilestmt.body);
+        case AST_FOR:
+            return runs_user_code(n->forstmt.start) || runs_user_code(n->forstmt.end) ||
+                   runs_user_code(n->forstmt.body);
+        case AST_INDEX_ASSIGN:
+            return runs_user_code(n->indexassign.array) || runs_user_code(n->indexassign.index) ||
+                   runs_user_code(n->indexassign.value);
+        default:
+            return 0;
+    }
+}
+
+/* Names bound by a statement subtree, excluding nested function bodies. */
+static void collect_assigned(ASTNode *n, NameTable *out) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) collect_assigned(n->statements.stmts[i], out);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            name_table_add(out, n->var.name);
+            break;
+        case AST_FOR:
+            name_table_add(out, n->forstmt.var);
+            collect_assigned(n->forstmt.body, out);
+            break;
+        case AST_IF:
+            collect_assigned(n->ifstmt.then_b, out);
+            collect_assigned(n->ifstmt.else_b, out);
+            break;
+        case AST_WHILE:
+            collect_assigned(n->whilestmt.body, out);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *clone_leaf(ASTNode *n) {
+    if (n->type == AST_NUMBER) return ast_number(n->number);
+    if (n->type == AST_STRING) return ast_string(n->string);
+    return ast_ident(n->string);
+}
+
+static int same_leaf(ASTNode *a, ASTNode *b) {
+    if (a->type != b->type) return 0;
+    if (a->type == AST_NUMBER) return memcmp(&a->number, &b->number, sizeof(double)) == 0;
+    return strcmp(a->string, b->string) == 0;
+}
+
+static Fact *fact_find(FactSet *fs, const char *name) {
+    int i;
+    for (i = 0; i < fs->count; i++) {
+        if (strcmp(fs->data[i].name, name) == 0) return &fs->data[i];
+    }
+    return NULL;
+}
+
+static void fact_add(FactSet *fs, const char *name, ASTNode *value, int is_const) {
+    if (fs->count >= fs->cap) {
+        fs->cap = fs->cap ? fs->cap * 2 : 16;
+        fs->data = (Fact *)xrealloc(fs->data, sizeof(Fact) * (size_t)fs->cap);
+    }
+    fs->data[fs->count].name = xstrdup(name);
+    fs->data[fs->count].value = clone_leaf(value);
+    fs->data[fs->count].is_const = is_const;
+    fs->count++;
+}
+
+static void fact_remove_at(FactSet *fs, int i) {
+    free(fs->data[i].name);
+    free_ast(fs->data[i].value);
+    fs->data[i] = fs->data[--fs->count];
+}
+
+/* Forgets `name` and every copy made from it. */
+static void fact_kill(FactSet *fs, const char *name) {
+    int i = 0;
+    while (i < fs->count) {
+        Fact *f = &fs->data[i];
+        if (strcmp(f->name, name) == 0 ||
+            (f->value->type == AST_IDENTIFIER && strcmp(f->value->string, name) == 0)) {
+            fact_remove_at(fs, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void fact_kill_all(FactSet *fs) {
+    int i = 0;
+    while (i < fs->count) {
+        if (fs->data[i].is_const) i++;
+        else fact_remove_at(fs, i);
+    }
+}
+
+static void fact_kill_table(FactSet *fs, const NameTable *names) {
+    int i;
+    for (i = 0; i < names->count; i++) fact_kill(fs, names->data[i]);
+}
+
+static FactSet fact_copy(const FactSet *fs) {
+    FactSet out = {0};
+    int i;
+    for (i = 0; i < fs->count; i++) fact_add(&out, fs->data[i].name, fs->data[i].value, fs->data[i].is_const);
+    return out;
+}
+
+static void fact_free(FactSet *fs) {
+    while (fs->count > 0) fact_remove_at(fs, fs->count - 1);
+    free(fs->data);
+    memset(fs, 0, sizeof(*fs));
+}
+
+/* Keeps only the facts of `fs` that also hold in `other`. */
+static void fact_intersect(FactSet *fs, FactSet *other) {
+    int i = 0;
+    while (i < fs->count) {
+        Fact *f = fact_find(other, fs->data[i].name);
+        if (f && same_leaf(f->value, fs->data[i].value)) i++;
+        else fact_remove_at(fs, i);
+    }
+}
+
+static void fact_replace(FactSet *fs, FactSet *with) {
+    fact_free(fs);
+    *fs = *with;
+    memset(with, 0, sizeof(*with));
+}
+
+static int is_literal(ASTNode *n) {
+    return n && (n->type == AST_NUMBER || n->type == AST_STRING);
+}
+
+static int ends_control_flow(ASTNode *n) {
+    if (!n) return 0;
+    if (n->type == AST_STATEMENTS) {
+        return n->statements.count > 0 && ends_control_flow(n->statements.stmts[n->statements.count - 1]);
+    }
+    return n->type == AST_RETURN || n->type == AST_BREAK || n->type == AST_CONTINUE;
+}
+
+static ASTNode *propagate_expr(ASTNode *n, FactSet *fs) {
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_IDENTIFIER: {
+            Fact *f = fact_find(fs, n->string);
+            if (!f) return n;
+            g_pass_counts.folds++;
+            free_ast(n);
+            return clone_leaf(f->value);
+        }
+        case AST_BINARY_OP:
+            n->binop.left = propagate_expr(n->binop.left, fs);
+            n->binop.right = propagate_expr(n->binop.right, fs);
+            return optimize_node(n);
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                n->funccall.args[i] = propagate_expr(n->funccall.args[i], fs);
+            }
+            if (call_runs_user_code(n)) fact_kill_all(fs);
+            return n;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                n->arraylit.items[i] = propagate_expr(n->arraylit.items[i], fs);
+            }
+            return n;
+        case AST_INDEX:
+            n->index.array = propagate_expr(n->index.array, fs);
+            n->index.index = propagate_expr(n->index.index, fs);
+            return n;
+        case AST_COND:
+            /* Facts killed in either arm stay killed; arms cannot add any. */
+            n->ifstmt.cond = propagate_expr(n->ifstmt.cond, fs);
+            n->ifstmt.then_b = propagate_expr(n->ifstmt.then_b, fs);
+            n->ifstmt.else_b = propagate_expr(n->ifstmt.else_b, fs);
+            return optimize_node(n);
+        default:
+            return n;
+    }
+}
+
+static ASTNode *propagate_stmt(ASTNode *n, FactSet *fs);
+
+static FactSet global_const_facts(void) {
+    return fact_copy(&g_global_consts);
+}
+
+static ASTNode *propagate_loop_body(ASTNode *body, FactSet *fs) {
+    FactSet inner = fact_copy(fs);
+    body = propagate_stmt(body, &inner);
+    fact_free(&inner);
+    return body;
+}
+
+static ASTNode *propagate_stmt(ASTNode *n, FactSet *fs) {
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                n->statements.stmts[i] = propagate_stmt(n->statements.stmts[i], fs);
+            }
+            return n;
+
+        case AST_LET:
+        case AST_ASSIGN: {
+            ASTNode *v;
+            n->var.value = propagate_expr(n->var.value, fs);
+            v = n->var.value;
+            fact_kill(fs, n->var.name);
+            if (is_literal(v)) {
+                fact_add(fs, n->var.name, v, fact_find(&g_global_consts, n->var.name) != NULL);
+            } else if (v && v->type == AST_IDENTIFIER && strcmp(v->string, n->var.name) != 0) {
+                fact_add(fs, n->var.name, v, 0);
+            }
+            return n;
+        }
+
+        case AST_PRINT:
+            n->print.expr = propagate_expr(n->print.expr, fs);
+            return n;
+
+        case AST_RETURN:
+            n->retstmt.expr = propagate_expr(n->retstmt.expr, fs);
+            return n;
+
+        case AST_INDEX_ASSIGN:
+            n->indexassign.array = propagate_expr(n->indexassign.array, fs);
+            n->indexassign.index = propagate_expr(n->indexassign.index, fs);
+            n->indexassign.value = propagate_expr(n->indexassign.value, fs);
+            return n;
+
+        case AST_IF: {
+            FactSet then_fs;
+            FactSet else_fs;
+            int then_ends;
+            int else_ends;
+
+            n->ifstmt.cond = propagate_expr(n->ifstmt.cond, fs);
+            if (is_literal(n->ifstmt.cond)) {
+                /* Let the folded branch keep feeding facts to the statements after it. */
+                n = optimize_node(n);
+                return propagate_stmt(n, fs);
+            }
+            then_fs = fact_copy(fs);
+            else_fs = fact_copy(fs);
+            n->ifstmt.then_b = propagate_stmt(n->ifstmt.then_b, &then_fs);
+            n->ifstmt.else_b = propagate_stmt(n->ifstmt.else_b, &else_fs);
+            then_ends = ends_control_flow(n->ifstmt.then_b);
+            else_ends = ends_control_flow(n->ifstmt.else_b);
+            if (then_ends && !else_ends) {
+                fact_replace(fs, &else_fs);
+            } else if (else_ends && !then_ends) {
+                fact_replace(fs, &then_fs);
+            } else {
+                fact_intersect(&then_fs, &else_fs);
+                fact_replace(fs, &then_fs);
+            }
+            fact_free(&then_fs);
+            fact_free(&else_fs);
+            return n;
+        }
+
+        case AST_WHILE: {
+            NameTable assigned = {0};
+            if (runs_user_code(n)) fact_kill_all(fs);
+            collect_assigned(n->whilestmt.body, &assigned);
+            fact_kill_table(fs, &assigned);
+            name_table_free(&assigned);
+            {
+                FactSet inner = fact_copy(fs);
+                n->whilestmt.cond = propagate_expr(n->whilestmt.cond, &inner);
+                n->whilestmt.body = propagate_stmt(n->whilestmt.body, &inner);
+                fact_free(&inner);
+            }
+            return n;
+        }
+
+        case AST_FOR: {
+            NameTable assigned = {0};
+            n->forstmt.start = propagate_expr(n->forstmt.start, fs);
+            if (runs_user_code(n->forstmt.end) || runs_user_code(n->forstmt.body)) fact_kill_all(fs);
+            fact_kill(fs, n->forstmt.var);
+            collect_assigned(n->forstmt.body, &assigned);
+            fact_kill_table(fs, &assigned);
+            name_table_free(&assigned);
+            {
+                /* The bound is re-evaluated before every iteration. */
+                FactSet inner = fact_copy(fs);
+                n->forstmt.end = propagate_expr(n->forstmt.end, &inner);
+                fact_free(&inner);
+            }
+            n->forstmt.body = propagate_loop_body(n->forstmt.body, fs);
+            return n;
+        }
+
+        case AST_FUNC_DEF: {
+            FactSet body_fs = global_const_facts();
+            n->funcdef.body = propagate_stmt(n->funcdef.body, &body_fs);
+            fact_free(&body_fs);
+            return n;
+        }
+
+        case AST_IMPORT_C:
+            fact_kill_all(fs);
+            return n;
+
+        case AST_BREAK:
+        case AST_CONTINUE:
+            return n;
+
+        default:
+            return propagate_expr(n, fs);
+    }
+}
+
+/* Finds the program-wide constants among the top-level statements that run before any user code. */
+static void find_global_consts(ASTNode *root) {
+    ASTNode **stmts = &root;
+    int count = 1;
+    int i;
+
+    if (root && root->type == AST_STATEMENTS) {
+        stmts = root->statements.stmts;
+        count = root->statements.count;
+    }
+    for (i = 0; i < count; i++) {
+        ASTNode *s = stmts[i];
+        if (!s || s->type == AST_FUNC_DEF) continue;
+        if (runs_user_code(s)) break;
+        if ((s->type == AST_LET || s->type == AST_ASSIGN) &&
+            name_table_count(&g_assign_counts, s->var.name) == 1) {
+            s->var.value = propagate_expr(s->var.value, &g_global_consts);
+            if (is_literal(s->var.value)) fact_add(&g_global_consts, s->var.name, s->var.value, 1);
+        }
+    }
+}
+
+static ASTNode *propagate_constants(ASTNode *root) {
+    FactSet fs = {0};
+
+    collect_program_names(root);
+    find_global_consts(root);
+    root = propagate_stmt(root, &fs);
+    fact_free(&fs);
+    fact_free(&g_global_consts);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Dead store elimination.
+ *
+ * Only top-level code can create globals, so inside a function a parameter,
+ * or a name no top-level statement binds, is always a frame local that callees
+ * cannot see. Top-level names are globals that user code may read, so user
+ * calls make everything read inside any function body live.
+ */
+
+typedef struct {
+    int in_func;
+    int apply;
+    char **params;
+    int param_count;
+    NameTable *break_live;
+    NameTable *continue_live;
+} DseCtx;
+
+static NameTable g_func_reads = {0};
+static NameTable g_top_bound = {0};
+
+static void name_table_remove(NameTable *t, const char *name) {
+    int i = name_table_find(t, name);
+    if (i < 0) return;
+    free(t->data[i]);
+    t->count--;
+    t->data[i] = t->data[t->count];
+    t->counts[i] = t->counts[t->count];
+}
+
+static void name_table_union(NameTable *t, const NameTable *other) {
+    int i;
+    for (i = 0; i < other->count; i++) {
+        if (name_table_find(t, other->data[i]) < 0) name_table_add(t, other->data[i]);
+    }
+}
+
+static NameTable name_table_copy(const NameTable *t) {
+    NameTable out = {0};
+    name_table_union(&out, t);
+    return out;
+}
+
+static int name_table_same(const NameTable *a, const NameTable *b) {
+    int i;
+    if (a->count != b->count) return 0;
+    for (i = 0; i < a->count; i++) {
+        if (name_table_find(b, a->data[i]) < 0) return 0;
+    }
+    return 1;
+}
+
+/* Counts variable reads, skipping reads of `self` (the target of the enclosing assignment). */
+static void count_reads(ASTNode *n, NameTable *reads, const char *self) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            if (!self || strcmp(n->string, self) != 0) name_table_add(reads, n->string);
+            break;
+        case AST_BINARY_OP:
+            count_reads(n->binop.left, reads, self);
+            count_reads(n->binop.right, reads, self);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) count_reads(n->funccall.args[i], reads, self);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) count_reads(n->arraylit.items[i], reads, self);
+            break;
+        case AST_INDEX:
+            count_reads(n->index.array, reads, self);
+            count_reads(n->index.index, reads, self);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) count_reads(n->statements.stmts[i], reads, NULL);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            count_reads(n->var.value, reads, n->var.name);
+            break;
+        case AST_PRINT:
+            count_reads(n->print.expr, reads, NULL);
+            break;
+        case AST_RETURN:
+            count_reads(n->retstmt.expr, reads, NULL);
+            break;
+        case AST_IF:
+            count_reads(n->ifstmt.cond, reads, NULL);
+            count_reads(n->ifstmt.then_b, reads, NULL);
+            count_reads(n->ifstmt.else_b, reads, NULL);
+            break;
+        case AST_COND:
+            count_reads(n->ifstmt.cond, reads, self);
+            count_reads(n->ifstmt.then_b, reads, self);
+            count_reads(n->ifstmt.else_b, reads, self);
+            break;
+        case AST_WHILE:
+            count_reads(n->whilestmt.cond, reads, NULL);
+            count_reads(n->whilestmt.body, reads, NULL);
+            break;
+        case AST_FOR:
+            name_table_add(reads, n->forstmt.var);
+            count_reads(n->forstmt.start, reads, NULL);
+            count_reads(n->forstmt.end, reads, NULL);
+            count_reads(n->forstmt.body, reads, NULL);
+            break;
+        case AST_INDEX_ASSIGN:
+            count_reads(n->indexassign.array, reads, NULL);
+            count_reads(n->indexassign.index, reads, NULL);
+            count_reads(n->indexassign.value, reads, NULL);
+            break;
+        case AST_FUNC_DEF:
+            count_reads(n->funcdef.body, reads, NULL);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Drops pure assignments to names that are never read, except by their own updates. */
+static int remove_unread_stores(ASTNode **slot, const NameTable *reads) {
+    ASTNode *n = *slot;
+    int changed = 0;
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) changed |= remove_unread_stores(&n->statements.stmts[i], reads);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            if (name_table_find(reads, n->var.name) < 0 && is_pure_expr(n->var.value)) {
+                free_ast(n);
+                *slot = ast_statements(NULL, 0);
+                g_pass_counts.eliminations++;
+                changed = 1;
+            }
+            break;
+        case AST_IF:
+            changed |= remove_unread_stores(&n->ifstmt.then_b, reads);
+            changed |= remove_unread_stores(&n->ifstmt.else_b, reads);
+            break;
+        case AST_WHILE:
+            changed |= remove_unread_stores(&n->whilestmt.body, reads);
+            break;
+        case AST_FOR:
+            changed |= remove_unread_stores(&n->forstmt.body, reads);
+            break;
+        case AST_FUNC_DEF:
+            changed |= remove_unread_stores(&n->funcdef.body, reads);
+            break;
+        default:
+            break;
+    }
+    return changed;
+}
+
+/* Names bound by code outside function bodies; these may be globals. */
+static void collect_top_bound(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) collect_top_bound(n->statements.stmts[i]);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            name_table_add(&g_top_bound, n->var.name);
+            break;
+        case AST_FOR:
+            name_table_add(&g_top_bound, n->forstmt.var);
+            collect_top_bound(n->forstmt.body);
+            break;
+        case AST_IF:
+            collect_top_bound(n->ifstmt.then_b);
+            collect_top_bound(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            collect_top_bound(n->whilestmt.body);
+            break;
+        case AST_FUNC_DEF:
+            count_reads(n->funcdef.body, &g_func_reads, NULL);
+            break;
+        default:
+            break;
+    }
+}
+
+static int dse_candidate(const DseCtx *ctx, const char *name) {
+    int i;
+    if (!ctx->in_func) return 1;
+    for (i = 0; i < ctx->param_count; i++) {
+        if (strcmp(ctx->params[i], name) == 0) return 1;
+    }
+    return name_table_find(&g_top_bound, name) < 0;
+}
+
+static void dse_reads(ASTNode *n, NameTable *live, const DseCtx *ctx) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            if (name_table_find(live, n->string) < 0) name_table_add(live, n->string);
+            break;
+        case AST_BINARY_OP:
+            dse_reads(n->binop.left, live, ctx);
+            dse_reads(n->binop.right, live, ctx);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) dse_reads(n->funccall.args[i], live, ctx);
+            if (!ctx->in_func && call_runs_user_code(n)) name_table_union(live, &g_func_reads);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) dse_reads(n->arraylit.items[i], live, ctx);
+            break;
+        case AST_INDEX:
+            dse_reads(n->index.array, live, ctx);
+            dse_reads(n->index.index, live, ctx);
+            break;
+        case AST_COND:
+            dse_reads(n->ifstmt.cond, live, ctx);
+            dse_reads(n->ifstmt.then_b, live, ctx);
+            dse_reads(n->ifstmt.else_b, live, ctx);
+            break;
+        default:
+            break;
+    }
+}
+
+static void dse_function(ASTNode *fn);
+static void dse_stmt(ASTNode **slot, NameTable *live, DseCtx *ctx);
+
+/* Adds to `into` the names live on entry to a loop body whose back edge reaches `head`. */
+static void dse_loop_body(ASTNode **body, const NameTable *head, NameTable *out, const char *for_var,
+                          DseCtx *ctx, NameTable *into) {
+    NameTable *saved_break = ctx->break_live;
+    NameTable *saved_continue = ctx->continue_live;
+    NameTable body_live = name_table_copy(head);
+    NameTable continue_live;
+
+    /* A `for` body falls through to the increment, which reads the loop variable. */
+    if (for_var && name_table_find(&body_live, for_var) < 0) name_table_add(&body_live, for_var);
+    continue_live = name_table_copy(&body_live);
+    ctx->break_live = out;
+    ctx->continue_live = &continue_live;
+    dse_stmt(body, &body_live, ctx);
+    name_table_union(into, &body_live);
+    name_table_free(&continue_live);
+    name_table_free(&body_live);
+    ctx->break_live = saved_break;
+    ctx->continue_live = saved_continue;
+}
+
+/* Walks a statement backwards: `live` holds the names live after it on entry and before it on return. */
+static void dse_stmt(ASTNode **slot, NameTable *live, DseCtx *ctx) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = n->statements.count - 1; i >= 0; i--) dse_stmt(&n->statements.stmts[i], live, ctx);
+            break;
+
+        case AST_LET:
+        case AST_ASSIGN:
+            if (dse_candidate(ctx, n->var.name)) {
+                if (name_table_find(live, n->var.name) < 0 && is_pure_expr(n->var.value)) {
+                    if (ctx->apply) {
+                        free_ast(n);
+                        *slot = ast_statements(NULL, 0);
+                        g_pass_counts.eliminations++;
+                    }
+                    break;
+                }
+                name_table_remove(live, n->var.name);
+            }
+            dse_reads(n->var.value, live, ctx);
+            break;
+
+        case AST_RETURN:
+            while (live->count > 0) name_table_remove(live, live->data[0]);
+            dse_reads(n->retstmt.expr, live, ctx);
+            break;
+
+        case AST_BREAK:
+        case AST_CONTINUE: {
+            NameTable *target = n->type == AST_BREAK ? ctx->break_live : ctx->continue_live;
+            while (live->count > 0) name_table_remove(live, live->data[0]);
+            if (target) name_table_union(live, target);
+            break;
+        }
+
+        case AST_IF: {
+            NameTable else_live = name_table_copy(live);
+            dse_stmt(&n->ifstmt.then_b, live, ctx);
+            dse_stmt(&n->ifstmt.else_b, &else_live, ctx);
+            name_table_union(live, &else_live);
+            name_table_free(&else_live);
+            dse_reads(n->ifstmt.cond, live, ctx);
+            break;
+        }
+
+        case AST_WHILE:
+        case AST_FOR: {
+            int is_for = n->type == AST_FOR;
+            const char *var = is_for ? n->forstmt.var : NULL;
+            ASTNode **body = is_for ? &n->forstmt.body : &n->whilestmt.body;
+            NameTable out = name_table_copy(live);
+            NameTable head = name_table_copy(live);
+            int saved_apply = ctx->apply;
+
+            /* Iterate from the optimistic solution up to the least fixpoint, then rewrite once. */
+            ctx->apply = 0;
+            for (;;) {
+                NameTable next = name_table_copy(&out);
+                dse_loop_body(body, &head, &out, var, ctx, &next);
+                if (is_for) {
+                    if (name_table_find(&next, var) < 0) name_table_add(&next, var);
+                    dse_reads(n->forstmt.end, &next, ctx);
+                } else {
+                    dse_reads(n->whilestmt.cond, &next, ctx);
+                }
+                if (name_table_same(&next, &head)) {
+                    name_table_free(&next);
+                    break;
+                }
+                name_table_free(&head);
+                head = next;
+            }
+            ctx->apply = saved_apply;
+            if (ctx->apply) {
+                NameTable unused = {0};
+                dse_loop_body(body, &head, &out, var, ctx, &unused);
+                name_table_free(&unused);
+            }
+
+            name_table_free(live);
+            *live = head;
+            if (is_for) {
+                name_table_remove(live, var);
+                dse_reads(n->forstmt.start, live, ctx);
+            }
+            name_table_free(&out);
+            break;
+        }
+
+        case AST_FUNC_DEF:
+            dse_function(n);
+            break;
+
+        case AST_IMPORT_C:
+            if (!ctx->in_func) name_table_union(live, &g_func_reads);
+            break;
+
+        case AST_PRINT:
+            dse_reads(n->print.expr, live, ctx);
+            break;
+
+        case AST_INDEX_ASSIGN:
+            dse_reads(n->indexassign.array, live, ctx);
+            dse_reads(n->indexassign.index, live, ctx);
+            dse_reads(n->indexassign.value, live, ctx);
+            break;
+
+        default:
+            dse_reads(n, live, ctx);
+            break;
+    }
+}
+
+static void dse_function(ASTNode *fn) {
+    DseCtx ctx = {0};
+    NameTable live = {0};
+
+    ctx.in_func = 1;
+    ctx.apply = 1;
+    ctx.params = fn->funcdef.params;
+    ctx.param_count = fn->funcdef.param_count;
+    dse_stmt(&fn->funcdef.body, &live, &ctx);
+    name_table_free(&live);
+}
+
+static ASTNode *eliminate_dead_stores(ASTNode *root) {
+    DseCtx ctx = {0};
+    NameTable live = {0};
+
+    for (;;) {
+        NameTable reads = {0};
+        int changed;
+        count_reads(root, &reads, NULL);
+        changed = remove_unread_stores(&root, &reads);
+        name_table_free(&reads);
+        if (!changed) break;
+    }
+
+    collect_top_bound(root);
+    ctx.apply = 1;
+    dse_stmt(&root, &live, &ctx);
+    name_table_free(&live);
+    name_table_free(&g_top_bound);
+    name_table_free(&g_func_reads);
+    return root;
+}
+
+/*
+ * Inlining.
+ *
+ * Candidates are functions defined once whose body is a tree of `if`s ending
+ * in `return`s and that call no user code. The body becomes one expression,
+ * with AST_COND standing in for each `if`. Such a body binds nothing and calls
+ * nothing that could rebind a variable, so it behaves the same when evaluated
+ * in the caller's frame. The only difference is where its free variables
+ * resolve, so sites whose caller may bind one of those names are skipped.
+ *
+ * With a profile (spbuild --profile-in), call sites that never ran keep their
+ * call, and hot functions may be up to INLINE_HOT_MAX_NODES; one over the
+ * usual limit is only inlined at hot sites whose arguments always arrived
+ * with the same types, specializing its body to that site.
+ *
+ * -O3 raises the usual limit to INLINE_O3_MAX_NODES. -Os lowers it to
+ * INLINE_OS_MAX_NODES, about what the call itself costs, and ignores the
+ * profile's hot functions.
+ */
+
+#define INLINE_MAX_NODES 48
+#define INLINE_HOT_MAX_NODES 160
+#define INLINE_O3_MAX_NODES 96
+#define INLINE_OS_MAX_NODES 6
+#define INLINE_MAX_ROUNDS 4
+
+typedef struct {
+    const char *name;
+    char **params;
+    int param_count;
+    ASTNode *expr;
+    int size;
+    int *param_uses;
+    int mutates;
+    NameTable free_reads;
+} InlineFn;
+
+typedef struct {
+    InlineFn *data;
+    int count;
+    int cap;
+} InlineTable;
+
+typedef struct {
+    const NameTable *caller_binds;
+    ASTNode ***pre;
+    int *pre_count;
+    int *pre_cap;
+    int inlined;
+} InlineCtx;
+
+typedef struct StmtCont {
+    ASTNode **stmts;
+    int count;
+    const struct StmtCont *next;
+} StmtCont;
+
+static InlineTable g_inline_fns = {0};
+static NameTable g_func_defs = {0};
+static int g_inline_temp_id = 0;
+
+static int ast_size(ASTNode *n) {
+    int i;
+    int size = 1;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_BINARY_OP:
+            return size + ast_size(n->binop.left) + ast_size(n->binop.right);
+        case AST_COND:
+            return size + ast_size(n->ifstmt.cond) + ast_size(n->ifstmt.then_b) + ast_size(n->ifstmt.else_b);
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) size += ast_size(n->funccall.args[i]);
+            return size;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) size += ast_size(n->arraylit.items[i]);
+            return size;
+        case AST_INDEX:
+            return size + ast_size(n->index.array) + ast_size(n->index.index);
+        default:
+            return size;
+    }
+}
+
+/* Turns statements whose every path ends in `return` into one expression; `rest` runs after them. */
+static ASTNode *returns_to_expr(ASTNode **stmts, int count, const StmtCont *rest, int *budget) {
+    ASTNode *s;
+
+    if (--*budget < 0) return NULL;
+    while (count == 0) {
+        /* Falling off the end of a function returns 0. */
+        if (!rest) return ast_number(0.0);
+        stmts = rest->stmts;
+        count = rest->count;
+        rest = rest->next;
+    }
+
+    s = stmts[0];
+    if (!s) return returns_to_expr(stmts + 1, count - 1, rest, budget);
+    switch (s->type) {
+        case AST_RETURN:
+            return s->retstmt.expr ? ast_clone(s->retstmt.expr) : ast_number(0.0);
+        case AST_STATEMENTS: {
+            StmtCont tail = { stmts + 1, count - 1, rest };
+            return returns_to_expr(s->statements.stmts, s->statements.count, &tail, budget);
+        }
+        case AST_IF: {
+            StmtCont tail = { stmts + 1, count - 1, rest };
+            ASTNode *then_e = returns_to_expr(&s->ifstmt.then_b, s->ifstmt.then_b ? 1 : 0, &tail, budget);
+            ASTNode *else_e = then_e ? returns_to_expr(&s->ifstmt.else_b, s->ifstmt.else_b ? 1 : 0, &tail, budget) : NULL;
+            if (!then_e || !else_e) {
+                free_ast(then_e);
+                return NULL;
+            }
+            return ast_cond(ast_clone(s->ifstmt.cond), then_e, else_e);
+        }
+        default:
+            return NULL;
+    }
+}
+
+/* True if the expression calls `append`, the one builtin that changes memory other code can read. */
+static int calls_append(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_FUNCTION_CALL:
+            if (strcmp(n->funccall.name, "append") == 0) return 1;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (calls_append(n->funccall.args[i])) return 1;
+            }
+            return 0;
+        case AST_BINARY_OP:
+            return calls_append(n->binop.left) || calls_append(n->binop.right);
+        case AST_COND:
+            return calls_append(n->ifstmt.cond) || calls_append(n->ifstmt.then_b) || calls_append(n->ifstmt.else_b);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (calls_append(n->arraylit.items[i])) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+            return calls_append(n->index.array) || calls_append(n->index.index);
+        default:
+            return 0;
+    }
+}
+
+static int count_name_uses(ASTNode *n, const char *name) {
+    NameTable reads = {0};
+    int uses;
+    count_reads(n, &reads, NULL);
+    uses = name_table_count(&reads, name);
+    name_table_free(&reads);
+    return uses;
+}
+
+static void collect_func_defs(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) collect_func_defs(n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            name_table_add(&g_func_defs, n->funcdef.name);
+            collect_func_defs(n->funcdef.body);
+            break;
+        case AST_IF:
+            collect_func_defs(n->ifstmt.then_b);
+            collect_func_defs(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            collect_func_defs(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            collect_func_defs(n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static int inline_max_nodes(void) {
+    if (g_opt_size) return INLINE_OS_MAX_NODES;
+    return g_opt_level >= 3 ? INLINE_O3_MAX_NODES : INLINE_MAX_NODES;
+}
+
+static void consider_inline_candidate(ASTNode *fn) {
+    InlineFn *c;
+    ASTNode *body = fn->funcdef.body;
+    ASTNode *expr;
+    unsigned long long calls;
+    int limit = inline_max_nodes();
+    int budget;
+    int i;
+    int j;
+
+    if (name_table_count(&g_func_defs, fn->funcdef.name) != 1) return;
+    if (!g_opt_size && profile_func_calls(fn->funcdef.name, &calls) && profile_is_hot(calls) &&
+        limit < INLINE_HOT_MAX_NODES) {
+        limit = INLINE_HOT_MAX_NODES;
+    }
+    budget = limit;
+    for (i = 0; i < fn->funcdef.param_count; i++) {
+        for (j = i + 1; j < fn->funcdef.param_count; j++) {
+            if (strcmp(fn->funcdef.params[i], fn->funcdef.params[j]) == 0) return;
+        }
+    }
+    expr = returns_to_expr(&body, body ? 1 : 0, NULL, &budget);
+    if (!expr) return;
+    if (runs_user_code(expr) || ast_size(expr) > limit) {
+        free_ast(expr);
+        return;
+    }
+
+    if (g_inline_fns.count >= g_inline_fns.cap) {
+        g_inline_fns.cap = g_inline_fns.cap ? g_inline_fns.cap * 2 : 16;
+        g_inline_fns.data = (InlineFn *)xrealloc(g_inline_fns.data, sizeof(InlineFn) * (size_t)g_inline_fns.cap);
+    }
+    c = &g_inline_fns.data[g_inline_fns.count++];
+    memset(c, 0, sizeof(*c));
+    c->name = fn->funcdef.name;
+    c->params = fn->funcdef.params;
+    c->param_count = fn->funcdef.param_count;
+    c->expr = expr;
+    c->size = ast_size(expr);
+    c->mutates = calls_append(expr);
+    c->param_uses = (int *)xmalloc(sizeof(int) * (size_t)(c->param_count + 1));
+    count_reads(expr, &c->free_reads, NULL);
+    for (i = 0; i < c->param_count; i++) {
+        c->param_uses[i] = count_name_uses(expr, c->params[i]);
+        name_table_remove(&c->free_reads, c->params[i]);
+    }
+}
+
+static void collect_inline_candidates(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) collect_inline_candidates(n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            consider_inline_candidate(n);
+            collect_inline_candidates(n->funcdef.body);
+            break;
+        case AST_IF:
+            collect_inline_candidates(n->ifstmt.then_b);
+            collect_inline_candidates(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            collect_inline_candidates(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            collect_inline_candidates(n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void free_inline_candidates(void) {
+    int i;
+    for (i = 0; i < g_inline_fns.count; i++) {
+        free_ast(g_inline_fns.data[i].expr);
+        free(g_inline_fns.data[i].param_uses);
+        name_table_free(&g_inline_fns.data[i].free_reads);
+    }
+    free(g_inline_fns.data);
+    memset(&g_inline_fns, 0, sizeof(g_inline_fns));
+}
+
+static InlineFn *find_inline_fn(ASTNode *call) {
+    int i;
+    for (i = 0; i < g_inline_fns.count; i++) {
+        InlineFn *f = &g_inline_fns.data[i];
+        if (f->param_count == call->funccall.arg_count && strcmp(f->name, call->funccall.name) == 0) return f;
+    }
+    return NULL;
+}
+
+/*
+ * True if evaluating `n` may rebind a variable or grow an array, so values
+ * read before it cannot be moved past it.
+ */
+static int has_opaque_call(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_FUNCTION_CALL: {
+            InlineFn *f = find_inline_fn(n);
+            if (f ? f->mutates : (call_runs_user_code(n) || strcmp(n->funccall.name, "append") == 0)) return 1;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (has_opaque_call(n->funccall.args[i])) return 1;
+            }
+            return 0;
+        }
+        case AST_BINARY_OP:
+            return has_opaque_call(n->binop.left) || has_opaque_call(n->binop.right);
+        case AST_COND:
+            return has_opaque_call(n->ifstmt.cond) || has_opaque_call(n->ifstmt.then_b) ||
+                   has_opaque_call(n->ifstmt.else_b);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (has_opaque_call(n->arraylit.items[i])) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+            return has_opaque_call(n->index.array) || has_opaque_call(n->index.index);
+        default:
+            return 0;
+    }
+}
+
+static ASTNode *substitute_params(ASTNode *n, const InlineFn *f, ASTNode **args) {
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            for (i = 0; i < f->param_count; i++) {
+                if (strcmp(n->string, f->params[i]) == 0) {
+                    free_ast(n);
+                    return ast_clone(args[i]);
+                }
+            }
+            return n;
+        case AST_BINARY_OP:
+            n->binop.left = substitute_params(n->binop.left, f, args);
+            n->binop.right = substitute_params(n->binop.right, f, args);
+            return n;
+        case AST_COND:
+            n->ifstmt.cond = substitute_params(n->ifstmt.cond, f, args);
+            n->ifstmt.then_b = substitute_params(n->ifstmt.then_b, f, args);
+            n->ifstmt.else_b = substitute_params(n->ifstmt.else_b, f, args);
+            return n;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                n->funccall.args[i] = substitute_params(n->funccall.args[i], f, args);
+            }
+            return n;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                n->arraylit.items[i] = substitute_params(n->arraylit.items[i], f, args);
+            }
+            return n;
+        case AST_INDEX:
+            n->index.array = substitute_params(n->index.array, f, args);
+            n->index.index = substitute_params(n->index.index, f, args);
+            return n;
+        default:
+            return n;
+    }
+}
+
+static void inline_pre_push(InlineCtx *ctx, ASTNode *stmt) {
+    if (*ctx->pre_count >= *ctx->pre_cap) {
+        *ctx->pre_cap = *ctx->pre_cap ? *ctx->pre_cap * 2 : 4;
+        *ctx->pre = (ASTNode **)xrealloc(*ctx->pre, sizeof(ASTNode *) * (size_t)*ctx->pre_cap);
+    }
+    (*ctx->pre)[(*ctx->pre_count)++] = stmt;
+}
+
+static int profile_allows_inline(ASTNode *call, const InlineFn *f) {
+    const SiteProfile *sp = profile_site(call->site);
+
+    if (sp && (sp->known & PROFILE_CALL) && sp->calls == 0) return 0;
+    if (f->size <= inline_max_nodes()) return 1;
+    return sp && (sp->known & PROFILE_CALL) && profile_is_hot(sp->calls) && !sp->mixed_types;
+}
+
+static ASTNode *inline_call(ASTNode *call, InlineCtx *ctx) {
+    InlineFn *f = find_inline_fn(call);
+    ASTNode **args;
+    ASTNode *out;
+    int i;
+
+    if (!f || !profile_allows_inline(call, f)) return call;
+    if (ctx->caller_binds) {
+        for (i = 0; i < f->free_reads.count; i++) {
+            if (name_table_find(ctx->caller_binds, f->free_reads.data[i]) >= 0) return call;
+        }
+    }
+    for (i = 0; i < f->param_count; i++) {
+        ASTNode *a = call->funccall.args[i];
+        int simple = a->type == AST_NUMBER || a->type == AST_STRING || a->type == AST_IDENTIFIER;
+        /* An `append` in the body can change what a pure argument such as `xs[2]` reads. */
+        if (simple || (!f->mutates && is_pure_expr(a) && f->param_uses[i] <= 1)) continue;
+        /* Other arguments are evaluated once into a temporary ahead of the statement. */
+        if (!ctx->pre || !is_pure_expr(a)) return call;
+    }
+
+    args = (ASTNode **)xmalloc(sizeof(ASTNode *) * (size_t)(f->param_count + 1));
+    for (i = 0; i < f->param_count; i++) {
+        ASTNode *a = call->funccall.args[i];
+        int simple = a->type == AST_NUMBER || a->type == AST_STRING || a->type == AST_IDENTIFIER;
+        if (simple || (!f->mutates && f->param_uses[i] <= 1)) {
+            args[i] = a;
+        } else {
+            char temp[32];
+            snprintf(temp, sizeof(temp), "$inl%d", ++g_inline_temp_id);
+            inline_pre_push(ctx, ast_var(AST_ASSIGN, temp, a));
+            args[i] = ast_ident(temp);
+        }
+        call->funccall.args[i] = NULL;
+    }
+    out = substitute_params(ast_clone(f->expr), f, args);
+    for (i = 0; i < f->param_count; i++) free_ast(args[i]);
+    free(args);
+    free_ast(call);
+    ctx->inlined++;
+    g_pass_counts.inlines++;
+    return out;
+}
+
+/* Inlines calls in an expression. Temporaries may only be hoisted where `ctx->pre` is set. */
+static ASTNode *inline_expr(ASTNode *n, InlineCtx *ctx) {
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                n->funccall.args[i] = inline_expr(n->funccall.args[i], ctx);
+            }
+            return inline_call(n, ctx);
+        case AST_BINARY_OP:
+            n->binop.left = inline_expr(n->binop.left, ctx);
+            if (n->binop.op && (strcmp(n->binop.op, "&&") == 0 || strcmp(n->binop.op, "||") == 0)) {
+                ASTNode ***saved = ctx->pre;
+                ctx->pre = NULL;
+                n->binop.right = inline_expr(n->binop.right, ctx);
+                ctx->pre = saved;
+            } else {
+                n->binop.right = inline_expr(n->binop.right, ctx);
+            }
+            return n;
+        case AST_COND: {
+            ASTNode ***saved = ctx->pre;
+            n->ifstmt.cond = inline_expr(n->ifstmt.cond, ctx);
+            ctx->pre = NULL;
+            n->ifstmt.then_b = inline_expr(n->ifstmt.then_b, ctx);
+            n->ifstmt.else_b = inline_expr(n->ifstmt.else_b, ctx);
+            ctx->pre = saved;
+            return n;
+        }
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                n->arraylit.items[i] = inline_expr(n->arraylit.items[i], ctx);
+            }
+            return n;
+        case AST_INDEX:
+            n->index.array = inline_expr(n->index.array, ctx);
+            n->index.index = inline_expr(n->index.index, ctx);
+            return n;
+        default:
+            return n;
+    }
+}
+
+static void inline_function(ASTNode *fn, int *inlined);
+
+static void inline_stmt(ASTNode **slot, const NameTable *caller_binds, int *inlined) {
+    ASTNode *n = *slot;
+    ASTNode **pre = NULL;
+    int pre_count = 0;
+    int pre_cap = 0;
+    InlineCtx ctx;
+    int i;
+
+    if (!n) return;
+    ctx.caller_binds = caller_binds;
+    ctx.pre = &pre;
+    ctx.pre_count = &pre_count;
+    ctx.pre_cap = &pre_cap;
+    ctx.inlined = 0;
+
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) inline_stmt(&n->statements.stmts[i], caller_binds, inlined);
+            return;
+        case AST_FUNC_DEF:
+            inline_function(n, inlined);
+            return;
+        case AST_BREAK:
+        case AST_CONTINUE:
+        case AST_IMPORT_C:
+            return;
+        default:
+            break;
+    }
+
+    /* Hoisting a temporary is only safe if nothing earlier in the statement can rebind variables. */
+    switch (n->type) {
+        case AST_LET:
+        case AST_ASSIGN:
+            if (has_opaque_call(n->var.value)) ctx.pre = NULL;
+            n->var.value = inline_expr(n->var.value, &ctx);
+            break;
+        case AST_PRINT:
+            if (has_opaque_call(n->print.expr)) ctx.pre = NULL;
+            n->print.expr = inline_expr(n->print.expr, &ctx);
+            break;
+        case AST_RETURN:
+            if (has_opaque_call(n->retstmt.expr)) ctx.pre = NULL;
+            n->retstmt.expr = inline_expr(n->retstmt.expr, &ctx);
+            break;
+        case AST_INDEX_ASSIGN:
+            if (has_opaque_call(n->indexassign.array) || has_opaque_call(n->indexassign.index) ||
+                has_opaque_call(n->indexassign.value)) {
+                ctx.pre = NULL;
+            }
+            n->indexassign.array = inline_expr(n->indexassign.array, &ctx);
+            n->indexassign.index = inline_expr(n->indexassign.index, &ctx);
+            n->indexassign.value = inline_expr(n->indexassign.value, &ctx);
+            break;
+        case AST_IF:
+            if (has_opaque_call(n->ifstmt.cond)) ctx.pre = NULL;
+            n->ifstmt.cond = inline_expr(n->ifstmt.cond, &ctx);
+            inline_stmt(&n->ifstmt.then_b, caller_binds, inlined);
+            inline_stmt(&n->ifstmt.else_b, caller_binds, inlined);
+            break;
+        case AST_WHILE:
+            /* The condition runs on every iteration, so nothing can be hoisted out of it. */
+            ctx.pre = NULL;
+            n->whilestmt.cond = inline_expr(n->whilestmt.cond, &ctx);
+            inline_stmt(&n->whilestmt.body, caller_binds, inlined);
+            break;
+        case AST_FOR: {
+            if (has_opaque_call(n->forstmt.start)) ctx.pre = NULL;
+            n->forstmt.start = inline_expr(n->forstmt.start, &ctx);
+            {
+                ASTNode ***saved = ctx.pre;
+                ctx.pre = NULL;
+                n->forstmt.end = inline_expr(n->forstmt.end, &ctx);
+                ctx.pre = saved;
+            }
+            inline_stmt(&n->forstmt.body, caller_binds, inlined);
+            break;
+        }
+        default:
+            if (has_opaque_call(n)) ctx.pre = NULL;
+            n = inline_expr(n, &ctx);
+            *slot = n;
+            break;
+    }
+
+    *inlined += ctx.inlined;
+    if (pre_count > 0) {
+        pre = (ASTNode **)xrealloc(pre, sizeof(ASTNode *) * (size_t)(pre_count + 1));
+        pre[pre_count++] = *slot;
+        *slot = ast_statements(pre, pre_count);
+    } else {
+        free(pre);
+    }
+}
+
+static void inline_function(ASTNode *fn, int *inlined) {
+    NameTable binds = {0};
+    int i;
+
+    for (i = 0; i < fn->funcdef.param_count; i++) name_table_add(&binds, fn->funcdef.params[i]);
+    collect_assigned(fn->funcdef.body, &binds);
+    inline_stmt(&fn->funcdef.body, &binds, inlined);
+    name_table_free(&binds);
+}
+
+static ASTNode *inline_functions(ASTNode *root) {
+    int round;
+
+    for (round = 0; round < INLINE_MAX_ROUNDS; round++) {
+        int inlined = 0;
+
+        collect_program_names(root);
+        collect_func_defs(root);
+        collect_inline_candidates(root);
+        if (g_inline_fns.count > 0) inline_stmt(&root, NULL, &inlined);
+        free_inline_candidates();
+        name_table_free(&g_func_defs);
+        name_table_free(&g_assign_counts);
+        name_table_free(&g_user_funcs);
+        if (inlined == 0) break;
+        root = optimize_node(root);
+    }
+    return root;
+}
+
+/*
+ * Compile-time evaluation.
+ *
+ * A call whose arguments are all literals is run by a small interpreter
+ * over the AST and replaced by its result. Purity is checked along the path
+ * actually taken: the run gives up on anything with an effect or an input
+ * it cannot see (output, arrays, native calls, reads of globals, stores that
+ * may reach a global, calls to functions defined more than once) and when
+ * it runs out of steps or frames. Operators fold through optimize_node, so
+ * the results match the constant folder. Pure builtins fold the same way.
+ */
+
+#define CTFE_MAX_STEPS 20000
+#define CTFE_MAX_DEPTH 16
+
+enum { CTFE_NEXT, CTFE_BREAK, CTFE_CONTINUE, CTFE_RETURN, CTFE_FAIL };
+
+typedef struct {
+    const char *name;
+    ASTNode *value;
+} CtfeVar;
+
+typedef struct {
+    CtfeVar *vars;
+    int count;
+    int cap;
+} CtfeFrame;
+
+typedef struct {
+    ASTNode **data;
+    int count;
+    int cap;
+} CtfeFuncs;
+
+static CtfeFuncs g_ctfe_funcs = {0};
+static int g_ctfe_steps = 0;
+static int g_ctfe_depth = 0;
+
+static void ctfe_collect(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) ctfe_collect(n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            if (g_ctfe_funcs.count >= g_ctfe_funcs.cap) {
+                g_ctfe_funcs.cap = g_ctfe_funcs.cap ? g_ctfe_funcs.cap * 2 : 16;
+                g_ctfe_funcs.data = (ASTNode **)xrealloc(g_ctfe_funcs.data, sizeof(ASTNode *) * (size_t)g_ctfe_funcs.cap);
+            }
+            g_ctfe_funcs.data[g_ctfe_funcs.count++] = n;
+            ctfe_collect(n->funcdef.body);
+            break;
+        case AST_IF:
+            ctfe_collect(n->ifstmt.then_b);
+            ctfe_collect(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            ctfe_collect(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            ctfe_collect(n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *ctfe_find_func(const char *name) {
+    int i;
+
+    if (name_table_count(&g_func_defs, name) != 1) return NULL;
+    for (i = 0; i < g_ctfe_funcs.count; i++) {
+        if (strcmp(g_ctfe_funcs.data[i]->funcdef.name, name) == 0) return g_ctfe_funcs.data[i];
+    }
+    return NULL;
+}
+
+static CtfeVar *ctfe_lookup(CtfeFrame *f, const char *name) {
+    int i;
+
+    for (i = 0; i < f->count; i++) {
+        if (strcmp(f->vars[i].name, name) == 0) return &f->vars[i];
+    }
+    return NULL;
+}
+
+/* Stores like OP_STORE in a call frame; fails where the store could reach a global. Takes `value`. */
+static int ctfe_store(CtfeFrame *f, const char *name, ASTNode *value) {
+    CtfeVar *v = ctfe_lookup(f, name);
+
+    if (!v) {
+        if (name_table_find(&g_top_bound, name) >= 0) {
+            free_ast(value);
+            return 0;
+        }
+        if (f->count >= f->cap) {
+            f->cap = f->cap ? f->cap * 2 : 8;
+            f->vars = (CtfeVar *)xrealloc(f->vars, sizeof(CtfeVar) * (size_t)f->cap);
+        }
+        v = &f->vars[f->count++];
+        v->name = name;
+        v->value = NULL;
+    }
+    free_ast(v->value);
+    v->value = value;
+    return 1;
+}
+
+static void ctfe_frame_free(CtfeFrame *f) {
+    int i;
+    for (i = 0; i < f->count; i++) free_ast(f->vars[i].value);
+    free(f->vars);
+}
+
+static const char *const g_ctfe_builtins[] = {
+    "len", "sin", "cos", "tan", "sqrt", "pow", "mod", "abs", "floor", "ceil",
+    "round", "min", "max", "clamp", "to_number", "lerp"
+};
+
+/* Mirrors call_builtin_or_native for the builtins that only compute a value. */
+static ASTNode *ctfe_builtin(const char *name, ASTNode **args, int argc) {
+    double x[3] = {0.0, 0.0, 0.0};
+    int nums = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(g_ctfe_builtins) / sizeof(g_ctfe_builtins[0]); i++) {
+        if (strcmp(g_ctfe_builtins[i], name) == 0) break;
+    }
+    if (i == sizeof(g_ctfe_builtins) / sizeof(g_ctfe_builtins[0])) return NULL;
+
+    if (strcmp(name, "len") == 0) {
+        if (argc < 1 || args[0]->type == AST_NUMBER) return ast_number(0.0);
+        return ast_number((double)strlen(args[0]->string));
+    }
+    if (strcmp(name, "to_number") == 0) {
+        if (argc < 1) return ast_number(0.0);
+        if (args[0]->type == AST_NUMBER) return ast_number(args[0]->number);
+        return ast_number(strtod(args[0]->string, NULL));
+    }
+    /* The rest return 0 unless each argument they use is a number. */
+    while (nums < argc && nums < 3 && args[nums]->type == AST_NUMBER) {
+        x[nums] = args[nums]->number;
+        nums++;
+    }
+    if (strcmp(name, "sin") == 0) return ast_number(nums >= 1 ? sin(x[0]) : 0.0);
+    if (strcmp(name, "cos") == 0) return ast_number(nums >= 1 ? cos(x[0]) : 0.0);
+    if (strcmp(name, "tan") == 0) return ast_number(nums >= 1 ? tan(x[0]) : 0.0);
+    if (strcmp(name, "sqrt") == 0) return ast_number(nums >= 1 && x[0] >= 0.0 ? sqrt(x[0]) : 0.0);
+    if (strcmp(name, "abs") == 0) return ast_number(nums >= 1 ? fabs(x[0]) : 0.0);
+    if (strcmp(name, "floor") == 0) return ast_number(nums >= 1 ? floor(x[0]) : 0.0);
+    if (strcmp(name, "ceil") == 0) return ast_number(nums >= 1 ? ceil(x[0]) : 0.0);
+    if (strcmp(name, "round") == 0) return ast_number(nums >= 1 ? round(x[0]) : 0.0);
+    if (strcmp(name, "pow") == 0) return ast_number(nums >= 2 ? pow(x[0], x[1]) : 0.0);
+    if (strcmp(name, "mod") == 0) return ast_number(nums >= 2 && x[1] != 0.0 ? fmod(x[0], x[1]) : 0.0);
+    if (strcmp(name, "min") == 0) return ast_number(nums >= 2 ? (x[0] < x[1] ? x[0] : x[1]) : 0.0);
+    if (strcmp(name, "max") == 0) return ast_number(nums >= 2 ? (x[0] > x[1] ? x[0] : x[1]) : 0.0);
+    if (strcmp(name, "clamp") == 0) {
+        if (nums < 3) return ast_number(0.0);
+        if (x[0] < x[1]) x[0] = x[1];
+        if (x[0] > x[2]) x[0] = x[2];
+        return ast_number(x[0]);
+    }
+    return ast_number(nums >= 3 ? x[0] + (x[1] - x[0]) * x[2] : 0.0);
+}
+
+static ASTNode *ctfe_call(ASTNode *fn, ASTNode **args, int argc);
+
+/* Evaluates to a fresh literal, or NULL when the value is not known at compile time. */
+static ASTNode *ctfe_expr(ASTNode *n, CtfeFrame *f) {
+    ASTNode *l;
+    ASTNode *r;
+    int truthy;
+    int i;
+
+    if (!n || ++g_ctfe_steps > CTFE_MAX_STEPS) return NULL;
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+            return ast_clone(n);
+        case AST_IDENTIFIER: {
+            CtfeVar *v = ctfe_lookup(f, n->string);
+            return v ? ast_clone(v->value) : NULL;
+        }
+        case AST_BINARY_OP:
+            l = ctfe_expr(n->binop.left, f);
+            if (!l) return NULL;
+            if (strcmp(n->binop.op, "&&") == 0 || strcmp(n->binop.op, "||") == 0) {
+                int is_and = strcmp(n->binop.op, "&&") == 0;
+                if (!literal_truthy(l, &truthy)) {
+                    free_ast(l);
+                    return NULL;
+                }
+                free_ast(l);
+                if (truthy != is_and) return ast_number(truthy ? 1.0 : 0.0);
+                r = ctfe_expr(n->binop.right, f);
+                if (!r) return NULL;
+                if (!literal_truthy(r, &truthy)) {
+                    free_ast(r);
+                    return NULL;
+                }
+                free_ast(r);
+                return ast_number(truthy ? 1.0 : 0.0);
+            }
+            r = NULL;
+            if (n->binop.right) {
+                r = ctfe_expr(n->binop.right, f);
+                if (!r) {
+                    free_ast(l);
+                    return NULL;
+                }
+            }
+            l = optimize_node(ast_binop(n->binop.op, l, r));
+            if (is_literal(l)) return l;
+            free_ast(l);
+            return NULL;
+        case AST_COND:
+            l = ctfe_expr(n->ifstmt.cond, f);
+            if (!l) return NULL;
+            if (!literal_truthy(l, &truthy)) {
+                free_ast(l);
+                return NULL;
+            }
+            free_ast(l);
+            return ctfe_expr(truthy ? n->ifstmt.then_b : n->ifstmt.else_b, f);
+        case AST_FUNCTION_CALL: {
+            ASTNode *fn = ctfe_find_func(n->funccall.name);
+            ASTNode **args = NULL;
+            ASTNode *out = NULL;
+
+            if (!fn && name_table_find(&g_func_defs, n->funccall.name) >= 0) return NULL;
+            if (n->funccall.arg_count > 0) args = (ASTNode **)xmalloc(sizeof(ASTNode *) * (size_t)n->funccall.arg_count);
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                args[i] = ctfe_expr(n->funccall.args[i], f);
+                if (!args[i]) break;
+            }
+            if (i == n->funccall.arg_count) {
+                out = fn ? ctfe_call(fn, args, i) : ctfe_builtin(n->funccall.name, args, i);
+            }
+            while (--i >= 0) free_ast(args[i]);
+            free(args);
+            return out;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static int ctfe_stmt(ASTNode *n, CtfeFrame *f, ASTNode **ret) {
+    ASTNode *v;
+    int status;
+    int truthy;
+    int i;
+
+    if (!n) return CTFE_NEXT;
+    if (++g_ctfe_steps > CTFE_MAX_STEPS) return CTFE_FAIL;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                status = ctfe_stmt(n->statements.stmts[i], f, ret);
+                if (status != CTFE_NEXT) return status;
+            }
+            return CTFE_NEXT;
+        case AST_LET:
+        case AST_ASSIGN:
+            v = ctfe_expr(n->var.value, f);
+            return v && ctfe_store(f, n->var.name, v) ? CTFE_NEXT : CTFE_FAIL;
+        case AST_IF:
+            v = ctfe_expr(n->ifstmt.cond, f);
+            if (!v) return CTFE_FAIL;
+            if (!literal_truthy(v, &truthy)) {
+                free_ast(v);
+                return CTFE_FAIL;
+            }
+            free_ast(v);
+            return ctfe_stmt(truthy ? n->ifstmt.then_b : n->ifstmt.else_b, f, ret);
+        case AST_WHILE:
+            for (;;) {
+                v = ctfe_expr(n->whilestmt.cond, f);
+                if (!v) return CTFE_FAIL;
+                if (!literal_truthy(v, &truthy)) {
+                    free_ast(v);
+                    return CTFE_FAIL;
+                }
+                free_ast(v);
+                if (!truthy) return CTFE_NEXT;
+                status = ctfe_stmt(n->whilestmt.body, f, ret);
+                if (status == CTFE_BREAK) return CTFE_NEXT;
+                if (status == CTFE_RETURN || status == CTFE_FAIL) return status;
+            }
+        case AST_FOR: {
+            CtfeVar *var;
+            v = ctfe_expr(n->forstmt.start, f);
+            if (!v || !ctfe_store(f, n->forstmt.var, v)) return CTFE_FAIL;
+            for (;;) {
+                ASTNode *end = ctfe_expr(n->forstmt.end, f);
+                if (!end) return CTFE_FAIL;
+                var = ctfe_lookup(f, n->forstmt.var);
+                v = optimize_node(ast_binop("<=", ast_clone(var->value), end));
+                if (!literal_truthy(v, &truthy)) {
+                    free_ast(v);
+                    return CTFE_FAIL;
+                }
+                free_ast(v);
+                if (!truthy) return CTFE_NEXT;
+                status = ctfe_stmt(n->forstmt.body, f, ret);
+                if (status == CTFE_BREAK) return CTFE_NEXT;
+                if (status == CTFE_RETURN || status == CTFE_FAIL) return status;
+                /* OP_INC; the body cannot have dropped the variable from the frame. */
+                var = ctfe_lookup(f, n->forstmt.var);
+                if (var->value->type != AST_NUMBER) return CTFE_FAIL;
+                var->value->number += 1.0;
+            }
+        }
+        case AST_RETURN:
+            *ret = n->retstmt.expr ? ctfe_expr(n->retstmt.expr, f) : ast_number(0.0);
+            return *ret ? CTFE_RETURN : CTFE_FAIL;
+        case AST_BREAK:
+            return CTFE_BREAK;
+        case AST_CONTINUE:
+            return CTFE_CONTINUE;
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_IDENTIFIER:
+        case AST_BINARY_OP:
+        case AST_COND:
+        case AST_FUNCTION_CALL:
+            v = ctfe_expr(n, f);
+            free_ast(v);
+            return v ? CTFE_NEXT : CTFE_FAIL;
+        default:
+            return CTFE_FAIL;
+    }
+}
+
+static ASTNode *ctfe_call(ASTNode *fn, ASTNode **args, int argc) {
+    CtfeFrame frame = {0};
+    ASTNode *ret = NULL;
+    int status;
+    int i;
+
+    if (g_ctfe_depth >= CTFE_MAX_DEPTH) return NULL;
+    for (i = 0; i < fn->funcdef.param_count; i++) {
+        /* Duplicate parameter names would bind in an order the interpreter does not model. */
+        if (ctfe_lookup(&frame, fn->funcdef.params[i])) {
+            ctfe_frame_free(&frame);
+            return NULL;
+        }
+        if (frame.count >= frame.cap) {
+            frame.cap = frame.cap ? frame.cap * 2 : 8;
+            frame.vars = (CtfeVar *)xrealloc(frame.vars, sizeof(CtfeVar) * (size_t)frame.cap);
+        }
+        frame.vars[frame.count].name = fn->funcdef.params[i];
+        frame.vars[frame.count].value = i < argc ? ast_clone(args[i]) : ast_number(0.0);
+        frame.count++;
+    }
+
+    g_ctfe_depth++;
+    status = ctfe_stmt(fn->funcdef.body, &frame, &ret);
+    g_ctfe_depth--;
+    ctfe_frame_free(&frame);
+    if (status == CTFE_RETURN) return ret;
+    if (status == CTFE_NEXT) return ast_number(0.0);
+    free_ast(ret);
+    return NULL;
+}
+
+static ASTNode *ctfe_fold(ASTNode *n) {
+    CtfeFrame empty = {0};
+    PassCounts saved;
+    ASTNode *out;
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_BINARY_OP:
+            n->binop.left = ctfe_fold(n->binop.left);
+            n->binop.right = ctfe_fold(n->binop.right);
+            break;
+        case AST_COND:
+        case AST_IF:
+            n->ifstmt.cond = ctfe_fold(n->ifstmt.cond);
+            n->ifstmt.then_b = ctfe_fold(n->ifstmt.then_b);
+            n->ifstmt.else_b = ctfe_fold(n->ifstmt.else_b);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) n->arraylit.items[i] = ctfe_fold(n->arraylit.items[i]);
+            break;
+        case AST_INDEX:
+            n->index.array = ctfe_fold(n->index.array);
+            n->index.index = ctfe_fold(n->index.index);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) n->statements.stmts[i] = ctfe_fold(n->statements.stmts[i]);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            n->var.value = ctfe_fold(n->var.value);
+            break;
+        case AST_PRINT:
+            n->print.expr = ctfe_fold(n->print.expr);
+            break;
+        case AST_RETURN:
+            n->retstmt.expr = ctfe_fold(n->retstmt.expr);
+            break;
+        case AST_INDEX_ASSIGN:
+            n->indexassign.array = ctfe_fold(n->indexassign.array);
+            n->indexassign.index = ctfe_fold(n->indexassign.index);
+            n->indexassign.value = ctfe_fold(n->indexassign.value);
+            break;
+        case AST_WHILE:
+            n->whilestmt.cond = ctfe_fold(n->whilestmt.cond);
+            n->whilestmt.body = ctfe_fold(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            n->forstmt.start = ctfe_fold(n->forstmt.start);
+            n->forstmt.end = ctfe_fold(n->forstmt.end);
+            n->forstmt.body = ctfe_fold(n->forstmt.body);
+            break;
+        case AST_FUNC_DEF:
+            n->funcdef.body = ctfe_fold(n->funcdef.body);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                n->funccall.args[i] = ctfe_fold(n->funccall.args[i]);
+                if (!is_literal(n->funccall.args[i])) return n;
+            }
+            g_ctfe_steps = 0;
+            saved = g_pass_counts; /* the interpreter folds as it evaluates; only the call counts */
+            out = ctfe_expr(n, &empty);
+            g_pass_counts = saved;
+            if (out) {
+                g_pass_counts.folds++;
+                free_ast(n);
+                return out;
+            }
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+static ASTNode *evaluate_constant_calls(ASTNode *root) {
+    collect_func_defs(root);
+    collect_top_bound(root);
+    ctfe_collect(root);
+    root = ctfe_fold(root);
+    free(g_ctfe_funcs.data);
+    memset(&g_ctfe_funcs, 0, sizeof(g_ctfe_funcs));
+    name_table_free(&g_func_defs);
+    name_table_free(&g_top_bound);
+    name_table_free(&g_func_reads);
+    return root;
+}
+
+/*
+ * Loop unrolling.
+ *
+ * A `for` loop with literal bounds and an integral start is rewritten into
+ * copies of its body with the loop variable substituted, so each copy folds
+ * on its own. The body must not rebind the variable, run user code, define
+ * functions or `break`/`continue` this loop. Short loops are unrolled fully;
+ * longer ones become a `while` running UNROLL_FACTOR copies per iteration,
+ * followed by the leftover iterations. The variable then gets the value the
+ * loop would have left in it. With a profile, a loop that iterated at least
+ * UNROLL_HOT_ITERATIONS times gets a bigger budget, as every loop does at
+ * -O3.
+ */
+
+#define UNROLL_FULL_TRIPS 16
+#define UNROLL_FACTOR 4
+#define UNROLL_MAX_NODES 256
+#define UNROLL_HOT_MAX_NODES 512
+#define UNROLL_HOT_ITERATIONS 4096
+
+typedef struct {
+    ASTNode **stmts;
+    int count;
+    int cap;
+} UnrollOut;
+
+static int stmt_size(ASTNode *n) {
+    int i;
+    int size = 1;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) size += stmt_size(n->statements.stmts[i]);
+            return size;
+        case AST_LET:
+        case AST_ASSIGN:
+            return size + ast_size(n->var.value);
+        case AST_PRINT:
+            return size + ast_size(n->print.expr);
+        case AST_RETURN:
+            return size + ast_size(n->retstmt.expr);
+        case AST_INDEX_ASSIGN:
+            return size + ast_size(n->indexassign.array) + ast_size(n->indexassign.index) +
+                   ast_size(n->indexassign.value);
+        case AST_IF:
+            return size + ast_size(n->ifstmt.cond) + stmt_size(n->ifstmt.then_b) + stmt_size(n->ifstmt.else_b);
+        case AST_WHILE:
+            return size + ast_size(n->whilestmt.cond) + stmt_size(n->whilestmt.body);
+        case AST_FOR:
+            return size + ast_size(n->forstmt.start) + ast_size(n->forstmt.end) + stmt_size(n->forstmt.body);
+        default:
+            return ast_size(n);
+    }
+}
+
+/* True if the body cannot be copied: it leaves the loop early or defines functions. */
+static int unroll_blocked(ASTNode *n, int nested) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_BREAK:
+        case AST_CONTINUE:
+            return !nested;
+        case AST_FUNC_DEF:
+            return 1;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                if (unroll_blocked(n->statements.stmts[i], nested)) return 1;
+            }
+            return 0;
+        case AST_IF:
+            return unroll_blocked(n->ifstmt.then_b, nested) || unroll_blocked(n->ifstmt.else_b, nested);
+        case AST_WHILE:
+            return unroll_blocked(n->whilestmt.body, 1);
+        case AST_FOR:
+            return unroll_blocked(n->forstmt.body, 1);
+        default:
+            return 0;
+    }
+}
+
+/* Replaces reads of `name` in a statement subtree that never binds it. */
+static ASTNode *unroll_subst(ASTNode *n, const char *name, ASTNode *value) {
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            if (strcmp(n->string, name) == 0) {
+                free_ast(n);
+                return ast_clone(value);
+            }
+            break;
+        case AST_BINARY_OP:
+            n->binop.left = unroll_subst(n->binop.left, name, value);
+            n->binop.right = unroll_subst(n->binop.right, name, value);
+            break;
+        case AST_COND:
+        case AST_IF:
+            n->ifstmt.cond = unroll_subst(n->ifstmt.cond, name, value);
+            n->ifstmt.then_b = unroll_subst(n->ifstmt.then_b, name, value);
+            n->ifstmt.else_b = unroll_subst(n->ifstmt.else_b, name, value);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) n->funccall.args[i] = unroll_subst(n->funccall.args[i], name, value);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) n->arraylit.items[i] = unroll_subst(n->arraylit.items[i], name, value);
+            break;
+        case AST_INDEX:
+            n->index.array = unroll_subst(n->index.array, name, value);
+            n->index.index = unroll_subst(n->index.index, name, value);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                n->statements.stmts[i] = unroll_subst(n->statements.stmts[i], name, value);
+            }
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            n->var.value = unroll_subst(n->var.value, name, value);
+            break;
+        case AST_PRINT:
+            n->print.expr = unroll_subst(n->print.expr, name, value);
+            break;
+        case AST_RETURN:
+            n->retstmt.expr = unroll_subst(n->retstmt.expr, name, value);
+            break;
+        case AST_INDEX_ASSIGN:
+            n->indexassign.array = unroll_subst(n->indexassign.array, name, value);
+            n->indexassign.index = unroll_subst(n->indexassign.index, name, value);
+            n->indexassign.value = unroll_subst(n->indexassign.value, name, value);
+            break;
+        case AST_WHILE:
+            n->whilestmt.cond = unroll_subst(n->whilestmt.cond, name, value);
+            n->whilestmt.body = unroll_subst(n->whilestmt.body, name, value);
+            break;
+        case AST_FOR:
+            n->forstmt.start = unroll_subst(n->forstmt.start, name, value);
+            n->forstmt.end = unroll_subst(n->forstmt.end, name, value);
+            n->forstmt.body = unroll_subst(n->forstmt.body, name, value);
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+static void unroll_push(UnrollOut *out, ASTNode *stmt) {
+    if (out->count >= out->cap) {
+        out->cap = out->cap ? out->cap * 2 : 8;
+        out->stmts = (ASTNode **)xrealloc(out->stmts, sizeof(ASTNode *) * (size_t)out->cap);
+    }
+    out->stmts[out->count++] = stmt;
+}
+
+/* Appends a copy of `body` for the iteration where the variable equals `value`; takes `value`. */
+static void unroll_push_copy(UnrollOut *out, ASTNode *body, const char *var, ASTNode *value) {
+    unroll_push(out, unroll_subst(ast_clone(body), var, value));
+    free_ast(value);
+}
+
+static ASTNode *unroll_for(ASTNode *n) {
+    const SiteProfile *sp = profile_site(n->site);
+    NameTable assigned = {0};
+    UnrollOut out = {0};
+    double start;
+    double end;
+    double trips;
+    int max_nodes = g_opt_level >= 3 ? UNROLL_HOT_MAX_NODES : UNROLL_MAX_NODES;
+    int size;
+    int k;
+
+    if (sp && (sp->known & PROFILE_LOOP) && sp->iterations >= UNROLL_HOT_ITERATIONS) max_nodes = UNROLL_HOT_MAX_NODES;
+
+    if (!is_number_lit(n->forstmt.start, &start) || !is_number_lit(n->forstmt.end, &end)) return n;
+    /* Integral values keep `start + k` exact, as the loop's own increments are. */
+    if (start < -1e9 || start > 1e9 || end < -1e9 || end > 1e9 || start != (double)(long)start) return n;
+    if (runs_user_code(n->forstmt.body) || unroll_blocked(n->forstmt.body, 0)) return n;
+    collect_assigned(n->forstmt.body, &assigned);
+    k = name_table_find(&assigned, n->forstmt.var);
+    name_table_free(&assigned);
+    if (k >= 0) return n;
+
+    trips = end >= start ? (double)(long)(end - start) + 1.0 : 0.0;
+    size = stmt_size(n->forstmt.body);
+    if (trips <= UNROLL_FULL_TRIPS && trips * size <= max_nodes) {
+        for (k = 0; k < (int)trips; k++) {
+            unroll_push_copy(&out, n->forstmt.body, n->forstmt.var, ast_number(start + k));
+        }
+    } else if (trips >= 2 * UNROLL_FACTOR && (2 * UNROLL_FACTOR - 1) * size <= max_nodes) {
+        int groups = (int)(trips / UNROLL_FACTOR);
+        UnrollOut group = {0};
+
+        for (k = 0; k < UNROLL_FACTOR; k++) {
+            ASTNode *value = k == 0 ? ast_ident(n->forstmt.var)
+                                    : ast_binop("+", ast_ident(n->forstmt.var), ast_number(k));
+            unroll_push_copy(&group, n->forstmt.body, n->forstmt.var, value);
+        }
+        unroll_push(&group, ast_var(AST_ASSIGN, n->forstmt.var,
+                                    ast_binop("+", ast_ident(n->forstmt.var), ast_number(UNROLL_FACTOR))));
+        unroll_push(&out, ast_var(AST_ASSIGN, n->forstmt.var, ast_number(start)));
+        unroll_push(&out, ast_while(ast_binop("<=", ast_ident(n->forstmt.var),
+                                              ast_number(start + (double)(groups - 1) * UNROLL_FACTOR)),
+                                    ast_statements(group.stmts, group.count)));
+        for (k = groups * UNROLL_FACTOR; k < (int)trips; k++) {
+            unroll_push_copy(&out, n->forstmt.body, n->forstmt.var, ast_number(start + k));
+        }
+    } else {
+        return n;
+    }
+
+    unroll_push(&out, ast_var(AST_ASSIGN, n->forstmt.var, ast_number(start + trips)));
+    free_ast(n);
+    g_pass_counts.rewrites++;
+    return ast_statements(out.stmts, out.count);
+}
+
+static void unroll_walk(ASTNode **slot) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) unroll_walk(&n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            unroll_walk(&n->funcdef.body);
+            break;
+        case AST_IF:
+            unroll_walk(&n->ifstmt.then_b);
+            unroll_walk(&n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            unroll_walk(&n->whilestmt.body);
+            break;
+        case AST_FOR:
+            /* Inner loops first, so the budget sees what will really be copied. */
+            unroll_walk(&n->forstmt.body);
+            *slot = unroll_for(n);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *unroll_loops(ASTNode *root) {
+    collect_program_names(root);
+    unroll_walk(&root);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Loop vectorization.
+ *
+ * A `for` loop whose body is the single store `c[i] = e` (or `c[i] op= e`),
+ * where `e` combines elements `a[i]` at the loop index, the index itself,
+ * variables and numbers with + - * /, gets a `$vec_map` call (OP_VEC_MAP) in
+ * front of it. The call evaluates the bounds once and runs the whole map if
+ * the loop variable starts at a non-negative integer, every index is in range
+ * and every value it reads is a number; it then returns the value the loop
+ * would leave in its variable. Otherwise it changes nothing and returns -1,
+ * and the loop runs as before. Such a body binds nothing and writes only the
+ * element at the current index, so the bounds, variables and lengths read
+ * cannot change while it runs.
+ *
+ * Reduction loops, whose body is `s = s + a[i]`, `s = s * a[i]`,
+ * `s = s + a[i] * b[i]` or `if (a[i] > s) { s = a[i]; }` (or <), become
+ * `$reduce_sum`, `$reduce_product`, `$dot`, `$reduce_max` or `$reduce_min`
+ * calls returning the accumulator's final value. A `$vec_guard` call
+ * (OP_VEC_GUARD) with the same arguments picks between the call and the
+ * loop, checking the conditions above and that `s` is a number; the bounds
+ * must not read `s`.
+ */
+
+#define VEC_MAX_ARRAYS 4
+#define VEC_MAX_SCALARS 8
+#define VEC_MAX_OPS 32
+#define VEC_MAX_DEPTH 8
+
+typedef struct {
+    const char *var;
+    const char *arrays[VEC_MAX_ARRAYS];
+    int array_count;
+    ASTNode *scalars[VEC_MAX_SCALARS]; /* identifiers and numbers, passed by value */
+    int scalar_count;
+    char prog[VEC_MAX_OPS + 3];         /* array count, scalar count, postfix steps */
+    int len;
+    int depth;
+    int max_depth;
+} VecMap;
+
+static int g_vec_temp_id = 0;
+
+static int vec_step(VecMap *m, char op, int delta) {
+    if (m->len >= VEC_MAX_OPS) return 0;
+    m->prog[2 + m->len++] = op;
+    m->depth += delta;
+    if (m->depth > m->max_depth) m->max_depth = m->depth;
+    return 1;
+}
+
+static int vec_array(VecMap *m, const char *name) {
+    int i;
+
+    for (i = 0; i < m->array_count; i++) {
+        if (strcmp(m->arrays[i], name) == 0) return vec_step(m, (char)('A' + i), 1);
+    }
+    if (m->array_count >= VEC_MAX_ARRAYS) return 0;
+    m->arrays[m->array_count] = name;
+    return vec_step(m, (char)('A' + m->array_count++), 1);
+}
+
+static int vec_scalar(VecMap *m, ASTNode *n) {
+    int i;
+
+    for (i = 0; i < m->scalar_count; i++) {
+        if (same_leaf(m->scalars[i], n)) return vec_step(m, (char)('a' + i), 1);
+    }
+    if (m->scalar_count >= VEC_MAX_SCALARS) return 0;
+    m->scalars[m->scalar_count] = n;
+    return vec_step(m, (char)('a' + m->scalar_count++), 1);
+}
+
+static int is_vec_op(const char *op) {
+    return op && (strcmp(op, "+") == 0 || strcmp(op, "-") == 0 || strcmp(op, "*") == 0 || strcmp(op, "/") == 0);
+}
+
+static int is_var_named(ASTNode *n, const char *name) {
+    return n && n->type == AST_IDENTIFIER && strcmp(n->string, name) == 0;
+}
+
+static int vec_compile(VecMap *m, ASTNode *n) {
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_NUMBER:
+            return vec_scalar(m, n);
+        case AST_IDENTIFIER:
+            if (strcmp(n->string, m->var) == 0) return vec_step(m, 'i', 1);
+            return vec_scalar(m, n);
+        case AST_INDEX:
+            if (!n->index.array || n->index.array->type != AST_IDENTIFIER || is_var_named(n->index.array, m->var) ||
+                !is_var_named(n->index.index, m->var)) {
+                return 0;
+            }
+            return vec_array(m, n->index.array->string);
+        case AST_BINARY_OP:
+            if (!n->binop.right || !is_vec_op(n->binop.op)) return 0;
+            return vec_compile(m, n->binop.left) && vec_compile(m, n->binop.right) && vec_step(m, n->binop.op[0], -1);
+        default:
+            return 0;
+    }
+}
+
+/* Bounds the call can evaluate once: arithmetic over numbers, variables other than the loop's and `len(x)`. */
+static int vec_bound_ok(ASTNode *n, const char *var) {
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_NUMBER:
+            return 1;
+        case AST_IDENTIFIER:
+            return strcmp(n->string, var) != 0;
+        case AST_BINARY_OP:
+            return n->binop.right && is_vec_op(n->binop.op) && vec_bound_ok(n->binop.left, var) &&
+                   vec_bound_ok(n->binop.right, var);
+        case AST_FUNCTION_CALL:
+            return strcmp(n->funccall.name, "len") == 0 && n->funccall.arg_count == 1 &&
+                   name_table_find(&g_user_funcs, "len") < 0 && n->funccall.args[0]->type == AST_IDENTIFIER &&
+                   strcmp(n->funccall.args[0]->string, var) != 0;
+        default:
+            return 0;
+    }
+}
+
+/* The array `x` when `n` is `x[var]`, otherwise NULL. */
+static const char *vec_element(ASTNode *n, const char *var) {
+    if (!n || n->type != AST_INDEX || !n->index.array || n->index.array->type != AST_IDENTIFIER ||
+        is_var_named(n->index.array, var) || !is_var_named(n->index.index, var)) {
+        return NULL;
+    }
+    return n->index.array->string;
+}
+
+static ASTNode *vec_single(ASTNode *n) {
+    if (n && n->type == AST_STATEMENTS) return n->statements.count == 1 ? n->statements.stmts[0] : NULL;
+    return n;
+}
+
+/*
+ * Matches a reduction body, filling the accumulator and the arrays it reads
+ * (`b` only for `$dot`), and returns the call to lower it to or NULL.
+ */
+static const char *vec_reduction(ASTNode *body, const char *var, const char **acc, const char **a, const char **b) {
+    ASTNode *n = vec_single(body);
+    ASTNode *term;
+
+    *b = NULL;
+    if (n && n->type == AST_IF && !n->ifstmt.else_b) {
+        ASTNode *cond = n->ifstmt.cond;
+        ASTNode *set = vec_single(n->ifstmt.then_b);
+        int elem_left;
+
+        if (!cond || cond->type != AST_BINARY_OP || !cond->binop.right || !set || set->type != AST_ASSIGN ||
+            (strcmp(cond->binop.op, ">") != 0 && strcmp(cond->binop.op, "<") != 0)) {
+            return NULL;
+        }
+        elem_left = cond->binop.right->type == AST_IDENTIFIER;
+        *a = vec_element(elem_left ? cond->binop.left : cond->binop.right, var);
+        *acc = set->var.name;
+        if (!*a || !is_var_named(elem_left ? cond->binop.right : cond->binop.left, *acc) ||
+            !vec_element(set->var.value, var) || strcmp(vec_element(set->var.value, var), *a) != 0) {
+            return NULL;
+        }
+        /* a[i] > s and s < a[i] keep the larger element. */
+        return (cond->binop.op[0] == '>') == elem_left ? "$reduce_max" : "$reduce_min";
+    }
+
+    if (!n || n->type != AST_ASSIGN || !n->var.value || n->var.value->type != AST_BINARY_OP ||
+        !n->var.value->binop.right || (strcmp(n->var.value->binop.op, "+") != 0 && strcmp(n->var.value->binop.op, "*") != 0)) {
+        return NULL;
+    }
+    *acc = n->var.name;
+    if (is_var_named(n->var.value->binop.left, *acc)) term = n->var.value->binop.right;
+    else if (is_var_named(n->var.value->binop.right, *acc)) term = n->var.value->binop.left;
+    else return NULL;
+
+    *a = vec_element(term, var);
+    if (*a) return n->var.value->binop.op[0] == '+' ? "$reduce_sum" : "$reduce_product";
+    if (n->var.value->binop.op[0] != '+' || term->type != AST_BINARY_OP || strcmp(term->binop.op, "*") != 0) return NULL;
+    *a = vec_element(term->binop.left, var);
+    *b = vec_element(term->binop.right, var);
+    return *a && *b ? "$dot" : NULL;
+}
+
+/* `name(acc, start, end, a)`, or with `b` after `a`: the reduction and its guard take the same arguments. */
+static ASTNode *vec_reduce_call(const char *name, ASTNode *n, const char *acc, const char *a, const char *b) {
+    int argc = b ? 5 : 4;
+    ASTNode **args = (ASTNode **)xmalloc(sizeof(ASTNode *) * (size_t)argc);
+
+    args[0] = ast_ident(acc);
+    args[1] = ast_clone(n->forstmt.start);
+    args[2] = ast_clone(n->forstmt.end);
+    args[3] = ast_ident(a);
+    if (b) args[4] = ast_ident(b);
+    return ast_call(name, args, argc);
+}
+
+static ASTNode *vectorize_reduction(ASTNode *n) {
+    const char *acc;
+    const char *a;
+    const char *b;
+    const char *call = vec_reduction(n->forstmt.body, n->forstmt.var, &acc, &a, &b);
+    ASTNode **floor_arg;
+    ASTNode *use;
+    ASTNode *last;
+
+    if (!call || strcmp(acc, n->forstmt.var) == 0 || strcmp(acc, a) == 0 || (b && strcmp(acc, b) == 0) ||
+        count_name_uses(n->forstmt.start, acc) || count_name_uses(n->forstmt.end, acc) ||
+        name_table_find(&g_user_funcs, "floor") >= 0) {
+        return n;
+    }
+
+    /* A loop that ran leaves floor(end) + 1 in its variable: the start is a non-negative integer. */
+    floor_arg = (ASTNode **)xmalloc(sizeof(ASTNode *));
+    floor_arg[0] = ast_clone(n->forstmt.end);
+    last = ast_binop("+", ast_call("floor", floor_arg, 1), ast_number(1.0));
+    use = ast_statements((ASTNode **)xmalloc(sizeof(ASTNode *) * 2), 2);
+    use->statements.stmts[0] = ast_var(AST_ASSIGN, acc, vec_reduce_call(call, n, acc, a, b));
+    use->statements.stmts[1] = ast_var(AST_ASSIGN, n->forstmt.var,
+                                       ast_cond(ast_binop("<=", ast_clone(n->forstmt.start), ast_clone(n->forstmt.end)),
+                                                last, ast_clone(n->forstmt.start)));
+    g_pass_counts.rewrites++;
+    return ast_if(vec_reduce_call("$vec_guard", n, acc, a, b), use, n);
+}
+
+static ASTNode *vectorize_for(ASTNode *n) {
+    ASTNode *store = n->forstmt.body;
+    ASTNode **args;
+    ASTNode **pre;
+    ASTNode *use;
+    VecMap m;
+    char temp[32];
+    int argc = 0;
+    int ok;
+    int i;
+
+    if (!vec_bound_ok(n->forstmt.start, n->forstmt.var) || !vec_bound_ok(n->forstmt.end, n->forstmt.var)) return n;
+    store = vec_single(store);
+    if (!store || store->type != AST_INDEX_ASSIGN || !store->indexassign.array ||
+        store->indexassign.array->type != AST_IDENTIFIER || is_var_named(store->indexassign.array, n->forstmt.var) ||
+        !is_var_named(store->indexassign.index, n->forstmt.var)) {
+        return vectorize_reduction(n);
+    }
+
+    memset(&m, 0, sizeof(m));
+    m.var = n->forstmt.var;
+    if (store->indexassign.op) {
+        ok = is_vec_op(store->indexassign.op) && vec_array(&m, store->indexassign.array->string) &&
+             vec_compile(&m, store->indexassign.value) && vec_step(&m, store->indexassign.op[0], -1);
+    } else {
+        ok = vec_compile(&m, store->indexassign.value);
+    }
+    if (!ok || m.max_depth > VEC_MAX_DEPTH) return n;
+    m.prog[0] = (char)('0' + m.array_count);
+    m.prog[1] = (char)('0' + m.scalar_count);
+    m.prog[2 + m.len] = '\0';
+
+    /* $vec_map(start, end, destination, sources..., scalars..., program) */
+    args = (ASTNode **)xmalloc(sizeof(ASTNode *) * (size_t)(4 + m.array_count + m.scalar_count));
+    args[argc++] = ast_clone(n->forstmt.start);
+    args[argc++] = ast_clone(n->forstmt.end);
+    args[argc++] = ast_ident(store->indexassign.array->string);
+    for (i = 0; i < m.array_count; i++) args[argc++] = ast_ident(m.arrays[i]);
+    for (i = 0; i < m.scalar_count; i++) args[argc++] = clone_leaf(m.scalars[i]);
+    args[argc++] = ast_string(m.prog);
+
+    snprintf(temp, sizeof(temp), "$vec%d", ++g_vec_temp_id);
+    use = ast_statements((ASTNode **)xmalloc(sizeof(ASTNode *)), 1);
+    use->statements.stmts[0] = ast_var(AST_ASSIGN, n->forstmt.var, ast_ident(temp));
+    pre = (ASTNode **)xmalloc(sizeof(ASTNode *) * 2);
+    pre[0] = ast_var(AST_ASSIGN, temp, ast_call("$vec_map", args, argc));
+    pre[1] = ast_if(ast_binop("<", ast_ident(temp), ast_number(0.0)), n, use);
+    g_pass_counts.rewrites++;
+    return ast_statements(pre, 2);
+}
+
+static void vec_walk(ASTNode **slot) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) vec_walk(&n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            vec_walk(&n->funcdef.body);
+            break;
+        case AST_IF:
+            vec_walk(&n->ifstmt.then_b);
+            vec_walk(&n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            vec_walk(&n->whilestmt.body);
+            break;
+        case AST_FOR:
+            vec_walk(&n->forstmt.body);
+            *slot = vectorize_for(n);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *vectorize_loops(ASTNode *root) {
+    collect_program_names(root);
+    vec_walk(&root);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Loop-invariant code motion.
+ *
+ * Loops that may run user code are left alone, since that code can rebind
+ * any variable. In the others, maximal subexpressions that read no variable
+ * the loop binds are computed once into a `$licmN` temporary before the
+ * loop. Hoisted code runs even when the loop body would not, so only
+ * expressions that cannot fail or allocate a fresh array are moved. Element
+ * stores and `append` may write through any alias of an array, so a loop
+ * containing either keeps all element reads and `len` calls in place.
+ */
+
+typedef struct {
+    NameTable assigned;
+    int mutates_arrays;
+    ASTNode **pre;
+    int pre_count;
+    int pre_cap;
+} LicmLoop;
+
+static const char *const g_pure_builtin_names[] = {
+    "len", "sin", "cos", "tan", "sqrt", "pow", "mod", "abs", "floor", "ceil",
+    "round", "min", "max", "clamp", "to_number", "lerp"
+};
+
+static int g_licm_temp_id = 0;
+
+static int is_pure_builtin_call(ASTNode *call) {
+    size_t i;
+
+    if (name_table_find(&g_user_funcs, call->funccall.name) >= 0) return 0;
+    for (i = 0; i < sizeof(g_pure_builtin_names) / sizeof(g_pure_builtin_names[0]); i++) {
+        if (strcmp(g_pure_builtin_names[i], call->funccall.name) == 0) return 1;
+    }
+    return 0;
+}
+
+static int mutates_arrays(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_INDEX_ASSIGN:
+            return 1;
+        case AST_FUNCTION_CALL:
+            if (strcmp(n->funccall.name, "append") == 0) return 1;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (mutates_arrays(n->funccall.args[i])) return 1;
+            }
+            return 0;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                if (mutates_arrays(n->statements.stmts[i])) return 1;
+            }
+            return 0;
+        case AST_BINARY_OP:
+            return mutates_arrays(n->binop.left) || mutates_arrays(n->binop.right);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (mutates_arrays(n->arraylit.items[i])) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+            return mutates_arrays(n->index.array) || mutates_arrays(n->index.index);
+        case AST_IF:
+        case AST_COND:
+            return mutates_arrays(n->ifstmt.cond) || mutates_arrays(n->ifstmt.then_b) ||
+                   mutates_arrays(n->ifstmt.else_b);
+        case AST_WHILE:
+            return mutates_arrays(n->whilestmt.cond) || mutates_arrays(n->whilestmt.body);
+        case AST_FOR:
+            return mutates_arrays(n->forstmt.start) || mutates_arrays(n->forstmt.end) ||
+                   mutates_arrays(n->forstmt.body);
+        case AST_LET:
+        case AST_ASSIGN:
+            return mutates_arrays(n->var.value);
+        case AST_PRINT:
+            return mutates_arrays(n->print.expr);
+        case AST_RETURN:
+            return mutates_arrays(n->retstmt.expr);
+        default:
+            return 0;
+    }
+}
+
+static int licm_invariant(ASTNode *n, const LicmLoop *loop) {
+    int i;
+
+    if (!n) return 1;
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+            return 1;
+        case AST_IDENTIFIER:
+            return name_table_find(&loop->assigned, n->string) < 0;
+        case AST_BINARY_OP:
+            if (n->binop.op && strcmp(n->binop.op, "%") == 0) {
+                /* A zero divisor fails, so only a known non-zero one may move. */
+                double d;
+                if (!is_number_lit(n->binop.right, &d) || (int)d == 0) return 0;
+            }
+            return licm_invariant(n->binop.left, loop) && licm_invariant(n->binop.right, loop);
+        case AST_COND:
+            return licm_invariant(n->ifstmt.cond, loop) && licm_invariant(n->ifstmt.then_b, loop) &&
+                   licm_invariant(n->ifstmt.else_b, loop);
+        case AST_INDEX:
+            return !loop->mutates_arrays && licm_invariant(n->index.array, loop) &&
+                   licm_invariant(n->index.index, loop);
+        case AST_FUNCTION_CALL:
+            if (!is_pure_builtin_call(n)) return 0;
+            if (loop->mutates_arrays && strcmp(n->funccall.name, "len") == 0) return 0;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (!licm_invariant(n->funccall.args[i], loop)) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static ASTNode *licm_expr(ASTNode *n, LicmLoop *loop) {
+    int i;
+
+    if (!n) return NULL;
+    if (n->type != AST_NUMBER && n->type != AST_STRING && n->type != AST_IDENTIFIER && licm_invariant(n, loop)) {
+        char temp[32];
+        for (i = 0; i < loop->pre_count; i++) {
+            /* Reuse the temporary of an identical hoisted expression. */
+            ASTNode *prev = loop->pre[i];
+            if (same_pure_expr(prev->var.value, n)) {
+                free_ast(n);
+                g_pass_counts.eliminations++;
+                return ast_ident(prev->var.name);
+            }
+        }
+        if (loop->pre_count >= loop->pre_cap) {
+            loop->pre_cap = loop->pre_cap ? loop->pre_cap * 2 : 4;
+            loop->pre = (ASTNode **)xrealloc(loop->pre, sizeof(ASTNode *) * (size_t)loop->pre_cap);
+        }
+        snprintf(temp, sizeof(temp), "$licm%d", ++g_licm_temp_id);
+        loop->pre[loop->pre_count++] = ast_var(AST_ASSIGN, temp, n);
+        g_pass_counts.rewrites++;
+        return ast_ident(temp);
+    }
+
+    switch (n->type) {
+        case AST_BINARY_OP:
+            n->binop.left = licm_expr(n->binop.left, loop);
+            n->binop.right = licm_expr(n->binop.right, loop);
+            break;
+        case AST_COND:
+            n->ifstmt.cond = licm_expr(n->ifstmt.cond, loop);
+            n->ifstmt.then_b = licm_expr(n->ifstmt.then_b, loop);
+            n->ifstmt.else_b = licm_expr(n->ifstmt.else_b, loop);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) n->funccall.args[i] = licm_expr(n->funccall.args[i], loop);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) n->arraylit.items[i] = licm_expr(n->arraylit.items[i], loop);
+            break;
+        case AST_INDEX:
+            n->index.array = licm_expr(n->index.array, loop);
+            n->index.index = licm_expr(n->index.index, loop);
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+/* Hoists from every expression evaluated inside the loop, including nested loops. */
+static void licm_stmt(ASTNode *n, LicmLoop *loop) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) licm_stmt(n->statements.stmts[i], loop);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            n->var.value = licm_expr(n->var.value, loop);
+            break;
+        case AST_PRINT:
+            n->print.expr = licm_expr(n->print.expr, loop);
+            break;
+        case AST_RETURN:
+            n->retstmt.expr = licm_expr(n->retstmt.expr, loop);
+            break;
+        case AST_INDEX_ASSIGN:
+            n->indexassign.array = licm_expr(n->indexassign.array, loop);
+            n->indexassign.index = licm_expr(n->indexassign.index, loop);
+            n->indexassign.value = licm_expr(n->indexassign.value, loop);
+            break;
+        case AST_IF:
+            n->ifstmt.cond = licm_expr(n->ifstmt.cond, loop);
+            licm_stmt(n->ifstmt.then_b, loop);
+            licm_stmt(n->ifstmt.else_b, loop);
+            break;
+        case AST_WHILE:
+            n->whilestmt.cond = licm_expr(n->whilestmt.cond, loop);
+            licm_stmt(n->whilestmt.body, loop);
+            break;
+        case AST_FOR:
+            n->forstmt.start = licm_expr(n->forstmt.start, loop);
+            n->forstmt.end = licm_expr(n->forstmt.end, loop);
+            licm_stmt(n->forstmt.body, loop);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) n->funccall.args[i] = licm_expr(n->funccall.args[i], loop);
+            break;
+        default:
+            break;
+    }
+}
+
+static void licm_walk(ASTNode **slot) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) licm_walk(&n->statements.stmts[i]);
+            return;
+        case AST_FUNC_DEF:
+            licm_walk(&n->funcdef.body);
+            return;
+        case AST_IF:
+            licm_walk(&n->ifstmt.then_b);
+            licm_walk(&n->ifstmt.else_b);
+            return;
+        case AST_WHILE:
+        case AST_FOR:
+            break;
+        default:
+            return;
+    }
+
+    if (!runs_user_code(n)) {
+        LicmLoop loop;
+        memset(&loop, 0, sizeof(loop));
+        loop.mutates_arrays = mutates_arrays(n);
+        if (n->type == AST_WHILE) {
+            collect_assigned(n->whilestmt.body, &loop.assigned);
+            n->whilestmt.cond = licm_expr(n->whilestmt.cond, &loop);
+            licm_stmt(n->whilestmt.body, &loop);
+        } else {
+            /* `start` runs once anyway; the bound runs every iteration. */
+            name_table_add(&loop.assigned, n->forstmt.var);
+            collect_assigned(n->forstmt.body, &loop.assigned);
+            n->forstmt.end = licm_expr(n->forstmt.end, &loop);
+            licm_stmt(n->forstmt.body, &loop);
+        }
+        name_table_free(&loop.assigned);
+        if (loop.pre_count > 0) {
+            loop.pre = (ASTNode **)xrealloc(loop.pre, sizeof(ASTNode *) * (size_t)(loop.pre_count + 1));
+            loop.pre[loop.pre_count++] = n;
+            *slot = ast_statements(loop.pre, loop.pre_count);
+        } else {
+            free(loop.pre);
+        }
+    }
+    /* Inner loops may still have code invariant to them alone. */
+    licm_walk(n->type == AST_WHILE ? &n->whilestmt.body : &n->forstmt.body);
+}
+
+static ASTNode *hoist_loop_invariants(ASTNode *root) {
+    collect_program_names(root);
+    licm_walk(&root);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Common subexpression elimination.
+ *
+ * Local value numbering over the straight-line runs of each block. A pure
+ * subexpression that a statement evaluates unconditionally, and that the
+ * same or following statements evaluate again before anything could change
+ * its value, is computed once into a `$cseN` temporary placed just before
+ * that statement. A run ends at any statement that calls something other
+ * than a pure builtin, at control flow, and after a store to a name the
+ * expression reads. Element stores end it for expressions that read arrays.
+ */
+
+typedef struct {
+    ASTNode **slots[3];
+    int count;
+    int ends_run;
+} CseStmt;
+
+static int g_cse_temp_id = 0;
+
+/* The right operand of these is only evaluated sometimes. */
+static int is_short_circuit(const char *op) {
+    return op && (strcmp(op, "&&") == 0 || strcmp(op, "||") == 0);
+}
+
+/* True when evaluating `n` has no effect beyond producing its value. */
+static int cse_pure(ASTNode *n) {
+    int i;
+
+    if (!n) return 1;
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_IDENTIFIER:
+            return 1;
+        case AST_BINARY_OP:
+            return cse_pure(n->binop.left) && cse_pure(n->binop.right);
+        case AST_COND:
+            return cse_pure(n->ifstmt.cond) && cse_pure(n->ifstmt.then_b) && cse_pure(n->ifstmt.else_b);
+        case AST_INDEX:
+            return cse_pure(n->index.array) && cse_pure(n->index.index);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (!cse_pure(n->arraylit.items[i])) return 0;
+            }
+            return 1;
+        case AST_FUNCTION_CALL:
+            if (!is_pure_builtin_call(n)) return 0;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (!cse_pure(n->funccall.args[i])) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Dispatch cost of evaluating `n`, or -1 when it may not be shared. */
+static int cse_cost(ASTNode *n) {
+    int cost;
+    int sub;
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_IDENTIFIER:
+            return 1;
+        case AST_BINARY_OP:
+            cost = cse_cost(n->binop.left);
+            sub = cse_cost(n->binop.right);
+            return (cost < 0 || sub < 0) ? -1 : cost + sub + 1;
+        case AST_COND:
+            cost = cse_cost(n->ifstmt.cond);
+            sub = cse_cost(n->ifstmt.then_b);
+            if (cost < 0 || sub < 0) return -1;
+            cost += sub;
+            sub = cse_cost(n->ifstmt.else_b);
+            return sub < 0 ? -1 : cost + sub + 2;
+        case AST_INDEX:
+            cost = cse_cost(n->index.array);
+            sub = cse_cost(n->index.index);
+            return (cost < 0 || sub < 0) ? -1 : cost + sub + 2;
+        case AST_FUNCTION_CALL:
+            /* Callers have checked purity; `len` results go stale with the array. */
+            cost = 2;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                sub = cse_cost(n->funccall.args[i]);
+                if (sub < 0) return -1;
+                cost += sub;
+            }
+            return cost;
+        default:
+            /* A shared array literal would alias what used to be fresh arrays. */
+            return -1;
+    }
+}
+
+static int reads_arrays(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_BINARY_OP:
+            return reads_arrays(n->binop.left) || reads_arrays(n->binop.right);
+        case AST_COND:
+            return reads_arrays(n->ifstmt.cond) || reads_arrays(n->ifstmt.then_b) || reads_arrays(n->ifstmt.else_b);
+        case AST_INDEX:
+            return 1;
+        case AST_FUNCTION_CALL:
+            if (strcmp(n->funccall.name, "len") == 0) return 1;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (reads_arrays(n->funccall.args[i])) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/* The expressions a statement always evaluates, in slots that may be rewritten. */
+static int cse_stmt_slots(ASTNode *n, CseStmt *out) {
+    int i;
+
+    out->count = 0;
+    out->ends_run = 0;
+    switch (n->type) {
+        case AST_LET:
+        case AST_ASSIGN:
+            out->slots[out->count++] = &n->var.value;
+            break;
+        case AST_PRINT:
+            out->slots[out->count++] = &n->print.expr;
+            break;
+        case AST_INDEX_ASSIGN:
+            out->slots[out->count++] = &n->indexassign.array;
+            out->slots[out->count++] = &n->indexassign.index;
+            out->slots[out->count++] = &n->indexassign.value;
+            break;
+        case AST_RETURN:
+            out->slots[out->count++] = &n->retstmt.expr;
+            out->ends_run = 1;
+            break;
+        case AST_IF:
+            out->slots[out->count++] = &n->ifstmt.cond;
+            out->ends_run = 1;
+            break;
+        case AST_FOR:
+            /* The bound is evaluated on every iteration. */
+            out->slots[out->count++] = &n->forstmt.start;
+            out->ends_run = 1;
+            break;
+        default:
+            return 0;
+    }
+    for (i = 0; i < out->count; i++) {
+        if (!cse_pure(*out->slots[i])) return 0;
+    }
+    return 1;
+}
+
+static int cse_kills(ASTNode *stmt, ASTNode *e) {
+    switch (stmt->type) {
+        case AST_LET:
+        case AST_ASSIGN:
+            return count_name_uses(e, stmt->var.name) > 0;
+        case AST_INDEX_ASSIGN:
+            return reads_arrays(e);
+        default:
+            return 0;
+    }
+}
+
+/* Occurrences of `e` that are evaluated whenever `n` is. */
+static int cse_count(ASTNode *n, ASTNode *e) {
+    int count = 0;
+    int i;
+
+    if (!n) return 0;
+    if (same_pure_expr(n, e)) return 1;
+    switch (n->type) {
+        case AST_BINARY_OP:
+            count = cse_count(n->binop.left, e);
+            if (!is_short_circuit(n->binop.op)) count += cse_count(n->binop.right, e);
+            return count;
+        case AST_COND:
+            return cse_count(n->ifstmt.cond, e);
+        case AST_INDEX:
+            return cse_count(n->index.array, e) + cse_count(n->index.index, e);
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) count += cse_count(n->funccall.args[i], e);
+            return count;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) count += cse_count(n->arraylit.items[i], e);
+            return count;
+        default:
+            return 0;
+    }
+}
+
+static ASTNode *cse_replace(ASTNode *n, ASTNode *e, const char *temp) {
+    int i;
+
+    if (!n) return NULL;
+    if (same_pure_expr(n, e)) {
+        free_ast(n);
+        return ast_ident(temp);
+    }
+    switch (n->type) {
+        case AST_BINARY_OP:
+            n->binop.left = cse_replace(n->binop.left, e, temp);
+            if (!is_short_circuit(n->binop.op)) n->binop.right = cse_replace(n->binop.right, e, temp);
+            break;
+        case AST_COND:
+            n->ifstmt.cond = cse_replace(n->ifstmt.cond, e, temp);
+            break;
+        case AST_INDEX:
+            n->index.array = cse_replace(n->index.array, e, temp);
+            n->index.index = cse_replace(n->index.index, e, temp);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) n->funccall.args[i] = cse_replace(n->funccall.args[i], e, temp);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) n->arraylit.items[i] = cse_replace(n->arraylit.items[i], e, temp);
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+/* Counts uses of `e` from statement `from` onwards and reports where its run ends. */
+static int cse_uses(ASTNode *block, int from, ASTNode *e, int *last) {
+    int uses = 0;
+    int i;
+    int j;
+
+    *last = from;
+    for (i = from; i < block->statements.count; i++) {
+        ASTNode *stmt = block->statements.stmts[i];
+        CseStmt info;
+        if (!cse_stmt_slots(stmt, &info)) break;
+        for (j = 0; j < info.count; j++) uses += cse_count(*info.slots[j], e);
+        *last = i;
+        if (info.ends_run || cse_kills(stmt, e)) break;
+    }
+    return uses;
+}
+
+/* Shares the first profitable candidate found in `n`; returns 1 if it did. */
+static int cse_try(ASTNode *block, int at, ASTNode *n) {
+    int cost;
+    int i;
+
+    if (!n) return 0;
+    cost = cse_cost(n);
+    if (cost > 1) {
+        int last;
+        int uses = cse_uses(block, at, n, &last);
+        /* `k * cost` before; after, one evaluation, a store and `k` loads. */
+        if (uses > 1 && (uses - 1) * cost > uses + 1) {
+            ASTNode **stmts;
+            ASTNode *value = ast_clone(n);
+            char temp[32];
+            snprintf(temp, sizeof(temp), "$cse%d", ++g_cse_temp_id);
+            g_pass_counts.eliminations += uses - 1;
+            for (i = at; i <= last; i++) {
+                CseStmt info;
+                int j;
+                cse_stmt_slots(block->statements.stmts[i], &info);
+                for (j = 0; j < info.count; j++) *info.slots[j] = cse_replace(*info.slots[j], value, temp);
+            }
+            stmts = (ASTNode **)xrealloc(block->statements.stmts,
+                                         sizeof(ASTNode *) * (size_t)(block->statements.count + 1));
+            memmove(stmts + at + 1, stmts + at, sizeof(ASTNode *) * (size_t)(block->statements.count - at));
+            stmts[at] = ast_var(AST_ASSIGN, temp, value);
+            block->statements.stmts = stmts;
+            block->statements.count++;
+            return 1;
+        }
+    }
+
+    switch (n->type) {
+        case AST_BINARY_OP:
+            if (cse_try(block, at, n->binop.left)) return 1;
+            return !is_short_circuit(n->binop.op) && cse_try(block, at, n->binop.right);
+        case AST_COND:
+            return cse_try(block, at, n->ifstmt.cond);
+        case AST_INDEX:
+            return cse_try(block, at, n->index.array) || cse_try(block, at, n->index.index);
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (cse_try(block, at, n->funccall.args[i])) return 1;
+            }
+            return 0;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (cse_try(block, at, n->arraylit.items[i])) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+static void cse_walk(ASTNode *n) {
+    int i;
+    int j;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                CseStmt info;
+                int shared = 0;
+                if (cse_stmt_slots(n->statements.stmts[i], &info)) {
+                    for (j = 0; j < info.count && !shared; j++) shared = cse_try(n, i, *info.slots[j]);
+                }
+                if (shared) {
+                    /* Revisit the new temporary's definition, then this statement. */
+                    i--;
+                    continue;
+                }
+                cse_walk(n->statements.stmts[i]);
+            }
+            break;
+        case AST_FUNC_DEF:
+            cse_walk(n->funcdef.body);
+            break;
+        case AST_IF:
+            cse_walk(n->ifstmt.then_b);
+            cse_walk(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            cse_walk(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            cse_walk(n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *eliminate_common_subexpressions(ASTNode *root) {
+    collect_program_names(root);
+    cse_walk(root);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Bounds-check elimination.
+ *
+ * In a `for` loop whose body runs no user code and never rebinds the loop
+ * variable, an access `a[i + c]` to an array variable the body does not
+ * rebind stays within one range of indices. If the bound also cannot change
+ * while the loop runs, one `$in_bounds` guard per access, checked after the
+ * start value is stored, proves every iteration's index valid: the variable
+ * only counts up and arrays never shrink. The loop is then versioned, with
+ * the copy taken under the guard using unchecked element opcodes.
+ */
+
+#define BCE_MAX_NODES 256
+
+typedef struct {
+    const char *array;
+    double offset;
+} BceAccess;
+
+typedef struct {
+    const char *var;
+    NameTable assigned;
+    BceAccess *items;
+    int count;
+    int cap;
+    int grows;
+    int writes;
+} BceLoop;
+
+/* Matches an index of the form `var`, `var + c` or `var - c`. */
+static int bce_offset(ASTNode *idx, const char *var, double *out) {
+    double c;
+
+    if (idx->type == AST_IDENTIFIER && strcmp(idx->string, var) == 0) {
+        *out = 0.0;
+        return 1;
+    }
+    if (idx->type == AST_BINARY_OP && idx->binop.left && idx->binop.left->type == AST_IDENTIFIER &&
+        strcmp(idx->binop.left->string, var) == 0 && is_number_lit(idx->binop.right, &c) &&
+        c == (double)(long)c && c > -1e9 && c < 1e9) {
+        if (strcmp(idx->binop.op, "+") == 0) {
+            *out = c;
+            return 1;
+        }
+        if (strcmp(idx->binop.op, "-") == 0) {
+            *out = -c;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int bce_guarded(const BceLoop *loop, ASTNode *array, ASTNode *idx, double *offset) {
+    return array && idx && array->type == AST_IDENTIFIER && name_table_find(&loop->assigned, array->string) < 0 &&
+           bce_offset(idx, loop->var, offset);
+}
+
+static void bce_record(BceLoop *loop, const char *array, double offset) {
+    int i;
+
+    for (i = 0; i < loop->count; i++) {
+        if (strcmp(loop->items[i].array, array) == 0 && loop->items[i].offset == offset) return;
+    }
+    if (loop->count >= loop->cap) {
+        loop->cap = loop->cap ? loop->cap * 2 : 4;
+        loop->items = (BceAccess *)xrealloc(loop->items, sizeof(BceAccess) * (size_t)loop->cap);
+    }
+    loop->items[loop->count].array = array;
+    loop->items[loop->count].offset = offset;
+    loop->count++;
+}
+
+/* Records guardable accesses in the body and marks them unchecked when `mark` is set. */
+static void bce_scan(ASTNode *n, BceLoop *loop, int mark) {
+    double offset;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_INDEX:
+            if (bce_guarded(loop, n->index.array, n->index.index, &offset)) {
+                if (mark) {
+                    n->index.unchecked = 1;
+                    g_pass_counts.eliminations++;
+                } else {
+                    bce_record(loop, n->index.array->string, offset);
+                }
+            }
+            bce_scan(n->index.array, loop, mark);
+            bce_scan(n->index.index, loop, mark);
+            break;
+        case AST_INDEX_ASSIGN:
+            loop->writes = 1;
+            if (bce_guarded(loop, n->indexassign.array, n->indexassign.index, &offset)) {
+                if (mark) {
+                    n->indexassign.unchecked = 1;
+                    g_pass_counts.eliminations++;
+                } else {
+                    bce_record(loop, n->indexassign.array->string, offset);
+                }
+            } else {
+                loop->grows = 1;
+            }
+            bce_scan(n->indexassign.array, loop, mark);
+            bce_scan(n->indexassign.index, loop, mark);
+            bce_scan(n->indexassign.value, loop, mark);
+            break;
+        case AST_FUNCTION_CALL:
+            if (strcmp(n->funccall.name, "append") == 0) loop->grows = 1;
+            for (i = 0; i < n->funccall.arg_count; i++) bce_scan(n->funccall.args[i], loop, mark);
+            break;
+        case AST_BINARY_OP:
+            bce_scan(n->binop.left, loop, mark);
+            bce_scan(n->binop.right, loop, mark);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) bce_scan(n->arraylit.items[i], loop, mark);
+            break;
+        case AST_IF:
+        case AST_COND:
+            bce_scan(n->ifstmt.cond, loop, mark);
+            bce_scan(n->ifstmt.then_b, loop, mark);
+            bce_scan(n->ifstmt.else_b, loop, mark);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) bce_scan(n->statements.stmts[i], loop, mark);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            bce_scan(n->var.value, loop, mark);
+            break;
+        case AST_PRINT:
+            bce_scan(n->print.expr, loop, mark);
+            break;
+        case AST_RETURN:
+            bce_scan(n->retstmt.expr, loop, mark);
+            break;
+        case AST_WHILE:
+            bce_scan(n->whilestmt.cond, loop, mark);
+            bce_scan(n->whilestmt.body, loop, mark);
+            break;
+        case AST_FOR:
+            bce_scan(n->forstmt.start, loop, mark);
+            bce_scan(n->forstmt.end, loop, mark);
+            bce_scan(n->forstmt.body, loop, mark);
+            break;
+        default:
+            break;
+    }
+}
+
+/* True if the loop bound evaluates the same on every iteration. */
+static int bce_invariant(ASTNode *n, const BceLoop *loop) {
+    int i;
+
+    if (!n) return 1;
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+            return 1;
+        case AST_IDENTIFIER:
+            return strcmp(n->string, loop->var) != 0 && name_table_find(&loop->assigned, n->string) < 0;
+        case AST_BINARY_OP:
+            return bce_invariant(n->binop.left, loop) && bce_invariant(n->binop.right, loop);
+        case AST_COND:
+            return bce_invariant(n->ifstmt.cond, loop) && bce_invariant(n->ifstmt.then_b, loop) &&
+                   bce_invariant(n->ifstmt.else_b, loop);
+        case AST_INDEX:
+            return !loop->writes && bce_invariant(n->index.array, loop) && bce_invariant(n->index.index, loop);
+        case AST_FUNCTION_CALL:
+            if (!is_pure_builtin_call(n)) return 0;
+            if (loop->grows && strcmp(n->funccall.name, "len") == 0) return 0;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (!bce_invariant(n->funccall.args[i], loop)) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int stmt_has_loop(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_WHILE:
+        case AST_FOR:
+            return 1;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                if (stmt_has_loop(n->statements.stmts[i])) return 1;
+            }
+            return 0;
+        case AST_IF:
+            return stmt_has_loop(n->ifstmt.then_b) || stmt_has_loop(n->ifstmt.else_b);
+        default:
+            return 0;
+    }
+}
+
+static ASTNode *bce_shift(ASTNode *e, double offset) {
+    if (offset == 0.0) return e;
+    return optimize_node(ast_binop("+", e, ast_number(offset)));
+}
+
+static ASTNode *bce_for(ASTNode *n) {
+    BceLoop loop;
+    ASTNode *guard = NULL;
+    ASTNode *fast;
+    ASTNode **stmts;
+    int i;
+
+    if (runs_user_code(n->forstmt.body) || unroll_blocked(n->forstmt.body, 1)) return n;
+    if (stmt_size(n->forstmt.body) > BCE_MAX_NODES) return n;
+
+    memset(&loop, 0, sizeof(loop));
+    loop.var = n->forstmt.var;
+    collect_assigned(n->forstmt.body, &loop.assigned);
+    if (name_table_find(&loop.assigned, loop.var) < 0) bce_scan(n->forstmt.body, &loop, 0);
+    if (loop.count == 0 || !bce_invariant(n->forstmt.end, &loop)) {
+        name_table_free(&loop.assigned);
+        free(loop.items);
+        return n;
+    }
+
+    for (i = loop.count - 1; i >= 0; i--) {
+        ASTNode **args = (ASTNode **)xmalloc(sizeof(ASTNode *) * 3);
+        ASTNode *check;
+        args[0] = ast_ident(loop.items[i].array);
+        args[1] = bce_shift(ast_ident(loop.var), loop.items[i].offset);
+        args[2] = bce_shift(ast_clone(n->forstmt.end), loop.items[i].offset);
+        check = ast_call("$in_bounds", args, 3);
+        guard = guard ? ast_binop("&&", check, guard) : check;
+    }
+
+    fast = ast_clone(n);
+    bce_scan(fast->forstmt.body, &loop, 1);
+    name_table_free(&loop.assigned);
+    free(loop.items);
+
+    /* Store the start once so the guard sees it; both versions resume from there. */
+    stmts = (ASTNode **)xmalloc(sizeof(ASTNode *) * 2);
+    stmts[0] = ast_var(AST_ASSIGN, n->forstmt.var, n->forstmt.start);
+    n->forstmt.start = ast_ident(n->forstmt.var);
+    free_ast(fast->forstmt.start);
+    fast->forstmt.start = ast_ident(fast->forstmt.var);
+    stmts[1] = ast_if(guard, fast, n);
+    return ast_statements(stmts, 2);
+}
+
+static void bce_walk(ASTNode **slot) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) bce_walk(&n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            bce_walk(&n->funcdef.body);
+            break;
+        case AST_IF:
+            bce_walk(&n->ifstmt.then_b);
+            bce_walk(&n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            bce_walk(&n->whilestmt.body);
+            break;
+        case AST_FOR:
+            /* Versioning the outer loop copies inner ones, so it is left alone. */
+            bce_walk(&n->forstmt.body);
+            if (!stmt_has_loop(n->forstmt.body)) *slot = bce_for(n);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *eliminate_bounds_checks(ASTNode *root) {
+    collect_program_names(root);
+    bce_walk(&root);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Type inference.
+ *
+ * Every variable with a given name is treated as one, so a name's type is
+ * the union of everything stored under it anywhere in the program: values
+ * assigned to it, arguments bound to it as a parameter, and the 0 read
+ * before any store. A function's result type is the union of its returns
+ * and the implicit 0. Types start empty and grow to a fixpoint. Binary ops
+ * with an operand that can never be a string are then marked numeric, so
+ * codegen can skip the string checks of `+`, `==` and `!=`. Native modules
+ * are opaque, so a program that imports one is left untyped.
+ */
+
+#define TYPE_NUMBER 1
+#define TYPE_STRING 2
+#define TYPE_ARRAY 4
+#define TYPE_ANY (TYPE_NUMBER | TYPE_STRING | TYPE_ARRAY)
+
+typedef struct {
+    const char **names;
+    int *types;
+    int count;
+    int cap;
+} TypeTable;
+
+static TypeTable g_var_types = {0};
+static TypeTable g_return_types = {0};
+static int g_types_changed = 0;
+
+static const char *const g_number_builtins[] = {
+    "print", "sleep", "noop", "len", "sin", "cos", "tan", "sqrt", "pow", "mod", "abs",
+    "floor", "ceil", "round", "min", "max", "clamp", "to_number", "lerp", "$in_bounds", "$vec_map",
+    "$vec_guard", "$reduce_sum", "$reduce_product", "$reduce_min", "$reduce_max", "$dot"
+};
+
+static int type_find(const TypeTable *t, const char *name) {
+    int i;
+
+    for (i = 0; i < t->count; i++) {
+        if (strcmp(t->names[i], name) == 0) return t->types[i];
+    }
+    return 0;
+}
+
+static void type_join(TypeTable *t, const char *name, int type) {
+    int i;
+
+    for (i = 0; i < t->count; i++) {
+        if (strcmp(t->names[i], name) == 0) {
+            if ((t->types[i] | type) != t->types[i]) g_types_changed = 1;
+            t->types[i] |= type;
+            return;
+        }
+    }
+    if (t->count >= t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 32;
+        t->names = (const char **)xrealloc(t->names, sizeof(char *) * (size_t)t->cap);
+        t->types = (int *)xrealloc(t->types, sizeof(int) * (size_t)t->cap);
+    }
+    t->names[t->count] = name;
+    t->types[t->count] = type;
+    t->count++;
+    g_types_changed = 1;
+}
+
+static void type_table_free(TypeTable *t) {
+    free(t->names);
+    free(t->types);
+    memset(t, 0, sizeof(*t));
+}
+
+static int type_of_call(ASTNode *call) {
+    size_t i;
+
+    if (name_table_find(&g_user_funcs, call->funccall.name) >= 0) {
+        return TYPE_NUMBER | type_find(&g_return_types, call->funccall.name);
+    }
+    for (i = 0; i < sizeof(g_number_builtins) / sizeof(g_number_builtins[0]); i++) {
+        if (strcmp(g_number_builtins[i], call->funccall.name) == 0) return TYPE_NUMBER;
+    }
+    if (strcmp(call->funccall.name, "input") == 0) return TYPE_STRING;
+    if (strcmp(call->funccall.name, "slice") == 0 || strcmp(call->funccall.name, "split") == 0) {
+        return TYPE_NUMBER | TYPE_ARRAY;
+    }
+    return TYPE_ANY;
+}
+
+static int type_of(ASTNode *n) {
+    if (!n) return TYPE_NUMBER;
+    switch (n->type) {
+        case AST_NUMBER:
+            return TYPE_NUMBER;
+        case AST_STRING:
+            return TYPE_STRING;
+        case AST_ARRAY:
+            return TYPE_ARRAY;
+        case AST_IDENTIFIER:
+            return TYPE_NUMBER | type_find(&g_var_types, n->string);
+        case AST_BINARY_OP:
+            if (strcmp(n->binop.op, "+") == 0) {
+                /* Only two strings concatenate; any other pair adds as numbers. */
+                int l = type_of(n->binop.left);
+                int r = type_of(n->binop.right);
+                return ((l & r) & TYPE_STRING) ? TYPE_NUMBER | TYPE_STRING : TYPE_NUMBER;
+            }
+            return TYPE_NUMBER;
+        case AST_COND:
+            return type_of(n->ifstmt.then_b) | type_of(n->ifstmt.else_b);
+        case AST_FUNCTION_CALL:
+            return type_of_call(n);
+        default:
+            return TYPE_ANY;
+    }
+}
+
+/* Joins every store and parameter binding in the subtree; `fn` receives its returns. */
+static void type_walk(ASTNode *n, const char *fn) {
+    int i;
+    int j;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_BINARY_OP:
+            type_walk(n->binop.left, fn);
+            type_walk(n->binop.right, fn);
+            break;
+        case AST_COND:
+        case AST_IF:
+            type_walk(n->ifstmt.cond, fn);
+            type_walk(n->ifstmt.then_b, fn);
+            type_walk(n->ifstmt.else_b, fn);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) type_walk(n->arraylit.items[i], fn);
+            break;
+        case AST_INDEX:
+            type_walk(n->index.array, fn);
+            type_walk(n->index.index, fn);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) type_walk(n->funccall.args[i], fn);
+            for (i = 0; i < g_ctfe_funcs.count; i++) {
+                ASTNode *def = g_ctfe_funcs.data[i];
+                if (strcmp(def->funcdef.name, n->funccall.name) != 0) continue;
+                for (j = 0; j < def->funcdef.param_count; j++) {
+                    type_join(&g_var_types, def->funcdef.params[j],
+                              j < n->funccall.arg_count ? type_of(n->funccall.args[j]) : TYPE_NUMBER);
+                }
+            }
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) type_walk(n->statements.stmts[i], fn);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            type_walk(n->var.value, fn);
+            type_join(&g_var_types, n->var.name, type_of(n->var.value));
+            break;
+        case AST_PRINT:
+            type_walk(n->print.expr, fn);
+            break;
+        case AST_RETURN:
+            type_walk(n->retstmt.expr, fn);
+            if (fn) type_join(&g_return_types, fn, type_of(n->retstmt.expr));
+            break;
+        case AST_INDEX_ASSIGN:
+            type_walk(n->indexassign.array, fn);
+            type_walk(n->indexassign.index, fn);
+            type_walk(n->indexassign.value, fn);
+            break;
+        case AST_WHILE:
+            type_walk(n->whilestmt.cond, fn);
+            type_walk(n->whilestmt.body, fn);
+            break;
+        case AST_FOR:
+            type_walk(n->forstmt.start, fn);
+            type_walk(n->forstmt.end, fn);
+            type_join(&g_var_types, n->forstmt.var, type_of(n->forstmt.start) | TYPE_NUMBER);
+            type_walk(n->forstmt.body, fn);
+            break;
+        case AST_FUNC_DEF:
+            type_walk(n->funcdef.body, n->funcdef.name);
+            break;
+        default:
+            break;
+    }
+}
+
+static void type_mark(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_BINARY_OP:
+            type_mark(n->binop.left);
+            type_mark(n->binop.right);
+            if (n->binop.right && (strcmp(n->binop.op, "+") == 0 || strcmp(n->binop.op, "==") == 0 ||
+                                   strcmp(n->binop.op, "!=") == 0)) {
+                n->binop.numeric = !(type_of(n->binop.left) & TYPE_STRING) || !(type_of(n->binop.right) & TYPE_STRING);
+                g_pass_counts.rewrites += n->binop.numeric;
+            }
+            break;
+        case AST_COND:
+        case AST_IF:
+            type_mark(n->ifstmt.cond);
+            type_mark(n->ifstmt.then_b);
+            type_mark(n->ifstmt.else_b);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) type_mark(n->arraylit.items[i]);
+            break;
+        case AST_INDEX:
+            type_mark(n->index.array);
+            type_mark(n->index.index);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) type_mark(n->funccall.args[i]);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) type_mark(n->statements.stmts[i]);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            type_mark(n->var.value);
+            break;
+        case AST_PRINT:
+            type_mark(n->print.expr);
+            break;
+        case AST_RETURN:
+            type_mark(n->retstmt.expr);
+            break;
+        case AST_INDEX_ASSIGN:
+            type_mark(n->indexassign.array);
+            type_mark(n->indexassign.index);
+            type_mark(n->indexassign.value);
+            break;
+        case AST_WHILE:
+            type_mark(n->whilestmt.cond);
+            type_mark(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            type_mark(n->forstmt.start);
+            type_mark(n->forstmt.end);
+            type_mark(n->forstmt.body);
+            break;
+        case AST_FUNC_DEF:
+            type_mark(n->funcdef.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static int has_native_import(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_IMPORT_C:
+            return 1;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                if (has_native_import(n->statements.stmts[i])) return 1;
+            }
+            return 0;
+        case AST_FUNC_DEF:
+            return has_native_import(n->funcdef.body);
+        case AST_IF:
+            return has_native_import(n->ifstmt.then_b) || has_native_import(n->ifstmt.else_b);
+        case AST_WHILE:
+            return has_native_import(n->whilestmt.body);
+        case AST_FOR:
+            return has_native_import(n->forstmt.body);
+        default:
+            return 0;
+    }
+}
+
+static ASTNode *infer_types(ASTNode *root) {
+    if (has_native_import(root)) return root;
+    collect_program_names(root);
+    ctfe_collect(root);
+    do {
+        g_types_changed = 0;
+        type_walk(root, NULL);
+    } while (g_types_changed);
+    type_mark(root);
+    type_table_free(&g_var_types);
+    type_table_free(&g_return_types);
+    free(g_ctfe_funcs.data);
+    memset(&g_ctfe_funcs, 0, sizeof(g_ctfe_funcs));
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Escape analysis.
+ *
+ * Inside a function, an array literal or builtin `slice` result that only the
+ * frame creating it can reach is marked `frame`, and codegen allocates it in
+ * the VM's per-frame bump region, which the call's OP_RET releases. A value
+ * stays in the frame while it is only indexed, written through, appended to,
+ * measured with `len`, sliced or printed: directly, or through a local
+ * variable used only that way. A variable is local when top-level code never
+ * binds it, since a store inside a function then always lands in its own
+ * frame and no other frame can load it. Returning the value, passing it to
+ * any other call, storing it in an array or copying it to another variable
+ * lets it escape.
+ */
+
+#define ESC_ESCAPES 0   /* the value may outlive the frame */
+#define ESC_CONTAINED 1 /* the value is consumed where it is computed */
+#define ESC_STORED 2    /* the value is bound to the variable being assigned */
+
+static NameTable g_global_names = {0};
+static NameTable g_escaping_locals = {0};
+
+static int is_builtin_call(ASTNode *call, const char *name, int argc) {
+    return call->funccall.arg_count == argc && strcmp(call->funccall.name, name) == 0 &&
+           name_table_find(&g_user_funcs, name) < 0;
+}
+
+static int escape_arg_context(ASTNode *call, int i) {
+    if (is_builtin_call(call, "len", 1) || is_builtin_call(call, "slice", 3) || is_builtin_call(call, "$in_bounds", 3)) {
+        return ESC_CONTAINED;
+    }
+    if (is_builtin_call(call, "append", 2) && i == 0) return ESC_CONTAINED;
+    if (strcmp(call->funccall.name, "$vec_map") == 0 || strcmp(call->funccall.name, "$vec_guard") == 0 ||
+        strncmp(call->funccall.name, "$reduce_", 8) == 0 || strcmp(call->funccall.name, "$dot") == 0) {
+        return ESC_CONTAINED;
+    }
+    return ESC_ESCAPES;
+}
+
+static int stays_in_frame(int ctx, const char *target) {
+    if (ctx == ESC_CONTAINED) return 1;
+    return ctx == ESC_STORED && name_table_find(&g_global_names, target) < 0 &&
+           name_table_find(&g_escaping_locals, target) < 0;
+}
+
+/* The first pass (mark == 0) collects escaping locals, the second flags allocations that stay in the frame. */
+static void escape_walk(ASTNode *n, int ctx, const char *target, int mark) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            if (!mark && ctx != ESC_CONTAINED) name_table_add(&g_escaping_locals, n->string);
+            break;
+        case AST_ARRAY:
+            if (mark) {
+                n->arraylit.frame = stays_in_frame(ctx, target);
+                g_pass_counts.rewrites += n->arraylit.frame;
+            }
+            for (i = 0; i < n->arraylit.count; i++) escape_walk(n->arraylit.items[i], ESC_ESCAPES, NULL, mark);
+            break;
+        case AST_FUNCTION_CALL:
+            if (mark) {
+                n->funccall.frame = is_builtin_call(n, "slice", 3) && stays_in_frame(ctx, target);
+                g_pass_counts.rewrites += n->funccall.frame;
+            }
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                escape_walk(n->funccall.args[i], escape_arg_context(n, i), NULL, mark);
+            }
+            break;
+        case AST_BINARY_OP:
+            escape_walk(n->binop.left, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->binop.right, ESC_CONTAINED, NULL, mark);
+            break;
+        case AST_COND:
+            escape_walk(n->ifstmt.cond, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->ifstmt.then_b, ctx, target, mark);
+            escape_walk(n->ifstmt.else_b, ctx, target, mark);
+            break;
+        case AST_INDEX:
+            escape_walk(n->index.array, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->index.index, ESC_CONTAINED, NULL, mark);
+            break;
+        case AST_INDEX_ASSIGN:
+            escape_walk(n->indexassign.array, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->indexassign.index, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->indexassign.value, ESC_ESCAPES, NULL, mark);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            escape_walk(n->var.value, ESC_STORED, n->var.name, mark);
+            break;
+        case AST_PRINT:
+            escape_walk(n->print.expr, ESC_CONTAINED, NULL, mark);
+            break;
+        case AST_RETURN:
+            escape_walk(n->retstmt.expr, ESC_ESCAPES, NULL, mark);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) escape_walk(n->statements.stmts[i], ESC_CONTAINED, NULL, mark);
+            break;
+        case AST_IF:
+            escape_walk(n->ifstmt.cond, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->ifstmt.then_b, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->ifstmt.else_b, ESC_CONTAINED, NULL, mark);
+            break;
+        case AST_WHILE:
+            escape_walk(n->whilestmt.cond, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->whilestmt.body, ESC_CONTAINED, NULL, mark);
+            break;
+        case AST_FOR:
+            /* The start value is stored into the loop variable, which outlives the loop. */
+            escape_walk(n->forstmt.start, ESC_STORED, n->forstmt.var, mark);
+            escape_walk(n->forstmt.end, ESC_CONTAINED, NULL, mark);
+            escape_walk(n->forstmt.body, ESC_CONTAINED, NULL, mark);
+            break;
+        default:
+            /* Nested definitions are analysed as functions of their own. */
+            break;
+    }
+}
+
+static void escape_functions(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_FUNC_DEF:
+            escape_walk(n->funcdef.body, ESC_CONTAINED, NULL, 0);
+            escape_walk(n->funcdef.body, ESC_CONTAINED, NULL, 1);
+            name_table_free(&g_escaping_locals);
+            escape_functions(n->funcdef.body);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) escape_functions(n->statements.stmts[i]);
+            break;
+        case AST_IF:
+            escape_functions(n->ifstmt.then_b);
+            escape_functions(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            escape_functions(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            escape_functions(n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *mark_frame_allocations(ASTNode *root) {
+    collect_program_names(root);
+    collect_assigned(root, &g_global_names);
+    escape_functions(root);
+    name_table_free(&g_global_names);
+    name_table_free(&g_assign_counts);
+    name_table_free(&g_user_funcs);
+    return root;
+}
+
+/*
+ * Tree shaking.
+ *
+ * A function is reachable from a call in top-level code or in the body of a
+ * reachable function; every other definition is dropped, so an imported
+ * library costs only the routines the program calls. Reads inside dropped
+ * bodies go with them, which leaves the library's unused globals to the
+ * unread-store removal in eliminate_dead_stores. Codegen interns symbols and
+ * constants as it emits, so theirs disappear as well.
+ */
+
+static NameTable g_reached_funcs = {0};
+
+/* Records the names called in `n`; nested definitions are only reached by their own calls. */
+static void shake_calls(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_FUNCTION_CALL:
+            if (name_table_find(&g_reached_funcs, n->funccall.name) < 0) name_table_add(&g_reached_funcs, n->funccall.name);
+            for (i = 0; i < n->funccall.arg_count; i++) shake_calls(n->funccall.args[i]);
+            break;
+        case AST_BINARY_OP:
+            shake_calls(n->binop.left);
+            shake_calls(n->binop.right);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            shake_calls(n->var.value);
+            break;
+        case AST_PRINT:
+            shake_calls(n->print.expr);
+            break;
+        case AST_WHILE:
+            shake_calls(n->whilestmt.cond);
+            shake_calls(n->whilestmt.body);
+            break;
+        case AST_IF:
+        case AST_COND:
+            shake_calls(n->ifstmt.cond);
+            shake_calls(n->ifstmt.then_b);
+            shake_calls(n->ifstmt.else_b);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) shake_calls(n->statements.stmts[i]);
+            break;
+        case AST_RETURN:
+            shake_calls(n->retstmt.expr);
+            break;
+        case AST_FOR:
+            shake_calls(n->forstmt.start);
+            shake_calls(n->forstmt.end);
+            shake_calls(n->forstmt.body);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) shake_calls(n->arraylit.items[i]);
+            break;
+        case AST_INDEX:
+            shake_calls(n->index.array);
+            shake_calls(n->index.index);
+            break;
+        case AST_INDEX_ASSIGN:
+            shake_calls(n->indexassign.array);
+            shake_calls(n->indexassign.index);
+            shake_calls(n->indexassign.value);
+            break;
+        default:
+            break;
+    }
+}
+
+/* True if the subtree holds a definition that is reached; its enclosing definitions must stay. */
+static int holds_reached_def(ASTNode *n) {
+    int i;
+
+    if (!n) return 0;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                if (holds_reached_def(n->statements.stmts[i])) return 1;
+            }
+            return 0;
+        case AST_FUNC_DEF:
+            return name_table_find(&g_reached_funcs, n->funcdef.name) >= 0 || holds_reached_def(n->funcdef.body);
+        case AST_IF:
+            return holds_reached_def(n->ifstmt.then_b) || holds_reached_def(n->ifstmt.else_b);
+        case AST_WHILE:
+            return holds_reached_def(n->whilestmt.body);
+        case AST_FOR:
+            return holds_reached_def(n->forstmt.body);
+        default:
+            return 0;
+    }
+}
+
+static void shake_defs(ASTNode **slot) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) shake_defs(&n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            if (!holds_reached_def(n)) {
+                free_ast(n);
+                *slot = ast_statements(NULL, 0);
+                g_pass_counts.eliminations++;
+                return;
+            }
+            shake_defs(&n->funcdef.body);
+            break;
+        case AST_IF:
+            shake_defs(&n->ifstmt.then_b);
+            shake_defs(&n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            shake_defs(&n->whilestmt.body);
+            break;
+        case AST_FOR:
+            shake_defs(&n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static ASTNode *shake_tree(ASTNode *root) {
+    int done = 0;
+    int i;
+
+    ctfe_collect(root);
+    shake_calls(root);
+    /* Calls in a body only count once its function is reached; the table grows as they are found. */
+    while (done < g_reached_funcs.count) {
+        const char *name = g_reached_funcs.data[done++];
+        for (i = 0; i < g_ctfe_funcs.count; i++) {
+            if (strcmp(g_ctfe_funcs.data[i]->funcdef.name, name) == 0) shake_calls(g_ctfe_funcs.data[i]->funcdef.body);
+        }
+    }
+    shake_defs(&root);
+    free(g_ctfe_funcs.data);
+    memset(&g_ctfe_funcs, 0, sizeof(g_ctfe_funcs));
+    name_table_free(&g_reached_funcs);
+    return root;
+}
+
+/*
+ * Pass manager.
+ *
+ * optimize_program runs g_passes in order, skipping those above the -O level
+ * and, at -Os, those that trade code size for speed. Consecutive PASS_REPEAT
+ * passes form a cleanup group whose members feed each other (a propagated
+ * constant folds, a fold exposes a dead branch or a constant call), so the
+ * group reruns until a round changes nothing or the level's round limit is
+ * hit. Whether a round changed anything is read from g_pass_counts, which
+ * every pass bumps as it rewrites the tree.
+ */
+
+#define PASS_REPEAT 1 /* member of a cleanup group rerun to a fixpoint */
+#define PASS_SPEED 2  /* grows code to make it faster; left out at -Os */
+
+typedef struct {
+    const char *name;
+    ASTNode *(*run)(ASTNode *root);
+    int min_level;
+    int flags;
+} Pass;
+
+static const Pass g_passes[] = {
+    { "fold", optimize_node, 1, 0 },
+    { "inline", inline_functions, 2, 0 },
+    { "const-prop", propagate_constants, 1, PASS_REPEAT },
+    { "ctfe", evaluate_constant_calls, 2, PASS_REPEAT },
+    { "fold", optimize_node, 1, PASS_REPEAT },
+    { "ssa", ssa_optimize, 2, PASS_REPEAT },
+    { "fold", optimize_node, 1, PASS_REPEAT },
+    { "unroll", unroll_loops, 2, PASS_SPEED },
+    { "fold", optimize_node, 1, 0 },
+    { "vectorize", vectorize_loops, 2, PASS_SPEED },
+    { "licm", hoist_loop_invariants, 2, PASS_SPEED },
+    { "cse", eliminate_common_subexpressions, 2, 0 },
+    { "shake", shake_tree, 1, 0 },
+    { "dse", eliminate_dead_stores, 1, 0 },
+    { "fold", optimize_node, 1, 0 },
+    { "bce", eliminate_bounds_checks, 2, PASS_SPEED },
+    { "types", infer_types, 1, 0 },
+    { "frames", mark_frame_allocations, 2, 0 }
+};
+
+#define PASS_COUNT ((int)(sizeof(g_passes) / sizeof(g_passes[0])))
+
+typedef struct {
+    const char *name;
+    int runs;
+    PassCounts counts;
+    double seconds;
+} PassStat;
+
+int g_opt_level = OPT_LEVEL_DEFAULT;
+int g_opt_size = 0;
+int g_pass_stats = 0;
+PassCounts g_pass_counts = {0};
+
+static PassStat g_stats[PASS_COUNT + 1]; /* one per pass name, plus codegen's peephole */
+static int g_stat_count = 0;
+
+void pass_mark(PassMark *m) {
+    m->counts = g_pass_counts;
+    m->start = clock();
+}
+
+/* Adds what happened since `m` to the statistics for `name`; returns 1 if the pass changed anything. */
+int pass_record(const char *name, const PassMark *m) {
+    PassCounts d;
+    PassStat *st = NULL;
+    int i;
+
+    d.folds = g_pass_counts.folds - m->counts.folds;
+    d.eliminations = g_pass_counts.eliminations - m->counts.eliminations;
+    d.inlines = g_pass_counts.inlines - m->counts.inlines;
+    d.rewrites = g_pass_counts.rewrites - m->counts.rewrites;
+    if (g_pass_stats) {
+        for (i = 0; i < g_stat_count && !st; i++) {
+            if (strcmp(g_stats[i].name, name) == 0) st = &g_stats[i];
+        }
+        if (!st && g_stat_count < PASS_COUNT + 1) {
+            st = &g_stats[g_stat_count++];
+            memset(st, 0, sizeof(*st));
+            st->name = name;
+        }
+        if (st) {
+            st->runs++;
+            st->counts.folds += d.folds;
+            st->counts.eliminations += d.eliminations;
+            st->counts.inlines += d.inlines;
+            st->counts.rewrites += d.rewrites;
+            st->seconds += (double)(clock() - m->start) / CLOCKS_PER_SEC;
+        }
+    }
+    return d.folds || d.eliminations || d.inlines || d.rewrites;
+}
+
+void print_pass_stats(void) {
+    PassStat total;
+    int i;
+
+    memset(&total, 0, sizeof(total));
+    printf("%-12s %5s %7s %7s %7s %8s %9s\n", "pass", "runs", "folds", "elims", "inlines", "rewrites", "ms");
+    for (i = 0; i < g_stat_count; i++) {
+        const PassStat *st = &g_stats[i];
+        printf("%-12s %5d %7ld %7ld %7ld %8ld %9.3f\n", st->name, st->runs, st->counts.folds, st->counts.eliminations,
+               st->counts.inlines, st->counts.rewrites, st->seconds * 1000.0);
+        total.runs += st->runs;
+        total.counts.folds += st->counts.folds;
+        total.counts.eliminations += st->counts.eliminations;
+        total.counts.inlines += st->counts.inlines;
+        total.counts.rewrites += st->counts.rewrites;
+        total.seconds += st->seconds;
+    }
+    printf("%-12s %5d %7ld %7ld %7ld %8ld %9.3f\n", "total", total.runs, total.counts.folds, total.counts.eliminations,
+           total.counts.inlines, total.counts.rewrites, total.seconds * 1000.0);
+}
+
+static int pass_enabled(const Pass *p) {
+    return g_opt_level >= p->min_level && !(g_opt_size && (p->flags & PASS_SPEED));
+}
+
+static ASTNode *run_pass(const Pass *p, ASTNode *root, int *changed) {
+    PassMark m;
+
+    pass_mark(&m);
+    root = p->run(root);
+    *changed |= pass_record(p->name, &m);
+    return root;
+}
+
+ASTNode *optimize_program(ASTNode *root) {
+    int max_rounds = g_opt_level >= 3 ? 8 : g_opt_level == 2 ? 4 : 1;
+    int i = 0;
+
+    /* Temporaries are named afresh for each run, so a second run (see bind_profile) matches a first one. */
+    g_inline_temp_id = 0;
+    g_licm_temp_id = 0;
+    g_cse_temp_id = 0;
+    g_vec_temp_id = 0;
+    while (i < PASS_COUNT) {
+        int end = i + 1;
+        int round;
+        int changed = 1;
+        int k;
+
+        if (!(g_passes[i].flags & PASS_REPEAT)) {
+            if (pass_enabled(&g_passes[i])) root = run_pass(&g_passes[i], root, &changed);
+            i++;
+            continue;
+        }
+        while (end < PASS_COUNT && (g_passes[end].flags & PASS_REPEAT)) end++;
+        for (round = 0; round < max_rounds && changed; round++) {
+            changed = 0;
+            for (k = i; k < end; k++) {
+                if (pass_enabled(&g_passes[k])) root = run_pass(&g_passes[k], root, &changed);
+            }
+        }
+        i = end;
+    }
+    return root;
+}
@@ -2,6 +2,20 @@
 
 static TokVec *G;
 static int P;
+/* Numbers ifs, loops and calls in source order, so a profile can name them across builds. */
+static int g_next_site = 0;
+/* Nesting depth of `{ }` blocks; `const` is only allowed outside all of them. */
+static int g_block_depth = 0;
+
+/* A `const` binding: the literal its initializer folded to. Constants are never stored at run time. */
+typedef struct {
+    char *name;
+    ASTNode *value;
+} ConstBinding;
+
+static ConstBinding *g_consts = NULL;
+static int g_const_count = 0;
+static int g_const_cap = 0;
 
 static Tok *peek(void) { return &G->data[P]; }
 static int at(TokType t) { return peek()->t == t; }
@@ -20,6 +34,7 @@ static ASTNode *parse_expr(void);
 static ASTNode *parse_stmt(void);
 static ASTNode *parse_block(void);
 static ASTNode *parse_if_stmt(void);
+static ASTNode *substitute_constants(ASTNode *n, char **params, int param_count);
 
 static int has_spl_extension(const char *path) {
     size_t n = strlen(path);
@@ -105,6 +120,137 @@ static ASTNode *parse_file_with_imports(const char *path) {
     return root;
 }
 
+static const ASTNode *find_const(const char *name) {
+    int i;
+
+    for (i = 0; i < g_const_count; i++) {
+        if (strcmp(g_consts[i].name, name) == 0) return g_consts[i].value;
+    }
+    return NULL;
+}
+
+static int is_param(const char *name, char **params, int param_count) {
+    int i;
+
+    for (i = 0; i < param_count; i++) {
+        if (strcmp(params[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+/* A constant's name can only be written where a parameter of the enclosing function shadows it. */
+static void reject_const_write(const char *name, char **params, int param_count) {
+    if (find_const(name) && !is_param(name, params, param_count)) {
+        fprintf(stderr, "spbuild: cannot assign to constant '%s'\n", name);
+        exit(1);
+    }
+}
+
+/*
+ * A `let` or `for` cannot reuse a constant's name either: reads before the
+ * binding, or outside its block, would still have to mean the constant.
+ */
+static void reject_const_binding(const char *name, char **params, int param_count) {
+    if (find_const(name) && !is_param(name, params, param_count)) {
+        fprintf(stderr, "spbuild: '%s' is a constant and cannot be rebound\n", name);
+        exit(1);
+    }
+}
+
+/* Replaces every read of a constant with its literal; `params` are the enclosing function's parameters. */
+static ASTNode *substitute_constants(ASTNode *n, char **params, int param_count) {
+    const ASTNode *value;
+    int i;
+
+    if (!n) return NULL;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            value = find_const(n->string);
+            if (value && !is_param(n->string, params, param_count)) {
+                free_ast(n);
+                return ast_clone(value);
+            }
+            break;
+        case AST_BINARY_OP:
+            n->binop.left = substitute_constants(n->binop.left, params, param_count);
+            n->binop.right = substitute_constants(n->binop.right, params, param_count);
+            break;
+        case AST_PRINT:
+            n->print.expr = substitute_constants(n->print.expr, params, param_count);
+            break;
+        case AST_LET:
+            reject_const_binding(n->var.name, params, param_count);
+            n->var.value = substitute_constants(n->var.value, params, param_count);
+            break;
+        case AST_ASSIGN:
+            reject_const_write(n->var.name, params, param_count);
+            n->var.value = substitute_constants(n->var.value, params, param_count);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) {
+                n->statements.stmts[i] = substitute_constants(n->statements.stmts[i], params, param_count);
+            }
+            break;
+        case AST_WHILE:
+            n->whilestmt.cond = substitute_constants(n->whilestmt.cond, params, param_count);
+            n->whilestmt.body = substitute_constants(n->whilestmt.body, params, param_count);
+            break;
+        case AST_IF:
+        case AST_COND:
+            n->ifstmt.cond = substitute_constants(n->ifstmt.cond, params, param_count);
+            n->ifstmt.then_b = substitute_constants(n->ifstmt.then_b, params, param_count);
+            n->ifstmt.else_b = substitute_constants(n->ifstmt.else_b, params, param_count);
+            break;
+        case AST_FUNC_DEF:
+            n->funcdef.body = substitute_constants(n->funcdef.body, n->funcdef.params, n->funcdef.param_count);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                n->funccall.args[i] = substitute_constants(n->funccall.args[i], params, param_count);
+            }
+            break;
+        case AST_RETURN:
+            n->retstmt.expr = substitute_constants(n->retstmt.expr, params, param_count);
+            break;
+        case AST_FOR:
+            reject_const_binding(n->forstmt.var, params, param_count);
+            n->forstmt.start = substitute_constants(n->forstmt.start, params, param_count);
+            n->forstmt.end = substitute_constants(n->forstmt.end, params, param_count);
+            n->forstmt.body = substitute_constants(n->forstmt.body, params, param_count);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                n->arraylit.items[i] = substitute_constants(n->arraylit.items[i], params, param_count);
+            }
+            break;
+        case AST_INDEX:
+            n->index.array = substitute_constants(n->index.array, params, param_count);
+            n->index.index = substitute_constants(n->index.index, params, param_count);
+            break;
+        case AST_INDEX_ASSIGN:
+            if (n->indexassign.array && n->indexassign.array->type == AST_IDENTIFIER) {
+                reject_const_write(n->indexassign.array->string, params, param_count);
+            }
+            n->indexassign.index = substitute_constants(n->indexassign.index, params, param_count);
+            n->indexassign.value = substitute_constants(n->indexassign.value, params, param_count);
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+static const char *compound_assign_op(TokType t) {
+    switch (t) {
+        case TK_PLUS_ASSIGN: return "+";
+        case TK_MINUS_ASSIGN: return "-";
+        case TK_STAR_ASSIGN: return "*";
+        case TK_SLASH_ASSIGN: return "/";
+        case TK_MOD_ASSIGN: return "%";
+        default: return NULL;
+    }
+}
+
 static int is_index_assign_start(void) {
     int depth = 0;
     int i;
@@ -119,7 +265,7 @@ static int is_index_assign_start(void) {
             depth--;
             if (depth == 0) {
                 if (i + 1 >= G->count) return 0;
-                return G->data[i + 1].t == TK_ASSIGN;
+                return G->data[i + 1].t == TK_ASSIGN || compound_assign_op(G->data[i + 1].t) != NULL;
             }
         }
         if (t == TK_EOF) break;
@@ -189,6 +335,7 @@ static ASTNode *parse_postfix(void) {
             }
             expect(TK_RPAREN, "Expected ')' after call");
             call = ast_call(name, args, count);
+            call->site = ++g_next_site;
             free_ast(e);
             e = call;
             continue;
@@ -280,6 +427,36 @@ static ASTNode *parse_stmt(void) {
         return ast_var(AST_LET, name, parse_expr());
     }
 
+    if (match(TK_CONST)) {
+        const char *name;
+        ASTNode *value;
+
+        expect(TK_IDENT, "Expected identifier after const");
+        name = G->data[P - 1].lex;
+        if (g_block_depth > 0) {
+            fprintf(stderr, "parse error line %d: const '%s' must be declared at top level\n", peek()->line, name);
+            exit(1);
+        }
+        if (find_const(name)) {
+            fprintf(stderr, "parse error line %d: constant '%s' is already declared\n", peek()->line, name);
+            exit(1);
+        }
+        expect(TK_ASSIGN, "Expected '=' after const name");
+        value = optimize_node(substitute_constants(parse_expr(), NULL, 0));
+        if (!value || (value->type != AST_NUMBER && value->type != AST_STRING)) {
+            fprintf(stderr, "parse error line %d: value of constant '%s' is not a compile-time number or string\n",
+                    peek()->line, name);
+            exit(1);
+        }
+        if (g_const_count >= g_const_cap) {
+            g_const_cap = g_const_cap ? g_const_cap * 2 : 16;
+            g_consts = (ConstBinding *)xrealloc(g_consts, sizeof(ConstBinding) * (size_t)g_const_cap);
+        }
+        g_consts[g_const_count].name = xstrdup(name);
+        g_consts[g_const_count++].value = value;
+        return NULL;
+    }
+
     if (match(TK_PRINT)) {
         ASTNode *e;
         expect(TK_LPAREN, "Expected '(' after print");
@@ -363,11 +540,14 @@ static ASTNode *parse_stmt(void) {
     if (match(TK_WHILE)) {
         ASTNode *cond;
         ASTNode *body;
+        ASTNode *loop;
         expect(TK_LPAREN, "Expected '(' after while");
         cond = parse_expr();
         expect(TK_RPAREN, "Expected ')'");
         body = parse_block();
-        return ast_while(cond, body);
+        loop = ast_while(cond, body);
+        loop->site = ++g_next_site;
+        return loop;
     }
 
     if (match(TK_FOR)) {
@@ -376,6 +556,7 @@ static ASTNode *parse_stmt(void) {
         ASTNode *start;
         ASTNode *end;
         ASTNode *body;
+        ASTNode *loop;
 
         expect(TK_IDENT, "Expected for variable name");
         var = G->data[P - 1].lex;
@@ -385,17 +566,26 @@ static ASTNode *parse_stmt(void) {
         end = parse_expr();
         if (has_parens) expect(TK_RPAREN, "Expected ')' after for header");
         body = parse_block();
-        return ast_for(var, start, end, body);
+        loop = ast_for(var, start, end, body);
+        loop->site = ++g_next_site;
+        return loop;
     }
 
     if (is_index_assign_start()) {
         const char *name = advance()->lex;
+        const char *op;
         ASTNode *idx;
         ASTNode *val;
 
         expect(TK_LBRACKET, "Expected '['");
         idx = parse_expr();
         expect(TK_RBRACKET, "Expected ']'");
+        op = compound_assign_op(peek()->t);
+        if (op) {
+            advance();
+            val = parse_expr();
+            return ast_index_compound(ast_ident(name), idx, op, val);
+        }
         expect(TK_ASSIGN, "Expected '=' after index");
         val = parse_expr();
         return ast_index_assign(ast_ident(name), idx, val);
@@ -407,6 +597,12 @@ static ASTNode *parse_stmt(void) {
         return ast_var(AST_ASSIGN, name, parse_expr());
     }
 
+    if (at(TK_IDENT) && compound_assign_op(G->data[P + 1].t)) {
+        const char *name = advance()->lex;
+        const char *op = compound_assign_op(advance()->t);
+        return ast_var(AST_ASSIGN, name, ast_binop(op, ast_ident(name), parse_expr()));
+    }
+
     return parse_expr();
 }
 
@@ -414,6 +610,7 @@ static ASTNode *parse_if_stmt(void) {
     ASTNode *cond;
     ASTNode *thenb;
     ASTNode *elseb = NULL;
+    ASTNode *n;
 
     expect(TK_LPAREN, "Expected '(' after if");
     cond = parse_expr();
@@ -426,7 +623,9 @@ static ASTNode *parse_if_stmt(void) {
         else elseb = parse_block();
     }
 
-    return ast_if(cond, thenb, elseb);
+    n = ast_if(cond, thenb, elseb);
+    n->site = ++g_next_site;
+    return n;
 }
 
 static ASTNode *parse_block(void) {
@@ -435,6 +634,7 @@ static ASTNode *parse_block(void) {
     int cap = 0;
 
     expect(TK_LBRACE, "Expected '{'");
+    g_block_depth++;
     while (!at(TK_RBRACE) && !at(TK_EOF)) {
         ASTNode *s = parse_stmt();
         if (s) {
@@ -447,6 +647,7 @@ static ASTNode *parse_block(void) {
         eat_separators();
     }
     expect(TK_RBRACE, "Expected '}'");
+    g_block_depth--;
     return ast_statements(stmts, count);
 }
 
@@ -472,3 +673,22 @@ ASTNode *parse_program(TokVec *v) {
 
     return ast_statements(stmts, count);
 }
+
+/*
+ * Substitutes `const` values at every use in the whole program, imports included, and
+ * drops the bindings. Runs after parsing so a function may use a constant declared below it.
+ */
+ASTNode *resolve_constants(ASTNode *root) {
+    int i;
+
+    root = substitute_constants(root, NULL, 0);
+    for (i = 0; i < g_const_count; i++) {
+        free(g_consts[i].name);
+        free_ast(g_consts[i].value);
+    }
+    free(g_consts);
+    g_consts = NULL;
+    g_const_count = 0;
+    g_const_cap = 0;
+    return root;
+}
@@ -0,0 +1,197 @@
+#include "builder.h"
+
+/*
+ * Profile-guided optimization (spbuild --profile-in).
+ *
+ * `Splice <file.spc> --profile-out <file>` writes per-function call counts and
+ * per-address counters: how often each conditional jump ran and was taken,
+ * how often each loop header was reached by a backward jump, and how often
+ * each call site ran with which argument types. Those addresses belong to the
+ * .spc a plain build of the program produces, so bind_profile (codegen.c)
+ * regenerates that build, checks its code against the hash in the profile and
+ * reports which parser site (ASTNode.site) produced each counted instruction.
+ * Until then every query answers "no data", which keeps that first build plain.
+ */
+
+#define PROFILE_HOT_FLOOR 64
+#define PROFILE_HOT_SHARE 50
+
+typedef struct {
+    int loaded;
+    int bound;
+    uint32_t code_size;
+    uint32_t code_hash;
+    unsigned long long *executed;
+    unsigned long long *taken;
+    unsigned long long *iterations;
+    unsigned long long *calls;
+    unsigned char *mixed_types;
+    char **func_names;
+    unsigned long long *func_calls;
+    int func_count;
+    int func_cap;
+    unsigned long long total_calls;
+    SiteProfile *sites;
+    int site_cap;
+} LoadedProfile;
+
+static LoadedProfile g_prof = {0};
+
+void profile_free(void) {
+    int i;
+
+    free(g_prof.executed);
+    free(g_prof.taken);
+    free(g_prof.iterations);
+    free(g_prof.calls);
+    free(g_prof.mixed_types);
+    for (i = 0; i < g_prof.func_count; i++) free(g_prof.func_names[i]);
+    free(g_prof.func_names);
+    free(g_prof.func_calls);
+    free(g_prof.sites);
+    memset(&g_prof, 0, sizeof(g_prof));
+}
+
+static void profile_add_func(const char *name, unsigned long long calls) {
+    if (g_prof.func_count >= g_prof.func_cap) {
+        g_prof.func_cap = g_prof.func_cap ? g_prof.func_cap * 2 : 16;
+        g_prof.func_names = (char **)xrealloc(g_prof.func_names, sizeof(char *) * (size_t)g_prof.func_cap);
+        g_prof.func_calls = (unsigned long long *)xrealloc(g_prof.func_calls,
+                                                           sizeof(unsigned long long) * (size_t)g_prof.func_cap);
+    }
+    g_prof.func_names[g_prof.func_count] = xstrdup(name);
+    g_prof.func_calls[g_prof.func_count++] = calls;
+    g_prof.total_calls += calls;
+}
+
+static void *profile_counters(size_t elem_size) {
+    void *p = xmalloc(elem_size * ((size_t)g_prof.code_size + 1u));
+    memset(p, 0, elem_size * ((size_t)g_prof.code_size + 1u));
+    return p;
+}
+
+int profile_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[1024];
+    unsigned int size;
+    unsigned int hash;
+    int ok = 1;
+
+    if (!f) return 0;
+    profile_free();
+    if (!fgets(line, sizeof(line), f) || strcmp(line, "splice-profile 1\n") != 0 ||
+        !fgets(line, sizeof(line), f) || sscanf(line, "code %u %x", &size, &hash) != 2 || size > (1u << 28)) {
+        fclose(f);
+        return 0;
+    }
+    g_prof.code_size = size;
+    g_prof.code_hash = hash;
+    g_prof.executed = (unsigned long long *)profile_counters(sizeof(unsigned long long));
+    g_prof.taken = (unsigned long long *)profile_counters(sizeof(unsigned long long));
+    g_prof.iterations = (unsigned long long *)profile_counters(sizeof(unsigned long long));
+    g_prof.calls = (unsigned long long *)profile_counters(sizeof(unsigned long long));
+    g_prof.mixed_types = (unsigned char *)profile_counters(sizeof(unsigned char));
+
+    while (ok && fgets(line, sizeof(line), f)) {
+        char name[sizeof(line)];
+        unsigned int at;
+        unsigned long long a;
+        unsigned long long b;
+        int used;
+
+        if (sscanf(line, "func %1023s %llu", name, &a) == 2) {
+            profile_add_func(name, a);
+        } else if (sscanf(line, "branch %u %llu %llu", &at, &a, &b) == 3 && at <= size && b <= a) {
+            g_prof.executed[at] = a;
+            g_prof.taken[at] = b;
+        } else if (sscanf(line, "loop %u %llu", &at, &a) == 2 && at <= size) {
+            g_prof.iterations[at] = a;
+        } else if (sscanf(line, "call %u %llu%n", &at, &a, &used) == 2 && at <= size) {
+            /* One letter per argument; more than one means that argument arrived with several types. */
+            const char *p = line + used;
+            g_prof.calls[at] = a;
+            while (*p) {
+                size_t len;
+                while (*p == ' ') p++;
+                len = strcspn(p, " \n");
+                if (len > 1) g_prof.mixed_types[at] = 1;
+                p += len;
+                if (*p == '\n') break;
+            }
+        } else {
+            ok = 0;
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        profile_free();
+        return 0;
+    }
+    g_prof.loaded = 1;
+    return 1;
+}
+
+int profile_matches_code(const uint8_t *code, uint32_t size) {
+    uint32_t h = 2166136261u;
+    uint32_t i;
+
+    if (!g_prof.loaded || size != g_prof.code_size) return 0;
+    for (i = 0; i < size; i++) {
+        h ^= code[i];
+        h *= 16777619u;
+    }
+    return h == g_prof.code_hash;
+}
+
+/* Attaches the counters at `addr` to `site`; an address the run never reached binds as zero. */
+void profile_bind_site(int kind, int site, uint32_t addr) {
+    SiteProfile *sp;
+
+    if (!g_prof.loaded || site <= 0 || addr > g_prof.code_size) return;
+    if (site >= g_prof.site_cap) {
+        int cap = g_prof.site_cap ? g_prof.site_cap : 64;
+        while (cap <= site) cap *= 2;
+        g_prof.sites = (SiteProfile *)xrealloc(g_prof.sites, sizeof(SiteProfile) * (size_t)cap);
+        memset(g_prof.sites + g_prof.site_cap, 0, sizeof(SiteProfile) * (size_t)(cap - g_prof.site_cap));
+        g_prof.site_cap = cap;
+    }
+    sp = &g_prof.sites[site];
+    sp->known |= kind;
+    if (kind == PROFILE_BRANCH) {
+        sp->executed += g_prof.executed[addr];
+        sp->taken += g_prof.taken[addr];
+    } else if (kind == PROFILE_LOOP) {
+        sp->iterations += g_prof.iterations[addr];
+    } else if (kind == PROFILE_CALL) {
+        sp->calls += g_prof.calls[addr];
+        if (g_prof.mixed_types[addr]) sp->mixed_types = 1;
+    }
+}
+
+void profile_mark_bound(void) {
+    g_prof.bound = 1;
+}
+
+const SiteProfile *profile_site(int site) {
+    if (!g_prof.bound || site <= 0 || site >= g_prof.site_cap || !g_prof.sites[site].known) return NULL;
+    return &g_prof.sites[site];
+}
+
+/* Sets *calls to the function's call count; 0 if the profile does not name it. */
+int profile_func_calls(const char *name, unsigned long long *calls) {
+    int i;
+
+    if (!g_prof.bound) return 0;
+    for (i = 0; i < g_prof.func_count; i++) {
+        if (strcmp(g_prof.func_names[i], name) == 0) {
+            *calls = g_prof.func_calls[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Hot: at least PROFILE_HOT_FLOOR calls and a 1/PROFILE_HOT_SHARE share of all calls to user functions. */
+int profile_is_hot(unsigned long long calls) {
+    return calls >= PROFILE_HOT_FLOOR && calls * PROFILE_HOT_SHARE >= g_prof.total_calls;
+}
@@ -0,0 +1,1228 @@
+#include "builder.h"
+
+/*
+ * SSA form for the optimizer. The top-level program and every function body
+ * are lowered, one at a time, to a control-flow graph whose variable reads
+ * name SSA values; phis are placed on the fly as blocks are sealed. Sparse
+ * conditional constant propagation, value numbering and dead-store detection
+ * run on that graph, and their results are written back into the AST, which
+ * is what codegen and write_spc consume.
+ */
+
+#define SSA_NONE (-1)
+
+typedef enum {
+    SSA_CONST,
+    SSA_OPAQUE,
+    SSA_PHI,
+    SSA_OP,
+    SSA_COPY
+} SsaKind;
+
+typedef enum {
+    LAT_TOP,
+    LAT_CONST,
+    LAT_BOTTOM
+} SsaLattice;
+
+typedef struct {
+    SsaKind kind;
+    int block;
+    char *op;          /* SSA_OP: operator, builtin name, "inc" or "?:" */
+    int is_call;
+    int *args;         /* SSA_OP operands, SSA_COPY source, SSA_PHI value per predecessor */
+    int argc;
+    int argcap;
+    ASTNode *lit;      /* SSA_CONST */
+    int forward;       /* trivial phi: the value it stands for */
+    int store;         /* SSA_COPY written by a removable statement */
+    SsaLattice lat;
+    ASTNode *cval;
+    int live;
+} SsaValue;
+
+typedef struct {
+    int var;
+    int phi;
+} SsaPending;
+
+typedef struct {
+    int *preds;
+    int npreds;
+    int predcap;
+    int succ[2];
+    int nsucc;
+    int cond;          /* branch value when nsucc == 2: succ[0] if truthy, succ[1] if not */
+    int sealed;
+    int exec;
+    int *defs;         /* current SSA value of each variable, or SSA_NONE */
+    SsaPending *pending;
+    int npending;
+    int pendcap;
+} SsaBlock;
+
+typedef enum {
+    SITE_READ,
+    SITE_COND
+} SsaSiteKind;
+
+typedef struct {
+    ASTNode **slot;
+    int value;
+    int owner;         /* store whose statement holds the site, or SSA_NONE */
+    int next_owned;
+    SsaSiteKind kind;
+    int replaced;
+} SsaSite;
+
+typedef struct {
+    ASTNode **slot;
+    int copy;
+    int first_site;
+} SsaStore;
+
+typedef struct {
+    SsaValue *values;
+    int nvalues;
+    int valcap;
+    SsaBlock *blocks;
+    int nblocks;
+    int blockcap;
+    char **vars;
+    unsigned char *visible;
+    int nvars;
+    int varcap;
+    int *table;        /* value numbering: SSA_CONST and SSA_OP values by content */
+    int tablecap;
+    int tablecount;
+    SsaSite *sites;
+    int nsites;
+    int sitecap;
+    SsaStore *stores;
+    int nstores;
+    int storecap;
+    int *roots;
+    int nroots;
+    int rootcap;
+    int *brk;
+    int *cont;
+    int nloops;
+    int loopcap;
+    int cur;
+    int owner;
+    int in_function;
+} SsaUnit;
+
+static const char *const g_ssa_builtin_names[] = {
+    "print", "input", "sleep", "noop", "len", "append", "sin", "cos", "tan",
+    "sqrt", "pow", "mod", "abs", "floor", "ceil", "round", "min", "max",
+    "clamp", "to_number", "lerp", "slice", "split"
+};
+
+/* Builtins whose result depends only on their argument values. */
+static const char *const g_ssa_value_builtins[] = {
+    "sin", "cos", "tan", "sqrt", "pow", "mod", "abs", "floor", "ceil",
+    "round", "min", "max", "clamp", "to_number", "lerp"
+};
+
+static char **g_ssa_funcs = NULL;
+static int g_ssa_func_count = 0;
+static char **g_ssa_globals = NULL;
+static int g_ssa_global_count = 0;
+
+static int name_listed(char **list, int count, const char *name) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(list[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void name_list_add(char ***list, int *count, const char *name) {
+    if (name_listed(*list, *count, name)) return;
+    *list = (char **)xrealloc(*list, sizeof(char *) * (size_t)(*count + 1));
+    (*list)[(*count)++] = xstrdup(name);
+}
+
+static void name_list_free(char ***list, int *count) {
+    int i;
+    for (i = 0; i < *count; i++) free((*list)[i]);
+    free(*list);
+    *list = NULL;
+    *count = 0;
+}
+
+/* Function names anywhere in the program, and names top-level code binds (the only globals). */
+static void ssa_collect_names(ASTNode *n, int top) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) ssa_collect_names(n->statements.stmts[i], top);
+            break;
+        case AST_FUNC_DEF:
+            name_list_add(&g_ssa_funcs, &g_ssa_func_count, n->funcdef.name);
+            ssa_collect_names(n->funcdef.body, 0);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            if (top) name_list_add(&g_ssa_globals, &g_ssa_global_count, n->var.name);
+            break;
+        case AST_FOR:
+            if (top) name_list_add(&g_ssa_globals, &g_ssa_global_count, n->forstmt.var);
+            ssa_collect_names(n->forstmt.body, top);
+            break;
+        case AST_IF:
+            ssa_collect_names(n->ifstmt.then_b, top);
+            ssa_collect_names(n->ifstmt.else_b, top);
+            break;
+        case AST_WHILE:
+            ssa_collect_names(n->whilestmt.body, top);
+            break;
+        default:
+            break;
+    }
+}
+
+static int ssa_in_list(const char *const *list, size_t count, const char *name) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(list[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+/* True if the call may run Splice or native code, which can rebind globals. */
+static int ssa_call_runs_code(ASTNode *call) {
+    if (name_listed(g_ssa_funcs, g_ssa_func_count, call->funccall.name)) return 1;
+    return !ssa_in_list(g_ssa_builtin_names, sizeof(g_ssa_builtin_names) / sizeof(g_ssa_builtin_names[0]),
+                        call->funccall.name);
+}
+
+static int ssa_value_call(ASTNode *call) {
+    if (name_listed(g_ssa_funcs, g_ssa_func_count, call->funccall.name)) return 0;
+    return ssa_in_list(g_ssa_value_builtins, sizeof(g_ssa_value_builtins) / sizeof(g_ssa_value_builtins[0]),
+                       call->funccall.name);
+}
+
+/* True if the expression can be dropped: no calls with effects and nothing that can fail. */
+static int ssa_removable(ASTNode *n) {
+    int i;
+
+    if (!n) return 1;
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_IDENTIFIER:
+            return 1;
+        case AST_BINARY_OP:
+            if (strcmp(n->binop.op, "%") == 0 &&
+                !(n->binop.right && n->binop.right->type == AST_NUMBER && (int)n->binop.right->number != 0)) {
+                return 0;
+            }
+            return ssa_removable(n->binop.left) && ssa_removable(n->binop.right);
+        case AST_COND:
+            return ssa_removable(n->ifstmt.cond) && ssa_removable(n->ifstmt.then_b) &&
+                   ssa_removable(n->ifstmt.else_b);
+        case AST_INDEX:
+            return ssa_removable(n->index.array) && ssa_removable(n->index.index);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) {
+                if (!ssa_removable(n->arraylit.items[i])) return 0;
+            }
+            return 1;
+        case AST_FUNCTION_CALL:
+            if (!ssa_value_call(n) && !(strcmp(n->funccall.name, "len") == 0 && !ssa_call_runs_code(n))) return 0;
+            for (i = 0; i < n->funccall.arg_count; i++) {
+                if (!ssa_removable(n->funccall.args[i])) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int ssa_is_literal(const ASTNode *n) {
+    return n && (n->type == AST_NUMBER || n->type == AST_STRING);
+}
+
+static int ssa_same_literal(const ASTNode *a, const ASTNode *b) {
+    if (a->type != b->type) return 0;
+    if (a->type == AST_NUMBER) return memcmp(&a->number, &b->number, sizeof(double)) == 0;
+    return strcmp(a->string, b->string) == 0;
+}
+
+static int ssa_truthy(const ASTNode *n) {
+    if (n->type == AST_NUMBER) return n->number != 0.0;
+    return n->string && n->string[0] != '\0';
+}
+
+/* ---- values and blocks ---- */
+
+static int ssa_new_value(SsaUnit *u, SsaKind kind) {
+    SsaValue *v;
+
+    if (u->nvalues >= u->valcap) {
+        u->valcap = u->valcap ? u->valcap * 2 : 64;
+        u->values = (SsaValue *)xrealloc(u->values, sizeof(SsaValue) * (size_t)u->valcap);
+    }
+    v = &u->values[u->nvalues];
+    memset(v, 0, sizeof(*v));
+    v->kind = kind;
+    v->block = u->cur;
+    v->forward = SSA_NONE;
+    v->store = SSA_NONE;
+    v->lat = LAT_TOP;
+    return u->nvalues++;
+}
+
+static void ssa_add_arg(SsaUnit *u, int v, int arg) {
+    SsaValue *val = &u->values[v];
+    if (val->argc >= val->argcap) {
+        val->argcap = val->argcap ? val->argcap * 2 : 2;
+        val->args = (int *)xrealloc(val->args, sizeof(int) * (size_t)val->argcap);
+    }
+    val->args[val->argc++] = arg;
+}
+
+/* Follows trivial phis to the value they were replaced by. */
+static int ssa_resolve(SsaUnit *u, int v) {
+    while (u->values[v].kind == SSA_PHI && u->values[v].forward != SSA_NONE) v = u->values[v].forward;
+    return v;
+}
+
+/* Like ssa_resolve, and also sees through copies: two names for one computation. */
+static int ssa_canon(SsaUnit *u, int v) {
+    for (;;) {
+        v = ssa_resolve(u, v);
+        if (u->values[v].kind != SSA_COPY) return v;
+        v = u->values[v].args[0];
+    }
+}
+
+static int ssa_new_block(SsaUnit *u, int sealed) {
+    SsaBlock *b;
+    int i;
+
+    if (u->nblocks >= u->blockcap) {
+        u->blockcap = u->blockcap ? u->blockcap * 2 : 16;
+        u->blocks = (SsaBlock *)xrealloc(u->blocks, sizeof(SsaBlock) * (size_t)u->blockcap);
+    }
+    b = &u->blocks[u->nblocks];
+    memset(b, 0, sizeof(*b));
+    b->cond = SSA_NONE;
+    b->sealed = sealed;
+    b->defs = (int *)xmalloc(sizeof(int) * (size_t)(u->nvars ? u->nvars : 1));
+    for (i = 0; i < u->nvars; i++) b->defs[i] = SSA_NONE;
+    return u->nblocks++;
+}
+
+static void ssa_edge(SsaUnit *u, int from, int to) {
+    SsaBlock *b = &u->blocks[to];
+    if (b->npreds >= b->predcap) {
+        b->predcap = b->predcap ? b->predcap * 2 : 2;
+        b->preds = (int *)xrealloc(b->preds, sizeof(int) * (size_t)b->predcap);
+    }
+    b->preds[b->npreds++] = from;
+    u->blocks[from].succ[u->blocks[from].nsucc++] = to;
+}
+
+static void ssa_jump(SsaUnit *u, int to) {
+    ssa_edge(u, u->cur, to);
+}
+
+static void ssa_branch(SsaUnit *u, int cond, int if_true, int if_false) {
+    u->blocks[u->cur].cond = cond;
+    ssa_edge(u, u->cur, if_true);
+    ssa_edge(u, u->cur, if_false);
+}
+
+/* ---- value numbering ---- */
+
+static unsigned ssa_hash_value(SsaUnit *u, const SsaValue *v) {
+    unsigned h = 2166136261u;
+    const unsigned char *p;
+    size_t len = 0;
+    int i;
+
+    if (v->kind == SSA_CONST) {
+        if (v->lit->type == AST_NUMBER) {
+            p = (const unsigned char *)&v->lit->number;
+            len = sizeof(double);
+        } else {
+            p = (const unsigned char *)v->lit->string;
+            len = strlen(v->lit->string);
+            h ^= 0x5bd1e995u;
+        }
+    } else {
+        p = (const unsigned char *)v->op;
+        len = strlen(v->op);
+    }
+    while (len--) h = (h ^ *p++) * 16777619u;
+    if (v->kind == SSA_OP) {
+        for (i = 0; i < v->argc; i++) h = (h ^ (unsigned)ssa_canon(u, v->args[i])) * 16777619u;
+    }
+    return h;
+}
+
+static int ssa_same_value(SsaUnit *u, const SsaValue *a, const SsaValue *b) {
+    int i;
+
+    if (a->kind != b->kind) return 0;
+    if (a->kind == SSA_CONST) return ssa_same_literal(a->lit, b->lit);
+    if (a->is_call != b->is_call || a->argc != b->argc || strcmp(a->op, b->op) != 0) return 0;
+    for (i = 0; i < a->argc; i++) {
+        if (ssa_canon(u, a->args[i]) != ssa_canon(u, b->args[i])) return 0;
+    }
+    return 1;
+}
+
+static void ssa_table_insert(SsaUnit *u, int v) {
+    unsigned mask = (unsigned)u->tablecap - 1;
+    unsigned i = ssa_hash_value(u, &u->values[v]) & mask;
+    while (u->table[i] != SSA_NONE) i = (i + 1) & mask;
+    u->table[i] = v;
+    u->tablecount++;
+}
+
+/* Returns the existing value equal to the newest one, dropping the newest; or keeps it. */
+static int ssa_intern(SsaUnit *u, int v) {
+    unsigned mask;
+    unsigned i;
+
+    if (u->tablecount * 2 >= u->tablecap) {
+        int *old = u->table;
+        int oldcap = u->tablecap;
+        int k;
+        u->tablecap = u->tablecap ? u->tablecap * 2 : 64;
+        u->table = (int *)xmalloc(sizeof(int) * (size_t)u->tablecap);
+        for (k = 0; k < u->tablecap; k++) u->table[k] = SSA_NONE;
+        u->tablecount = 0;
+        for (k = 0; k < oldcap; k++) {
+            if (old[k] != SSA_NONE) ssa_table_insert(u, old[k]);
+        }
+        free(old);
+    }
+    mask = (unsigned)u->tablecap - 1;
+    i = ssa_hash_value(u, &u->values[v]) & mask;
+    while (u->table[i] != SSA_NONE) {
+        if (ssa_same_value(u, &u->values[u->table[i]], &u->values[v])) {
+            SsaValue *dup = &u->values[v];
+            free(dup->args);
+            free(dup->op);
+            free_ast(dup->lit);
+            u->nvalues--;
+            return u->table[i];
+        }
+        i = (i + 1) & mask;
+    }
+    u->table[i] = v;
+    u->tablecount++;
+    return v;
+}
+
+static int ssa_const(SsaUnit *u, ASTNode *lit) {
+    int v = ssa_new_value(u, SSA_CONST);
+    u->values[v].lit = ast_clone(lit);
+    return ssa_intern(u, v);
+}
+
+static int ssa_const_number(SsaUnit *u, double d) {
+    ASTNode *lit = ast_number(d);
+    int v = ssa_const(u, lit);
+    free_ast(lit);
+    return v;
+}
+
+static int ssa_opaque(SsaUnit *u) {
+    return ssa_new_value(u, SSA_OPAQUE);
+}
+
+static int ssa_op(SsaUnit *u, const char *op, int is_call, const int *args, int argc) {
+    int v = ssa_new_value(u, SSA_OP);
+    int i;
+    u->values[v].op = xstrdup(op);
+    u->values[v].is_call = is_call;
+    for (i = 0; i < argc; i++) ssa_add_arg(u, v, args[i]);
+    return ssa_intern(u, v);
+}
+
+static int ssa_copy(SsaUnit *u, int src) {
+    int v = ssa_new_value(u, SSA_COPY);
+    ssa_add_arg(u, v, src);
+    return v;
+}
+
+/* ---- variables (on-the-fly SSA construction) ---- */
+
+static int ssa_var_index(SsaUnit *u, const char *name) {
+    int i;
+    for (i = 0; i < u->nvars; i++) {
+        if (strcmp(u->vars[i], name) == 0) return i;
+    }
+    return SSA_NONE;
+}
+
+static void ssa_add_var(SsaUnit *u, const char *name) {
+    if (ssa_var_index(u, name) != SSA_NONE) return;
+    if (u->nvars >= u->varcap) {
+        u->varcap = u->varcap ? u->varcap * 2 : 16;
+        u->vars = (char **)xrealloc(u->vars, sizeof(char *) * (size_t)u->varcap);
+        u->visible = (unsigned char *)xrealloc(u->visible, (size_t)u->varcap);
+    }
+    u->vars[u->nvars] = xstrdup(name);
+    u->visible[u->nvars++] = 1;
+}
+
+/* Every name the unit reads or binds, without entering nested function bodies. */
+static void ssa_collect_vars(SsaUnit *u, ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_IDENTIFIER:
+            ssa_add_var(u, n->string);
+            break;
+        case AST_LET:
+        case AST_ASSIGN:
+            ssa_add_var(u, n->var.name);
+            ssa_collect_vars(u, n->var.value);
+            break;
+        case AST_BINARY_OP:
+            ssa_collect_vars(u, n->binop.left);
+            ssa_collect_vars(u, n->binop.right);
+            break;
+        case AST_PRINT:
+            ssa_collect_vars(u, n->print.expr);
+            break;
+        case AST_WHILE:
+            ssa_collect_vars(u, n->whilestmt.cond);
+            ssa_collect_vars(u, n->whilestmt.body);
+            break;
+        case AST_IF:
+        case AST_COND:
+            ssa_collect_vars(u, n->ifstmt.cond);
+            ssa_collect_vars(u, n->ifstmt.then_b);
+            ssa_collect_vars(u, n->ifstmt.else_b);
+            break;
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) ssa_collect_vars(u, n->statements.stmts[i]);
+            break;
+        case AST_FUNCTION_CALL:
+            for (i = 0; i < n->funccall.arg_count; i++) ssa_collect_vars(u, n->funccall.args[i]);
+            break;
+        case AST_RETURN:
+            ssa_collect_vars(u, n->retstmt.expr);
+            break;
+        case AST_FOR:
+            ssa_add_var(u, n->forstmt.var);
+            ssa_collect_vars(u, n->forstmt.start);
+            ssa_collect_vars(u, n->forstmt.end);
+            ssa_collect_vars(u, n->forstmt.body);
+            break;
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) ssa_collect_vars(u, n->arraylit.items[i]);
+            break;
+        case AST_INDEX:
+            ssa_collect_vars(u, n->index.array);
+            ssa_collect_vars(u, n->index.index);
+            break;
+        case AST_INDEX_ASSIGN:
+            ssa_collect_vars(u, n->indexassign.array);
+            ssa_collect_vars(u, n->indexassign.index);
+            ssa_collect_vars(u, n->indexassign.value);
+            break;
+        default:
+            break;
+    }
+}
+
+static int ssa_read(SsaUnit *u, int var, int block);
+
+static void ssa_write(SsaUnit *u, int var, int block, int v) {
+    u->blocks[block].defs[var] = v;
+}
+
+/* Drops a phi whose operands are all one value (or itself), as the block is completed. */
+static int ssa_try_trivial_phi(SsaUnit *u, int phi) {
+    int same = SSA_NONE;
+    int i;
+
+    for (i = 0; i < u->values[phi].argc; i++) {
+        int a = ssa_resolve(u, u->values[phi].args[i]);
+        if (a == same || a == phi) continue;
+        if (same != SSA_NONE) return phi;
+        same = a;
+    }
+    if (same == SSA_NONE) same = ssa_opaque(u);
+    u->values[phi].forward = same;
+    return same;
+}
+
+static int ssa_add_phi_operands(SsaUnit *u, int var, int phi) {
+    int b = u->values[phi].block;
+    int i;
+    for (i = 0; i < u->blocks[b].npreds; i++) {
+        int a = ssa_read(u, var, u->blocks[b].preds[i]);
+        ssa_add_arg(u, phi, a);
+    }
+    return ssa_try_trivial_phi(u, phi);
+}
+
+static int ssa_new_phi(SsaUnit *u, int block) {
+    int saved = u->cur;
+    int v;
+    u->cur = block;
+    v = ssa_new_value(u, SSA_PHI);
+    u->cur = saved;
+    return v;
+}
+
+/* Value of a variable on entry to the unit: unset globals read 0 at the top level. */
+static int ssa_entry_value(SsaUnit *u) {
+    if (u->in_function) return ssa_opaque(u);
+    return ssa_const_number(u, 0.0);
+}
+
+static int ssa_read(SsaUnit *u, int var, int block) {
+    SsaBlock *b = &u->blocks[block];
+    int v;
+
+    if (b->defs[var] != SSA_NONE) return ssa_resolve(u, b->defs[var]);
+    if (!b->sealed) {
+        v = ssa_new_phi(u, block);
+        b = &u->blocks[block];
+        if (b->npending >= b->pendcap) {
+            b->pendcap = b->pendcap ? b->pendcap * 2 : 8;
+            b->pending = (SsaPending *)xrealloc(b->pending, sizeof(SsaPending) * (size_t)b->pendcap);
+        }
+        b->pending[b->npending].var = var;
+        b->pending[b->npending++].phi = v;
+    } else if (b->npreds == 0) {
+        v = block == 0 ? ssa_entry_value(u) : ssa_opaque(u);
+    } else if (b->npreds == 1) {
+        v = ssa_read(u, var, b->preds[0]);
+    } else {
+        v = ssa_new_phi(u, block);
+        ssa_write(u, var, block, v);
+        v = ssa_add_phi_operands(u, var, v);
+    }
+    ssa_write(u, var, block, v);
+    return v;
+}
+
+static void ssa_seal(SsaUnit *u, int block) {
+    int i;
+    for (i = 0; i < u->blocks[block].npending; i++) {
+        SsaPending p = u->blocks[block].pending[i];
+        ssa_add_phi_operands(u, p.var, p.phi);
+    }
+    u->blocks[block].npending = 0;
+    u->blocks[block].sealed = 1;
+}
+
+/* ---- lowering ---- */
+
+static void ssa_root(SsaUnit *u, int v) {
+    if (u->nroots >= u->rootcap) {
+        u->rootcap = u->rootcap ? u->rootcap * 2 : 32;
+        u->roots = (int *)xrealloc(u->roots, sizeof(int) * (size_t)u->rootcap);
+    }
+    u->roots[u->nroots++] = v;
+}
+
+static void ssa_site(SsaUnit *u, ASTNode **slot, int v, SsaSiteKind kind) {
+    SsaSite *s;
+
+    if (u->nsites >= u->sitecap) {
+        u->sitecap = u->sitecap ? u->sitecap * 2 : 64;
+        u->sites = (SsaSite *)xrealloc(u->sites, sizeof(SsaSite) * (size_t)u->sitecap);
+    }
+    s = &u->sites[u->nsites++];
+    s->slot = slot;
+    s->value = v;
+    s->owner = u->owner;
+    s->next_owned = SSA_NONE;
+    s->kind = kind;
+    s->replaced = 0;
+}
+
+/* Variables a callee or caller may observe stay live here. */
+static void ssa_root_visible(SsaUnit *u) {
+    int i;
+    for (i = 0; i < u->nvars; i++) {
+        if (u->visible[i]) ssa_root(u, ssa_read(u, i, u->cur));
+    }
+}
+
+/* User code may rebind any global: they become unknown values. */
+static void ssa_clobber(SsaUnit *u) {
+    int i;
+    ssa_root_visible(u);
+    for (i = 0; i < u->nvars; i++) {
+        if (u->visible[i]) ssa_write(u, i, u->cur, ssa_opaque(u));
+    }
+}
+
+/* Value numbering onto a name: a variable that already holds `v` replaces the expression. */
+static void ssa_reuse(SsaUnit *u, ASTNode **slot, int v, int site_mark) {
+    int want = ssa_canon(u, v);
+    int i;
+
+    for (i = 0; i < u->nvars; i++) {
+        int d = u->blocks[u->cur].defs[i];
+        if (d == SSA_NONE) continue;
+        d = ssa_resolve(u, d);
+        if (u->values[d].kind != SSA_COPY || ssa_canon(u, d) != want) continue;
+        u->nsites = site_mark;
+        free_ast(*slot);
+        *slot = ast_ident(u->vars[i]);
+        g_pass_counts.eliminations++;
+        ssa_site(u, slot, d, SITE_READ);
+        return;
+    }
+}
+
+static int ssa_lower_expr(SsaUnit *u, ASTNode **slot) {
+    ASTNode *n = *slot;
+    int mark = u->nsites;
+    int args[3];
+    int v;
+    int i;
+
+    if (!n) return ssa_const_number(u, 0.0);
+    switch (n->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+            return ssa_const(u, n);
+        case AST_IDENTIFIER: {
+            int var = ssa_var_index(u, n->string);
+            v = ssa_read(u, var, u->cur);
+            ssa_site(u, slot, v, SITE_READ);
+            return v;
+        }
+        case AST_BINARY_OP:
+            args[0] = ssa_lower_expr(u, &n->binop.left);
+            if (!n->binop.right) {
+                v = ssa_op(u, n->binop.op, 0, args, 1);
+            } else {
+                args[1] = ssa_lower_expr(u, &n->binop.right);
+                v = ssa_op(u, n->binop.op, 0, args, 2);
+            }
+            ssa_reuse(u, slot, v, mark);
+            return v;
+        case AST_COND:
+            args[0] = ssa_lower_expr(u, &n->ifstmt.cond);
+            args[1] = ssa_lower_expr(u, &n->ifstmt.then_b);
+            args[2] = ssa_lower_expr(u, &n->ifstmt.else_b);
+            v = ssa_op(u, "?:", 0, args, 3);
+            ssa_reuse(u, slot, v, mark);
+            return v;
+        case AST_FUNCTION_CALL: {
+            int *cargs = (int *)xmalloc(sizeof(int) * (size_t)(n->funccall.arg_count + 1));
+            for (i = 0; i < n->funccall.arg_count; i++) cargs[i] = ssa_lower_expr(u, &n->funccall.args[i]);
+            if (ssa_call_runs_code(n)) {
+                ssa_clobber(u);
+                v = ssa_opaque(u);
+            } else if (ssa_value_call(n)) {
+                v = ssa_op(u, n->funccall.name, 1, cargs, n->funccall.arg_count);
+                free(cargs);
+                ssa_reuse(u, slot, v, mark);
+                return v;
+            } else {
+                v = ssa_opaque(u);
+            }
+            free(cargs);
+            return v;
+        }
+        case AST_INDEX:
+            ssa_lower_expr(u, &n->index.array);
+            ssa_lower_expr(u, &n->index.index);
+            return ssa_opaque(u);
+        case AST_ARRAY:
+            for (i = 0; i < n->arraylit.count; i++) ssa_lower_expr(u, &n->arraylit.items[i]);
+            return ssa_opaque(u);
+        default:
+            return ssa_opaque(u);
+    }
+}
+
+static int ssa_add_store(SsaUnit *u, ASTNode **slot) {
+    if (u->nstores >= u->storecap) {
+        u->storecap = u->storecap ? u->storecap * 2 : 32;
+        u->stores = (SsaStore *)xrealloc(u->stores, sizeof(SsaStore) * (size_t)u->storecap);
+    }
+    u->stores[u->nstores].slot = slot;
+    u->stores[u->nstores].copy = SSA_NONE;
+    u->stores[u->nstores].first_site = SSA_NONE;
+    return u->nstores++;
+}
+
+/* Lowers a branch condition; a side-effect free one may later be replaced by its constant. */
+static int ssa_lower_cond(SsaUnit *u, ASTNode **slot) {
+    int removable = ssa_removable(*slot);
+    int v = ssa_lower_expr(u, slot);
+    if (removable) ssa_site(u, slot, v, SITE_COND);
+    return v;
+}
+
+static void ssa_push_loop(SsaUnit *u, int brk, int cont) {
+    if (u->nloops >= u->loopcap) {
+        u->loopcap = u->loopcap ? u->loopcap * 2 : 8;
+        u->brk = (int *)xrealloc(u->brk, sizeof(int) * (size_t)u->loopcap);
+        u->cont = (int *)xrealloc(u->cont, sizeof(int) * (size_t)u->loopcap);
+    }
+    u->brk[u->nloops] = brk;
+    u->cont[u->nloops++] = cont;
+}
+
+static void ssa_lower_stmt(SsaUnit *u, ASTNode **slot) {
+    ASTNode *n = *slot;
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) ssa_lower_stmt(u, &n->statements.stmts[i]);
+            break;
+        case AST_LET:
+        case AST_ASSIGN: {
+            int saved = u->owner;
+            int store = SSA_NONE;
+            int v;
+            if (ssa_removable(n->var.value)) store = ssa_add_store(u, slot);
+            u->owner = store;
+            v = ssa_lower_expr(u, &n->var.value);
+            u->owner = saved;
+            v = ssa_copy(u, v);
+            if (store != SSA_NONE) {
+                u->stores[store].copy = v;
+                u->values[v].store = store;
+            }
+            ssa_write(u, ssa_var_index(u, n->var.name), u->cur, v);
+            break;
+        }
+        case AST_PRINT:
+            ssa_lower_expr(u, &n->print.expr);
+            break;
+        case AST_INDEX_ASSIGN:
+            ssa_lower_expr(u, &n->indexassign.array);
+            ssa_lower_expr(u, &n->indexassign.index);
+            ssa_lower_expr(u, &n->indexassign.value);
+            break;
+        case AST_IF: {
+            int c = ssa_lower_cond(u, &n->ifstmt.cond);
+            int then_b = ssa_new_block(u, 1);
+            int else_b = ssa_new_block(u, 1);
+            int join = ssa_new_block(u, 0);
+            ssa_branch(u, c, then_b, else_b);
+            u->cur = then_b;
+            ssa_lower_stmt(u, &n->ifstmt.then_b);
+            ssa_jump(u, join);
+            u->cur = else_b;
+            ssa_lower_stmt(u, &n->ifstmt.else_b);
+            ssa_jump(u, join);
+            ssa_seal(u, join);
+            u->cur = join;
+            break;
+        }
+        case AST_WHILE: {
+            int header = ssa_new_block(u, 0);
+            int body;
+            int exit_b;
+            int c;
+            ssa_jump(u, header);
+            u->cur = header;
+            c = ssa_lower_cond(u, &n->whilestmt.cond);
+            body = ssa_new_block(u, 1);
+            exit_b = ssa_new_block(u, 0);
+            ssa_branch(u, c, body, exit_b);
+            ssa_push_loop(u, exit_b, header);
+            u->cur = body;
+            ssa_lower_stmt(u, &n->whilestmt.body);
+            ssa_jump(u, header);
+            u->nloops--;
+            ssa_seal(u, header);
+            ssa_seal(u, exit_b);
+            u->cur = exit_b;
+            break;
+        }
+        case AST_FOR: {
+            int var = ssa_var_index(u, n->forstmt.var);
+            int header = ssa_new_block(u, 0);
+            int body;
+            int latch;
+            int exit_b;
+            int args[2];
+            ssa_write(u, var, u->cur, ssa_copy(u, ssa_lower_expr(u, &n->forstmt.start)));
+            ssa_jump(u, header);
+            u->cur = header;
+            args[1] = ssa_lower_expr(u, &n->forstmt.end);
+            args[0] = ssa_read(u, var, header);
+            ssa_root(u, args[0]);
+            body = ssa_new_block(u, 1);
+            latch = ssa_new_block(u, 0);
+            exit_b = ssa_new_block(u, 0);
+            ssa_branch(u, ssa_op(u, "<=", 0, args, 2), body, exit_b);
+            ssa_push_loop(u, exit_b, latch);
+            u->cur = body;
+            ssa_lower_stmt(u, &n->forstmt.body);
+            ssa_jump(u, latch);
+            u->nloops--;
+            ssa_seal(u, latch);
+            u->cur = latch;
+            args[0] = ssa_read(u, var, latch);
+            ssa_root(u, args[0]);
+            ssa_write(u, var, latch, ssa_copy(u, ssa_op(u, "inc", 0, args, 1)));
+            ssa_jump(u, header);
+            ssa_seal(u, header);
+            ssa_seal(u, exit_b);
+            u->cur = exit_b;
+            break;
+        }
+        case AST_BREAK:
+        case AST_CONTINUE:
+            if (u->nloops > 0) ssa_jump(u, n->type == AST_BREAK ? u->brk[u->nloops - 1] : u->cont[u->nloops - 1]);
+            u->cur = ssa_new_block(u, 1);
+            break;
+        case AST_RETURN:
+            ssa_lower_expr(u, &n->retstmt.expr);
+            if (u->in_function) ssa_root_visible(u);
+            u->cur = ssa_new_block(u, 1);
+            break;
+        case AST_FUNC_DEF:
+            break;
+        case AST_IMPORT_C:
+            ssa_clobber(u);
+            break;
+        default:
+            ssa_lower_expr(u, slot);
+            break;
+    }
+}
+
+/* ---- sparse conditional constant propagation ---- */
+
+static int ssa_set_lattice(SsaValue *v, SsaLattice lat, ASTNode *c) {
+    if (v->lat == LAT_BOTTOM || lat == LAT_TOP) {
+        free_ast(c);
+        return 0;
+    }
+    if (lat == LAT_CONST) {
+        if (v->lat == LAT_CONST) {
+            if (ssa_same_literal(v->cval, c)) {
+                free_ast(c);
+                return 0;
+            }
+        } else {
+            v->lat = LAT_CONST;
+            v->cval = c;
+            return 1;
+        }
+    }
+    free_ast(c);
+    free_ast(v->cval);
+    v->cval = NULL;
+    v->lat = LAT_BOTTOM;
+    return 1;
+}
+
+static int ssa_edge_exec(SsaUnit *u, int from, int to) {
+    SsaBlock *b = &u->blocks[from];
+    SsaValue *c;
+
+    if (!b->exec) return 0;
+    if (b->nsucc < 2) return 1;
+    c = &u->values[ssa_resolve(u, b->cond)];
+    if (c->lat == LAT_TOP) return 0;
+    if (c->lat == LAT_BOTTOM) return 1;
+    return ssa_truthy(c->cval) ? b->succ[0] == to : b->succ[1] == to;
+}
+
+/* Lattice meet of `v` into (*lat, *c); *c is borrowed. */
+static void ssa_meet(SsaUnit *u, int v, SsaLattice *lat, const ASTNode **c) {
+    const SsaValue *a = &u->values[ssa_resolve(u, v)];
+
+    if (a->lat == LAT_TOP || *lat == LAT_BOTTOM) return;
+    if (a->lat == LAT_BOTTOM) {
+        *lat = LAT_BOTTOM;
+    } else if (*lat == LAT_TOP) {
+        *lat = LAT_CONST;
+        *c = a->cval;
+    } else if (!ssa_same_literal(*c, a->cval)) {
+        *lat = LAT_BOTTOM;
+    }
+}
+
+static const SsaValue *ssa_arg(SsaUnit *u, const SsaValue *v, int i) {
+    return &u->values[ssa_resolve(u, v->args[i])];
+}
+
+/* Folds an operation whose operands are constants, through the AST folder. */
+static ASTNode *ssa_fold(const SsaValue *v, const SsaValue *a, const SsaValue *b) {
+    ASTNode *n = ast_binop(v->op, ast_clone(a->cval), b ? ast_clone(b->cval) : NULL);
+    PassCounts saved = g_pass_counts; /* a scratch tree; only a rewritten site counts as a fold */
+
+    n = optimize_node(n);
+    g_pass_counts = saved;
+    if (ssa_is_literal(n)) return n;
+    free_ast(n);
+    return NULL;
+}
+
+static int ssa_eval_op(SsaUnit *u, SsaValue *v) {
+    const SsaValue *a = v->argc > 0 ? ssa_arg(u, v, 0) : NULL;
+    const SsaValue *b = v->argc > 1 ? ssa_arg(u, v, 1) : NULL;
+    SsaLattice lat = LAT_TOP;
+    const ASTNode *c = NULL;
+    ASTNode *folded;
+    int i;
+
+    if (v->is_call) {
+        for (i = 0; i < v->argc; i++) {
+            if (ssa_arg(u, v, i)->lat == LAT_TOP) return 0;
+        }
+        return ssa_set_lattice(v, LAT_BOTTOM, NULL);
+    }
+    if (strcmp(v->op, "?:") == 0) {
+        if (a->lat == LAT_CONST) {
+            const SsaValue *pick = ssa_arg(u, v, ssa_truthy(a->cval) ? 1 : 2);
+            return ssa_set_lattice(v, pick->lat, pick->lat == LAT_CONST ? ast_clone(pick->cval) : NULL);
+        }
+        if (a->lat == LAT_TOP) return 0;
+        ssa_meet(u, v->args[1], &lat, &c);
+        ssa_meet(u, v->args[2], &lat, &c);
+        return ssa_set_lattice(v, lat, lat == LAT_CONST ? ast_clone(c) : NULL);
+    }
+    if (strcmp(v->op, "&&") == 0 || strcmp(v->op, "||") == 0) {
+        int is_and = v->op[0] == '&';
+        if (a->lat != LAT_CONST) return ssa_set_lattice(v, a->lat, NULL);
+        if (ssa_truthy(a->cval) != is_and) return ssa_set_lattice(v, LAT_CONST, ast_number(is_and ? 0.0 : 1.0));
+        if (b->lat != LAT_CONST) return ssa_set_lattice(v, b->lat, NULL);
+        return ssa_set_lattice(v, LAT_CONST, ast_number(ssa_truthy(b->cval) ? 1.0 : 0.0));
+    }
+    for (i = 0; i < v->argc; i++) {
+        if (ssa_arg(u, v, i)->lat == LAT_BOTTOM) return ssa_set_lattice(v, LAT_BOTTOM, NULL);
+    }
+    for (i = 0; i < v->argc; i++) {
+        if (ssa_arg(u, v, i)->lat == LAT_TOP) return 0;
+    }
+    if (strcmp(v->op, "inc") == 0) {
+        /* OP_INC adds to the number field, which only a number carries meaningfully. */
+        if (a->cval->type != AST_NUMBER) return ssa_set_lattice(v, LAT_BOTTOM, NULL);
+        return ssa_set_lattice(v, LAT_CONST, ast_number(a->cval->number + 1.0));
+    }
+    folded = ssa_fold(v, a, b);
+    return ssa_set_lattice(v, folded ? LAT_CONST : LAT_BOTTOM, folded);
+}
+
+static int ssa_eval(SsaUnit *u, int id) {
+    SsaValue *v = &u->values[id];
+    SsaLattice lat = LAT_TOP;
+    const ASTNode *c = NULL;
+    const SsaValue *src;
+    int i;
+
+    switch (v->kind) {
+        case SSA_CONST:
+            return ssa_set_lattice(v, LAT_CONST, ast_clone(v->lit));
+        case SSA_OPAQUE:
+            return ssa_set_lattice(v, LAT_BOTTOM, NULL);
+        case SSA_COPY:
+            src = ssa_arg(u, v, 0);
+            return ssa_set_lattice(v, src->lat, src->lat == LAT_CONST ? ast_clone(src->cval) : NULL);
+        case SSA_PHI:
+            if (v->forward != SSA_NONE) {
+                src = &u->values[ssa_resolve(u, id)];
+                return ssa_set_lattice(v, src->lat, src->lat == LAT_CONST ? ast_clone(src->cval) : NULL);
+            }
+            for (i = 0; i < v->argc; i++) {
+                if (ssa_edge_exec(u, u->blocks[v->block].preds[i], v->block)) ssa_meet(u, v->args[i], &lat, &c);
+            }
+            return ssa_set_lattice(v, lat, lat == LAT_CONST ? ast_clone(c) : NULL);
+        case SSA_OP:
+            return ssa_eval_op(u, v);
+    }
+    return 0;
+}
+
+/* Iterates block reachability and value lattices together to a fixed point. */
+static void ssa_propagate(SsaUnit *u) {
+    int changed = 1;
+    int b;
+    int i;
+
+    u->blocks[0].exec = 1;
+    while (changed) {
+        changed = 0;
+        for (b = 1; b < u->nblocks; b++) {
+            if (u->blocks[b].exec) continue;
+            for (i = 0; i < u->blocks[b].npreds; i++) {
+                if (ssa_edge_exec(u, u->blocks[b].preds[i], b)) {
+                    u->blocks[b].exec = 1;
+                    changed = 1;
+                    break;
+                }
+            }
+        }
+        /* Numbered values are shared between blocks, so all are evaluated; only phis look at edges. */
+        for (i = 0; i < u->nvalues; i++) changed |= ssa_eval(u, i);
+    }
+}
+
+/* ---- liveness and rewriting ---- */
+
+static void ssa_mark_live(SsaUnit *u, int v, int **stack, int *count, int *cap) {
+    v = ssa_resolve(u, v);
+    if (u->values[v].live) return;
+    u->values[v].live = 1;
+    if (*count >= *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *stack = (int *)xrealloc(*stack, sizeof(int) * (size_t)*cap);
+    }
+    (*stack)[(*count)++] = v;
+}
+
+/* A store is needed when a remaining read, a call or the function's exit can observe it. */
+static void ssa_liveness(SsaUnit *u) {
+    int *stack = NULL;
+    int count = 0;
+    int cap = 0;
+    int i;
+
+    for (i = 0; i < u->nsites; i++) {
+        SsaSite *s = &u->sites[i];
+        if (s->kind != SITE_READ || s->replaced) continue;
+        if (s->owner == SSA_NONE) {
+            ssa_mark_live(u, s->value, &stack, &count, &cap);
+        } else {
+            s->next_owned = u->stores[s->owner].first_site;
+            u->stores[s->owner].first_site = i;
+        }
+    }
+    for (i = 0; i < u->nroots; i++) ssa_mark_live(u, u->roots[i], &stack, &count, &cap);
+    while (count > 0) {
+        SsaValue *v = &u->values[stack[--count]];
+        int k;
+        if (v->kind == SSA_PHI || v->kind == SSA_COPY) {
+            for (k = 0; k < v->argc; k++) ssa_mark_live(u, v->args[k], &stack, &count, &cap);
+        }
+        if (v->kind == SSA_COPY && v->store != SSA_NONE) {
+            for (k = u->stores[v->store].first_site; k != SSA_NONE; k = u->sites[k].next_owned) {
+                ssa_mark_live(u, u->sites[k].value, &stack, &count, &cap);
+            }
+        }
+    }
+    free(stack);
+}
+
+static void ssa_rewrite(SsaUnit *u) {
+    int i;
+
+    for (i = 0; i < u->nsites; i++) {
+        SsaSite *s = &u->sites[i];
+        const SsaValue *v = &u->values[ssa_resolve(u, s->value)];
+        if (v->lat != LAT_CONST || ssa_is_literal(*s->slot)) continue;
+        free_ast(*s->slot);
+        *s->slot = ast_clone(v->cval);
+        s->replaced = 1;
+        g_pass_counts.folds++;
+    }
+    ssa_liveness(u);
+    for (i = 0; i < u->nstores; i++) {
+        SsaStore *st = &u->stores[i];
+        if (u->values[st->copy].live) continue;
+        free_ast(*st->slot);
+        *st->slot = ast_statements(NULL, 0);
+        g_pass_counts.eliminations++;
+    }
+}
+
+static void ssa_unit_free(SsaUnit *u) {
+    int i;
+
+    for (i = 0; i < u->nvalues; i++) {
+        free(u->values[i].op);
+        free(u->values[i].args);
+        free_ast(u->values[i].lit);
+        free_ast(u->values[i].cval);
+    }
+    for (i = 0; i < u->nblocks; i++) {
+        free(u->blocks[i].preds);
+        free(u->blocks[i].defs);
+        free(u->blocks[i].pending);
+    }
+    for (i = 0; i < u->nvars; i++) free(u->vars[i]);
+    free(u->values);
+    free(u->blocks);
+    free(u->vars);
+    free(u->visible);
+    free(u->table);
+    free(u->sites);
+    free(u->stores);
+    free(u->roots);
+    free(u->brk);
+    free(u->cont);
+}
+
+/* Runs the SSA passes over one body: a function's (with its parameters) or the program's. */
+static void ssa_optimize_unit(ASTNode **body, char **params, int param_count, int in_function) {
+    SsaUnit u;
+    int i;
+
+    memset(&u, 0, sizeof(u));
+    u.in_function = in_function;
+    u.owner = SSA_NONE;
+    for (i = 0; i < param_count; i++) ssa_add_var(&u, params[i]);
+    ssa_collect_vars(&u, *body);
+    if (in_function) {
+        /* Frame locals are private to the call; only names top-level code binds can be globals. */
+        for (i = 0; i < u.nvars; i++) {
+            u.visible[i] = i >= param_count && name_listed(g_ssa_globals, g_ssa_global_count, u.vars[i]);
+        }
+    }
+    u.cur = ssa_new_block(&u, 1);
+    ssa_lower_stmt(&u, body);
+    if (in_function) ssa_root_visible(&u);
+    ssa_propagate(&u);
+    ssa_rewrite(&u);
+    ssa_unit_free(&u);
+}
+
+static void ssa_optimize_functions(ASTNode *n) {
+    int i;
+
+    if (!n) return;
+    switch (n->type) {
+        case AST_STATEMENTS:
+            for (i = 0; i < n->statements.count; i++) ssa_optimize_functions(n->statements.stmts[i]);
+            break;
+        case AST_FUNC_DEF:
+            ssa_optimize_unit(&n->funcdef.body, n->funcdef.params, n->funcdef.param_count, 1);
+            ssa_optimize_functions(n->funcdef.body);
+            break;
+        case AST_IF:
+            ssa_optimize_functions(n->ifstmt.then_b);
+            ssa_optimize_functions(n->ifstmt.else_b);
+            break;
+        case AST_WHILE:
+            ssa_optimize_functions(n->whilestmt.body);
+            break;
+        case AST_FOR:
+            ssa_optimize_functions(n->forstmt.body);
+            break;
+        default:
+            break;
+    }
+}
+
+ASTNode *ssa_optimize(ASTNode *root) {
+    if (!root) return root;
+    ssa_collect_names(root, 1);
+    ssa_optimize_functions(root);
+    ssa_optimize_unit(&root, NULL, 0, 0);
+    name_list_free(&g_ssa_funcs, &g_ssa_func_count);
+    name_list_free(&g_ssa_globals, &g_ssa_global_count);
+    return root;
+}
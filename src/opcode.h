@@ -42,7 +42,46 @@ typedef enum {
     OP_DEC,
     OP_IADD_VAR,
 
-    OP_HALT
+    OP_HALT,
+
+    OP_TAILCALL,
+
+    OP_LEN,
+    OP_APPEND,
+    OP_ABS,
+    OP_FLOOR,
+    OP_SQRT,
+    OP_SIN,
+    OP_COS,
+    OP_MINMAX,
+
+    OP_IOP,
+    OP_IOP_CONST,
+    OP_IOP_VAR,
+    OP_INDEX_IOP,
+
+    OP_JMP_IF_TRUE,
+
+    OP_INDEX_GUARD,
+    OP_INDEX_GET_UNCHECKED,
+    OP_INDEX_SET_UNCHECKED,
+
+    OP_ADD_NUM,
+    OP_EQ_NUM,
+    OP_NEQ_NUM,
+
+    OP_STORE_KEEP,
+
+    OP_ARRAY_NEW_FRAME,
+    OP_SLICE_FRAME,
+
+    OP_VEC_MAP,
+    OP_VEC_GUARD,
+    OP_REDUCE_SUM,
+    OP_REDUCE_PRODUCT,
+    OP_REDUCE_MIN,
+    OP_REDUCE_MAX,
+    OP_DOT
 } OpCode;
 
 #endif
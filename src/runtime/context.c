@@ -1,4 +1,5 @@
-static Value vm_stack[VM_STACK_MAX];
+static Value vm_stack_storage[VM_STACK_MAX + 1];
+static Value *const vm_stack = vm_stack_storage + 1;
 static int vm_sp = 0;
 static uint32_t vm_ip = 0;
 
@@ -8,6 +9,23 @@ static uint8_t vm_frame_epoch[VAR_STACK_MAX];
 static CallFrame vm_callstack[CALLSTACK_MAX];
 static int vm_callsp = 0;
 
+/*
+ * Bump region for arrays spbuild proved never outlive the call that makes
+ * them (OP_ARRAY_NEW_FRAME, OP_SLICE_FRAME). vm_frame_mark[f] is where frame
+ * f's allocations start; leaving or reusing the frame drops everything above.
+ */
+typedef union {
+    double number;
+    void *pointer;
+    long long integer;
+} SpliceRegionCell;
+
+#define SPLICE_FRAME_REGION_CELLS (SPLICE_FRAME_REGION_SIZE / sizeof(SpliceRegionCell))
+
+static SpliceRegionCell vm_frame_region[SPLICE_FRAME_REGION_CELLS];
+static size_t vm_frame_top = 0;
+static size_t vm_frame_mark[VAR_STACK_MAX];
+
 static Value value_number(double n) {
     Value v = { VAL_NUMBER, n, NULL, NULL };
     return v;
@@ -19,6 +37,40 @@ static int value_truthy(Value v) {
     return v.number != 0.0;
 }
 
+/* NULL when the region is full; callers fall back to the heap. */
+static void *splice_frame_alloc(size_t bytes) {
+    size_t cells = (bytes + sizeof(SpliceRegionCell) - 1u) / sizeof(SpliceRegionCell);
+    void *p;
+
+    if (cells > SPLICE_FRAME_REGION_CELLS - vm_frame_top) return NULL;
+    p = &vm_frame_region[vm_frame_top];
+    vm_frame_top += cells;
+    return p;
+}
+
+static int splice_frame_owns(const void *p) {
+    uintptr_t at = (uintptr_t)p;
+    uintptr_t base = (uintptr_t)vm_frame_region;
+    return p && at >= base && at < base + sizeof(vm_frame_region);
+}
+
+/* An empty array with room for `capacity` items, all in the region, or NULL. */
+static ObjArray *splice_frame_array(size_t capacity) {
+    size_t head = (sizeof(ObjArray) + sizeof(SpliceRegionCell) - 1u) / sizeof(SpliceRegionCell) * sizeof(SpliceRegionCell);
+    unsigned char *block;
+    ObjArray *oa;
+
+    if (!splice_array_capacity_valid(capacity) || !splice_allocation_fits(capacity, sizeof(Value))) return NULL;
+    block = (unsigned char *)splice_frame_alloc(head + sizeof(Value) * capacity);
+    if (!block) return NULL;
+    oa = (ObjArray *)block;
+    oa->type = OBJ_ARRAY;
+    oa->count = 0;
+    oa->capacity = (int)capacity;
+    oa->items = capacity > 0 ? (Value *)(block + head) : NULL;
+    return oa;
+}
+
 static int splice_array_reserve(ObjArray *oa, size_t min_capacity) {
     size_t cap;
     size_t newcap;
@@ -41,8 +93,16 @@ static int splice_array_reserve(ObjArray *oa, size_t min_capacity) {
     }
     if (newcap < min_capacity || !splice_allocation_fits(newcap, sizeof(Value))) return 0;
 
-    ni = (Value *)realloc(oa->items, sizeof(Value) * newcap);
-    if (!ni) return 0;
+    if (splice_frame_owns(oa->items)) {
+        /* Region items cannot be realloc'ed. Only the owning frame can reach the array, so it is on top. */
+        ni = (Value *)splice_frame_alloc(sizeof(Value) * newcap);
+        if (!ni) ni = (Value *)malloc(sizeof(Value) * newcap);
+        if (!ni) return 0;
+        memcpy(ni, oa->items, sizeof(Value) * cap);
+    } else {
+        ni = (Value *)realloc(oa->items, sizeof(Value) * newcap);
+        if (!ni) return 0;
+    }
     oa->items = ni;
     oa->capacity = (int)newcap;
     return 1;
@@ -53,5 +113,6 @@ static void splice_reset_vm(void) {
     vm_ip = 0;
     var_stack_depth = 0;
     memset(vm_frame_epoch, 0, sizeof(vm_frame_epoch));
+    vm_frame_top = 0;
     vm_callsp = 0;
 }
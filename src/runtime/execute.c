@@ -1,15 +1,41 @@
-static inline void vm_push_fast(int *sp, Value v) {
+/*
+ * The interpreter keeps the top of stack in a local (`tos`) and vm_stack only
+ * holds the entries below it, so vm_stack[sp - 1] is stale while sp > 0.
+ * vm_stack[-1] is a spare slot, which lets a push spill unconditionally.
+ */
+static inline void vm_push_fast(int *sp, Value *tos, Value v) {
 #ifndef NDEBUG
     if (*sp >= VM_STACK_MAX) SPLICE_FAIL("STACK_OVERFLOW");
 #endif
-    vm_stack[(*sp)++] = v;
+    vm_stack[*sp - 1] = *tos;
+    *tos = v;
+    (*sp)++;
 }
 
-static inline Value vm_pop_fast(int *sp) {
+static inline Value vm_pop_fast(int *sp, Value *tos) {
+    Value v = *tos;
 #ifndef NDEBUG
     if (*sp <= 0) SPLICE_FAIL("STACK_UNDERFLOW");
 #endif
-    return vm_stack[--(*sp)];
+    (*sp)--;
+    *tos = vm_stack[*sp - 1];
+    return v;
+}
+
+/* Drops the entry under tos and returns it; the caller writes the result into tos. */
+static inline Value vm_take_second_fast(int *sp) {
+#ifndef NDEBUG
+    if (*sp < 2) SPLICE_FAIL("STACK_UNDERFLOW");
+#endif
+    (*sp)--;
+    return vm_stack[*sp - 1];
+}
+
+static inline uint8_t fetch_u8_fast(const BytecodeProgram *p, uint32_t *ip) {
+#ifndef NDEBUG
+    if (*ip + 1 > p->code_size) SPLICE_FAIL("IP_OOB");
+#endif
+    return p->code[(*ip)++];
 }
 
 static inline uint16_t fetch_u16_fast(const BytecodeProgram *p, uint32_t *ip) {
@@ -33,9 +59,31 @@ static inline uint32_t fetch_u32_fast(const BytecodeProgram *p, uint32_t *ip) {
     return v;
 }
 
+/* Shared by the in-place opcodes; `op` is one of OP_ADD..OP_MOD. */
+static Value splice_arith(uint8_t op, Value a, Value b) {
+    switch (op) {
+        case OP_ADD:
+            if (a.type == VAL_STRING && b.type == VAL_STRING) return splice_string_concat(a, b);
+            return value_number(a.number + b.number);
+        case OP_SUB: return value_number(a.number - b.number);
+        case OP_MUL: return value_number(a.number * b.number);
+        case OP_DIV: return value_number(a.number / b.number);
+        case OP_MOD: {
+            int bi = (int)b.number;
+            if (bi == 0) SPLICE_FAIL("MOD_ZERO");
+            return value_number((double)((int)a.number % bi));
+        }
+        default:
+            SPLICE_FAIL("BAD_OPCODE");
+    }
+    return value_number(0.0);
+}
+
 static int splice_execute_bytecode(const unsigned char *data, size_t size) {
     BytecodeProgram prog;
+    SpliceProfile *prof;
     if (!load_program(data, size, &prog)) return 0;
+    prof = splice_profile_begin(&prog);
 
     splice_reset_vm();
 
@@ -44,15 +92,20 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
         uint32_t ip = vm_ip;
         int callsp = vm_callsp;
         int depth = var_stack_depth;
+        Value tos = vm_stack[sp - 1];
 
-#define vm_push(v) vm_push_fast(&sp, (v))
-#define vm_pop() vm_pop_fast(&sp)
+#define vm_push(v) vm_push_fast(&sp, &tos, (v))
+#define vm_pop() vm_pop_fast(&sp, &tos)
+#define vm_second() vm_take_second_fast(&sp)
+#define VM_FLUSH_TOS() (vm_stack[sp - 1] = tos)
+#define VM_RELOAD_TOS() (tos = vm_stack[sp - 1])
+#define fetch_u8(p) fetch_u8_fast((p), &ip)
 #define fetch_u16(p) fetch_u16_fast((p), &ip)
 #define fetch_u32(p) fetch_u32_fast((p), &ip)
 #define vm_ip ip
 #define vm_callsp callsp
 #define var_stack_depth depth
-#define SYNC_VM_STATE() do { vm_sp = sp; vm_ip = ip; vm_callsp = callsp; var_stack_depth = depth; } while (0)
+#define SYNC_VM_STATE() do { VM_FLUSH_TOS(); vm_sp = sp; vm_ip = ip; vm_callsp = callsp; var_stack_depth = depth; } while (0)
 
         while (vm_ip < prog.code_size) {
             OpCode op = (OpCode)prog.code[vm_ip++];
@@ -87,11 +140,13 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
                     vm_push(prog.global_used[idx] ? prog.global_values[idx] : value_number(0.0));
                     break;
                 }
-                case OP_STORE: {
+                case OP_STORE:
+                case OP_STORE_KEEP: {
+                    /* OP_STORE_KEEP leaves the value on the stack: a store followed by a load of it. */
                     uint16_t idx = fetch_u16(&prog);
                     Value v;
                     if (idx >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                    v = vm_pop();
+                    v = (op == OP_STORE_KEEP) ? tos : vm_pop();
                     if (var_stack_depth > 0) {
                         size_t frame = (size_t)var_stack_depth - 1u;
                         size_t off = frame * prog.symbol_count + idx;
@@ -113,116 +168,116 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
                     (void)vm_pop();
                     break;
                 case OP_ADD: {
-                    Value b = vm_pop();
-                    Value a = vm_pop();
-                    if (a.type == VAL_STRING && b.type == VAL_STRING) {
-                        size_t la = strlen(a.string ? a.string : "");
-                        size_t lb = strlen(b.string ? b.string : "");
-                        char *s = splice_strdup_owned("");
-                        s = (char *)realloc(s, la + lb + 1u);
-                        if (!s) SPLICE_FAIL("OOM");
-                        memcpy(s, a.string ? a.string : "", la);
-                        memcpy(s + la, b.string ? b.string : "", lb);
-                        s[la + lb] = 0;
-                        vm_push(value_string(s));
-                    } else {
-                        vm_push(value_number(a.number + b.number));
-                    }
+                    Value a = vm_second();
+                    if (a.type == VAL_STRING && tos.type == VAL_STRING) tos = splice_string_concat(a, tos);
+                    else tos = value_number(a.number + tos.number);
                     break;
                 }
-                case OP_SUB: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number - b.number)); break; }
-                case OP_MUL: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number * b.number)); break; }
-                case OP_DIV: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number / b.number)); break; }
+                /* Emitted when spbuild proves an operand is not a string. */
+                case OP_ADD_NUM: { Value a = vm_second(); tos = value_number(a.number + tos.number); break; }
+                case OP_EQ_NUM: { Value a = vm_second(); tos = value_number(a.number == tos.number ? 1.0 : 0.0); break; }
+                case OP_NEQ_NUM: { Value a = vm_second(); tos = value_number(a.number != tos.number ? 1.0 : 0.0); break; }
+                case OP_SUB: { Value a = vm_second(); tos = value_number(a.number - tos.number); break; }
+                case OP_MUL: { Value a = vm_second(); tos = value_number(a.number * tos.number); break; }
+                case OP_DIV: { Value a = vm_second(); tos = value_number(a.number / tos.number); break; }
                 case OP_MOD: {
-                    Value b = vm_pop();
-                    Value a = vm_pop();
-                    int bi = (int)b.number;
+                    Value a = vm_second();
+                    int bi = (int)tos.number;
                     if (bi == 0) SPLICE_FAIL("MOD_ZERO");
-                    vm_push(value_number((double)((int)a.number % bi)));
+                    tos = value_number((double)((int)a.number % bi));
                     break;
                 }
-                case OP_NEG: { Value a = vm_pop(); vm_push(value_number(-a.number)); break; }
-                case OP_EQ: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(value_eq(a, b) ? 1.0 : 0.0)); break; }
-                case OP_NEQ: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(value_eq(a, b) ? 0.0 : 1.0)); break; }
-                case OP_LT: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number < b.number ? 1.0 : 0.0)); break; }
-                case OP_GT: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number > b.number ? 1.0 : 0.0)); break; }
-                case OP_LTE: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number <= b.number ? 1.0 : 0.0)); break; }
-                case OP_GTE: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number(a.number >= b.number ? 1.0 : 0.0)); break; }
+                case OP_NEG: tos = value_number(-tos.number); break;
+                case OP_EQ: { Value a = vm_second(); tos = value_number(value_eq(a, tos) ? 1.0 : 0.0); break; }
+                case OP_NEQ: { Value a = vm_second(); tos = value_number(value_eq(a, tos) ? 0.0 : 1.0); break; }
+                case OP_LT: { Value a = vm_second(); tos = value_number(a.number < tos.number ? 1.0 : 0.0); break; }
+                case OP_GT: { Value a = vm_second(); tos = value_number(a.number > tos.number ? 1.0 : 0.0); break; }
+                case OP_LTE: { Value a = vm_second(); tos = value_number(a.number <= tos.number ? 1.0 : 0.0); break; }
+                case OP_GTE: { Value a = vm_second(); tos = value_number(a.number >= tos.number ? 1.0 : 0.0); break; }
                 case OP_JMP: {
                     uint32_t addr = fetch_u32(&prog);
                     if (addr > prog.code_size) SPLICE_FAIL("JMP_OOB");
+                    if (prof) splice_profile_jump(prof, vm_ip - 5u, addr, 0, 1);
                     vm_ip = addr;
                     break;
                 }
                 case OP_JMP_IF_FALSE: {
                     uint32_t addr = fetch_u32(&prog);
-                    if (!value_truthy(vm_pop())) {
+                    int jump = !value_truthy(vm_pop());
+                    if (prof) splice_profile_jump(prof, vm_ip - 5u, addr, 1, jump);
+                    if (jump) {
+                        if (addr > prog.code_size) SPLICE_FAIL("JMP_OOB");
+                        vm_ip = addr;
+                    }
+                    break;
+                }
+                case OP_JMP_IF_TRUE: {
+                    uint32_t addr = fetch_u32(&prog);
+                    int jump = value_truthy(vm_pop());
+                    if (prof) splice_profile_jump(prof, vm_ip - 5u, addr, 1, jump);
+                    if (jump) {
                         if (addr > prog.code_size) SPLICE_FAIL("JMP_OOB");
                         vm_ip = addr;
                     }
                     break;
                 }
                 case OP_CALL:
-                case OP_CALL1: {
+                case OP_CALL1:
+                case OP_TAILCALL: {
+                    uint32_t at = vm_ip - 1u;
                     uint16_t symbol = fetch_u16(&prog);
                     uint16_t argc = (op == OP_CALL1) ? 1u : fetch_u16(&prog);
                     FunctionEntry *fn;
+                    Value *args;
 
-                    if (argc > VM_ARG_MAX) SPLICE_FAIL("ARGC_OOB");
+                    if ((int)argc > sp) SPLICE_FAIL("ARGC_OOB");
                     if (symbol >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
+                    /* Arguments stay where the caller pushed them; both paths read this window. */
+                    VM_FLUSH_TOS();
+                    args = vm_stack + (sp - (int)argc);
+                    sp -= (int)argc;
+                    VM_RELOAD_TOS();
                     fn = find_function(&prog, symbol);
+                    if (prof) splice_profile_call(prof, &prog, at, fn, (int)argc, args);
                     if (!fn) {
-                        Value argv[VM_ARG_MAX];
-                        for (int i = (int)argc - 1; i >= 0; i--) argv[i] = vm_pop();
-                        vm_push(call_builtin_or_native(prog.symbols[symbol], (int)argc, argv));
+                        vm_push(call_builtin_or_native(prog.symbols[symbol], (int)argc, args));
                         break;
                     }
 
-                    if (vm_callsp >= CALLSTACK_MAX) SPLICE_FAIL("CALLSTACK_OOM");
-                    if (var_stack_depth >= VAR_STACK_MAX) SPLICE_FAIL("VARSTACK_OOM");
-                    vm_callstack[vm_callsp++].return_ip = vm_ip;
-
                     {
-                        size_t frame = (size_t)var_stack_depth++;
-                        uint8_t epoch = (uint8_t)(vm_frame_epoch[frame] + 1u);
+                        size_t frame;
+                        size_t base;
+                        uint8_t epoch;
+                        uint16_t limit = fn->param_count < argc ? fn->param_count : argc;
+
+                        if (op == OP_TAILCALL && var_stack_depth > 0) {
+                            /* Reuse the caller's frame; the new epoch below drops its locals and this its region. */
+                            frame = (size_t)var_stack_depth - 1u;
+                            vm_frame_top = vm_frame_mark[frame];
+                        } else {
+                            if (vm_callsp >= CALLSTACK_MAX) SPLICE_FAIL("CALLSTACK_OOM");
+                            if (var_stack_depth >= VAR_STACK_MAX) SPLICE_FAIL("VARSTACK_OOM");
+                            vm_callstack[vm_callsp++].return_ip = vm_ip;
+                            frame = (size_t)var_stack_depth++;
+                            vm_frame_mark[frame] = vm_frame_top;
+                        }
+
+                        epoch = (uint8_t)(vm_frame_epoch[frame] + 1u);
                         if (epoch == 0) {
                             memset(prog.frame_stamp + frame * prog.symbol_count, 0, prog.symbol_count);
                             epoch = 1;
                         }
                         vm_frame_epoch[frame] = epoch;
 
-                        if (op == OP_CALL1) {
-                            if (fn->param_count > 0) {
-                                if (fn->params[0] >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                                prog.frame_stamp[frame * prog.symbol_count + fn->params[0]] = epoch;
-                                prog.frame_values[frame * prog.symbol_count + fn->params[0]] = vm_pop();
-                                for (uint16_t i = 1; i < fn->param_count; i++) {
-                                    size_t off;
-                                    if (fn->params[i] >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                                    off = frame * prog.symbol_count + fn->params[i];
-                                    prog.frame_stamp[off] = epoch;
-                                    prog.frame_values[off] = value_number(0.0);
-                                }
-                            } else {
-                                (void)vm_pop();
-                            }
-                        } else {
-                            int limit = fn->param_count < argc ? fn->param_count : argc;
-                            for (int i = (int)argc - 1; i >= limit; i--) (void)vm_pop();
-                            for (int i = limit - 1; i >= 0; i--) {
-                                size_t off;
-                                if (fn->params[i] >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                                off = frame * prog.symbol_count + fn->params[i];
-                                prog.frame_stamp[off] = epoch;
-                                prog.frame_values[off] = vm_pop();
-                            }
-                            for (uint16_t i = (uint16_t)limit; i < fn->param_count; i++) {
-                                size_t off;
-                                if (fn->params[i] >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                                off = frame * prog.symbol_count + fn->params[i];
-                                prog.frame_stamp[off] = epoch;
-                                prog.frame_values[off] = value_number(0.0);
-                            }
+                        /* Parameter symbols are range-checked once in load_program. */
+                        base = frame * prog.symbol_count;
+                        for (uint16_t i = 0; i < limit; i++) {
+                            prog.frame_stamp[base + fn->params[i]] = epoch;
+                            prog.frame_values[base + fn->params[i]] = args[i];
+                        }
+                        for (uint16_t i = limit; i < fn->param_count; i++) {
+                            prog.frame_stamp[base + fn->params[i]] = epoch;
+                            prog.frame_values[base + fn->params[i]] = value_number(0.0);
                         }
                     }
 
@@ -234,47 +289,127 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
                     if (vm_callsp <= 0) {
                         vm_push(ret);
                         SYNC_VM_STATE();
+                        splice_profile_finish(&prog);
                         free_program(&prog);
                         return 1;
                     }
                     vm_callsp--;
                     vm_ip = vm_callstack[vm_callsp].return_ip;
-                    if (var_stack_depth > 0) var_stack_depth--;
+                    if (var_stack_depth > 0) {
+                        var_stack_depth--;
+                        vm_frame_top = vm_frame_mark[var_stack_depth];
+                    }
                     vm_push(ret);
                     break;
                 }
                 case OP_PRINT: splice_print_value(vm_pop()); break;
-                case OP_NOT: { Value v = vm_pop(); vm_push(value_number(value_truthy(v) ? 0.0 : 1.0)); break; }
-                case OP_AND: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number((value_truthy(a) && value_truthy(b)) ? 1.0 : 0.0)); break; }
-                case OP_OR: { Value b = vm_pop(); Value a = vm_pop(); vm_push(value_number((value_truthy(a) || value_truthy(b)) ? 1.0 : 0.0)); break; }
-                case OP_ARRAY_NEW: {
+                case OP_NOT: tos = value_number(value_truthy(tos) ? 0.0 : 1.0); break;
+                case OP_AND: { Value a = vm_second(); tos = value_number((value_truthy(a) && value_truthy(tos)) ? 1.0 : 0.0); break; }
+                case OP_OR: { Value a = vm_second(); tos = value_number((value_truthy(a) || value_truthy(tos)) ? 1.0 : 0.0); break; }
+                case OP_ARRAY_NEW:
+                case OP_ARRAY_NEW_FRAME: {
+                    /* OP_ARRAY_NEW_FRAME: spbuild proved the array dies with this call; the heap is the fallback. */
                     uint16_t count = fetch_u16(&prog);
                     size_t array_capacity = count > 0 ? (size_t)count : 4u;
-                    ObjArray *oa = (ObjArray *)malloc(sizeof(ObjArray));
-                    if (!oa) SPLICE_FAIL("ARRAY_OOM");
-                    oa->type = OBJ_ARRAY;
-                    oa->count = (int)count;
-                    oa->capacity = (int)array_capacity;
-                    if (!splice_array_capacity_valid(array_capacity) || !splice_allocation_fits(array_capacity, sizeof(Value))) {
-                        SPLICE_FAIL("ARRAY_OOM");
+                    ObjArray *oa = (op == OP_ARRAY_NEW_FRAME) ? splice_frame_array(array_capacity) : NULL;
+                    if (!oa) {
+                        oa = (ObjArray *)malloc(sizeof(ObjArray));
+                        if (!oa) SPLICE_FAIL("ARRAY_OOM");
+                        oa->type = OBJ_ARRAY;
+                        oa->capacity = (int)array_capacity;
+                        if (!splice_array_capacity_valid(array_capacity) || !splice_allocation_fits(array_capacity, sizeof(Value))) {
+                            SPLICE_FAIL("ARRAY_OOM");
+                        }
+                        oa->items = (Value *)malloc(sizeof(Value) * array_capacity);
+                        if (!oa->items) SPLICE_FAIL("ARRAY_OOM");
                     }
-                    oa->items = (Value *)malloc(sizeof(Value) * array_capacity);
-                    if (!oa->items) SPLICE_FAIL("ARRAY_OOM");
+                    oa->count = (int)count;
                     for (int i = (int)count - 1; i >= 0; i--) oa->items[i] = vm_pop();
                     vm_push(((Value){ VAL_OBJECT, 0.0, NULL, oa }));
                     break;
                 }
+                case OP_VEC_MAP: {
+                    /* Start, end, destination, sources and scalars lie under the program string (vector.c). */
+                    Value progv = vm_pop();
+                    int argc = splice_vec_arg_count(progv);
+                    Value *args;
+                    if (argc < 0 || argc > sp) SPLICE_FAIL("VEC_PROGRAM");
+                    VM_FLUSH_TOS();
+                    args = vm_stack + (sp - argc);
+                    sp -= argc;
+                    VM_RELOAD_TOS();
+                    vm_push(splice_vec_map(progv.string, args));
+                    break;
+                }
+                case OP_VEC_GUARD: {
+                    /* Accumulator, start, end and the arrays of the reduction it guards. */
+                    int argc = 3 + (int)fetch_u8(&prog);
+                    int ok;
+                    if (argc > sp) SPLICE_FAIL("ARGC_OOB");
+                    VM_FLUSH_TOS();
+                    ok = splice_vec_guard(vm_stack + (sp - argc), argc - 3);
+                    sp -= argc;
+                    VM_RELOAD_TOS();
+                    vm_push(value_number(ok ? 1.0 : 0.0));
+                    break;
+                }
+                case OP_REDUCE_SUM:
+                case OP_REDUCE_PRODUCT:
+                case OP_REDUCE_MIN:
+                case OP_REDUCE_MAX:
+                case OP_DOT: {
+                    /* Accumulator, start, end and the array (two for OP_DOT); only emitted under OP_VEC_GUARD. */
+                    int argc = op == OP_DOT ? 5 : 4;
+                    Value *args;
+                    VM_FLUSH_TOS();
+                    args = vm_stack + (sp - argc);
+                    sp -= argc;
+                    VM_RELOAD_TOS();
+                    vm_push(splice_reduce(op, args));
+                    break;
+                }
+                case OP_SLICE_FRAME: {
+                    Value lo = vm_second();
+                    Value arrv = vm_second();
+                    tos = splice_builtin_slice(arrv, lo, tos, 1);
+                    break;
+                }
                 case OP_INDEX_GET: {
-                    Value idxv = vm_pop();
-                    Value arrv = vm_pop();
+                    Value arrv = vm_second();
+                    Value idxv = tos;
                     if (arrv.type != VAL_OBJECT || !arrv.object) {
-                        vm_push(value_number(0.0));
+                        tos = value_number(0.0);
                     } else {
                         ObjArray *oa = (ObjArray *)arrv.object;
                         int idx = (int)idxv.number;
-                        if (idx < 0 || idx >= oa->count) vm_push(value_number(0.0));
-                        else vm_push(oa->items[idx]);
+                        if (idx < 0 || idx >= oa->count) tos = value_number(0.0);
+                        else tos = oa->items[idx];
+                    }
+                    break;
+                }
+                case OP_INDEX_GUARD: {
+                    /* Array, lowest and highest index: true if every index in between is in bounds. */
+                    Value lo = vm_second();
+                    Value arrv = vm_second();
+                    int ok = 0;
+                    if (arrv.type == VAL_OBJECT && arrv.object && lo.type == VAL_NUMBER && tos.type == VAL_NUMBER) {
+                        ObjArray *oa = (ObjArray *)arrv.object;
+                        ok = lo.number >= 0.0 && tos.number < (double)oa->count;
                     }
+                    tos = value_number(ok ? 1.0 : 0.0);
+                    break;
+                }
+                case OP_INDEX_GET_UNCHECKED: {
+                    /* Only emitted under a passing OP_INDEX_GUARD; arrays never shrink. */
+                    Value arrv = vm_second();
+                    tos = ((ObjArray *)arrv.object)->items[(int)tos.number];
+                    break;
+                }
+                case OP_INDEX_SET_UNCHECKED: {
+                    Value val = vm_pop();
+                    Value idxv = vm_pop();
+                    Value arrv = vm_pop();
+                    ((ObjArray *)arrv.object)->items[(int)idxv.number] = val;
                     break;
                 }
                 case OP_INDEX_SET: {
@@ -305,70 +440,101 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
                 case OP_INC:
                 case OP_DEC: {
                     uint16_t idx = fetch_u16(&prog);
+                    Value *slot;
                     if (idx >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                    {
-                        double delta = (op == OP_INC) ? 1.0 : -1.0;
-                        if (var_stack_depth > 0) {
-                            size_t frame = (size_t)var_stack_depth - 1u;
-                            size_t off = frame * prog.symbol_count + idx;
-                            if (prog.frame_stamp[off] == vm_frame_epoch[frame]) {
-                                prog.frame_values[off].number += delta;
-                            } else if (prog.global_used[idx]) {
-                                prog.global_values[idx].number += delta;
-                            } else {
-                                prog.frame_stamp[off] = vm_frame_epoch[frame];
-                                prog.frame_values[off] = value_number(delta);
-                            }
-                        } else {
-                            if (!prog.global_used[idx]) {
-                                prog.global_used[idx] = 1;
-                                prog.global_values[idx] = value_number(delta);
-                            } else {
-                                prog.global_values[idx].number += delta;
-                            }
-                        }
-                    }
+                    slot = splice_variable_ref(&prog, var_stack_depth, idx);
+                    *slot = value_number(slot->number + ((op == OP_INC) ? 1.0 : -1.0));
                     break;
                 }
                 case OP_IADD_VAR: {
                     uint16_t dst = fetch_u16(&prog);
                     uint16_t src = fetch_u16(&prog);
+                    Value rhs;
+                    Value *slot;
                     if (dst >= prog.symbol_count || src >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
-                    {
-                        Value rhs = value_number(0.0);
-                        if (var_stack_depth > 0) {
-                            size_t frame = (size_t)var_stack_depth - 1u;
-                            size_t src_off = frame * prog.symbol_count + src;
-                            if (prog.frame_stamp[src_off] == vm_frame_epoch[frame]) rhs = prog.frame_values[src_off];
-                            else if (prog.global_used[src]) rhs = prog.global_values[src];
-                        } else if (prog.global_used[src]) {
-                            rhs = prog.global_values[src];
-                        }
-
-                        if (var_stack_depth > 0) {
-                            size_t frame = (size_t)var_stack_depth - 1u;
-                            size_t dst_off = frame * prog.symbol_count + dst;
-                            if (prog.frame_stamp[dst_off] == vm_frame_epoch[frame]) {
-                                prog.frame_values[dst_off].number += rhs.number;
-                            } else if (prog.global_used[dst]) {
-                                prog.global_values[dst].number += rhs.number;
-                            } else {
-                                prog.frame_stamp[dst_off] = vm_frame_epoch[frame];
-                                prog.frame_values[dst_off] = value_number(rhs.number);
-                            }
-                        } else {
-                            if (!prog.global_used[dst]) {
-                                prog.global_used[dst] = 1;
-                                prog.global_values[dst] = value_number(rhs.number);
-                            } else {
-                                prog.global_values[dst].number += rhs.number;
-                            }
-                        }
+                    rhs = splice_variable_value(&prog, var_stack_depth, src);
+                    slot = splice_variable_ref(&prog, var_stack_depth, dst);
+                    *slot = splice_arith(OP_ADD, *slot, rhs);
+                    break;
+                }
+                case OP_LEN: tos = splice_builtin_len(tos); break;
+                case OP_APPEND: { Value arr = vm_second(); tos = splice_builtin_append(arr, tos); break; }
+                case OP_ABS: tos = value_number(tos.type == VAL_NUMBER ? fabs(tos.number) : 0.0); break;
+                case OP_FLOOR: tos = value_number(tos.type == VAL_NUMBER ? floor(tos.number) : 0.0); break;
+                case OP_SQRT: tos = value_number(tos.type == VAL_NUMBER && tos.number >= 0.0 ? sqrt(tos.number) : 0.0); break;
+                case OP_SIN: tos = value_number(tos.type == VAL_NUMBER ? sin(tos.number) : 0.0); break;
+                case OP_COS: tos = value_number(tos.type == VAL_NUMBER ? cos(tos.number) : 0.0); break;
+                case OP_MINMAX: {
+                    uint8_t want_max = fetch_u8(&prog);
+                    Value a = vm_second();
+                    if (a.type != VAL_NUMBER || tos.type != VAL_NUMBER) tos = value_number(0.0);
+                    else if (want_max) tos = value_number(a.number > tos.number ? a.number : tos.number);
+                    else tos = value_number(a.number < tos.number ? a.number : tos.number);
+                    break;
+                }
+                case OP_IOP: {
+                    uint16_t idx = fetch_u16(&prog);
+                    uint8_t aop = fetch_u8(&prog);
+                    Value rhs;
+                    Value *slot;
+                    if (idx >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
+                    rhs = vm_pop();
+                    slot = splice_variable_ref(&prog, var_stack_depth, idx);
+                    *slot = splice_arith(aop, *slot, rhs);
+                    break;
+                }
+                case OP_IOP_CONST: {
+                    uint16_t idx = fetch_u16(&prog);
+                    uint8_t aop = fetch_u8(&prog);
+                    uint16_t ci = fetch_u16(&prog);
+                    Value rhs;
+                    Value *slot;
+                    if (idx >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
+                    if (ci >= prog.const_count) SPLICE_FAIL("CONST_OOB");
+                    rhs = prog.consts[ci].type == CONST_NUMBER
+                        ? value_number(prog.consts[ci].number)
+                        : value_string(prog.consts[ci].string ? prog.consts[ci].string : "");
+                    slot = splice_variable_ref(&prog, var_stack_depth, idx);
+                    *slot = splice_arith(aop, *slot, rhs);
+                    break;
+                }
+                case OP_IOP_VAR: {
+                    uint16_t dst = fetch_u16(&prog);
+                    uint8_t aop = fetch_u8(&prog);
+                    uint16_t src = fetch_u16(&prog);
+                    Value rhs;
+                    Value *slot;
+                    if (dst >= prog.symbol_count || src >= prog.symbol_count) SPLICE_FAIL("SYMBOL_OOB");
+                    rhs = splice_variable_value(&prog, var_stack_depth, src);
+                    slot = splice_variable_ref(&prog, var_stack_depth, dst);
+                    *slot = splice_arith(aop, *slot, rhs);
+                    break;
+                }
+                case OP_INDEX_IOP: {
+                    uint8_t aop = fetch_u8(&prog);
+                    Value val = vm_pop();
+                    Value idxv = vm_pop();
+                    Value arrv = vm_pop();
+                    ObjArray *oa;
+                    Value cur;
+                    int idx;
+                    if (arrv.type != VAL_OBJECT || !arrv.object) SPLICE_FAIL("INDEX_TARGET");
+                    oa = (ObjArray *)arrv.object;
+                    idx = (int)idxv.number;
+                    if (idx < 0) SPLICE_FAIL("INDEX_OOB");
+                    cur = idx < oa->count ? oa->items[idx] : value_number(0.0);
+                    val = splice_arith(aop, cur, val);
+                    if (idx >= oa->capacity && !splice_array_reserve(oa, (size_t)idx + 1u)) SPLICE_FAIL("ARRAY_OOM");
+                    if (idx >= oa->count) {
+                        for (int i = oa->count; i <= idx; i++) oa->items[i] = value_number(0.0);
+                        oa->count = idx + 1;
                     }
+                    oa->items[idx] = val;
                     break;
                 }
                 case OP_HALT:
                     SYNC_VM_STATE();
+                    splice_profile_finish(&prog);
                     free_program(&prog);
                     return 1;
                 default:
@@ -379,6 +545,10 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
         SYNC_VM_STATE();
 #undef vm_push
 #undef vm_pop
+#undef vm_second
+#undef VM_FLUSH_TOS
+#undef VM_RELOAD_TOS
+#undef fetch_u8
 #undef fetch_u16
 #undef fetch_u32
 #undef vm_ip
@@ -387,6 +557,7 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size) {
 #undef SYNC_VM_STATE
     }
 
+    splice_profile_finish(&prog);
     free_program(&prog);
     return 1;
 }
@@ -3,6 +3,65 @@ static inline FunctionEntry *find_function(const BytecodeProgram *p, uint16_t sy
     return p->func_by_symbol[symbol_idx];
 }
 
+static Value splice_builtin_len(Value v) {
+    if (v.type == VAL_STRING) return value_number((double)strlen(v.string ? v.string : ""));
+    if (v.type == VAL_OBJECT && v.object) {
+        ObjArray *oa = (ObjArray *)v.object;
+        if (oa->type == OBJ_ARRAY || oa->type == OBJ_TUPLE) return value_number((double)oa->count);
+    }
+    return value_number(0.0);
+}
+
+static Value splice_builtin_append(Value target, Value val) {
+    ObjArray *oa;
+    if (target.type != VAL_OBJECT || !target.object) SPLICE_FAIL("APPEND_TARGET");
+    oa = (ObjArray *)target.object;
+    if (oa->type != OBJ_ARRAY) SPLICE_FAIL("APPEND_TARGET");
+    if (oa->count >= oa->capacity && !splice_array_reserve(oa, (size_t)oa->count + 1u)) {
+        SPLICE_FAIL("ARRAY_OOM");
+    }
+    if (val.type == VAL_STRING) {
+        Value copy = val;
+        copy.string = splice_strdup_owned(val.string);
+        oa->items[oa->count++] = copy;
+    } else {
+        oa->items[oa->count++] = val;
+    }
+    return value_number((double)oa->count);
+}
+
+/* slice(src, start, end); `in_frame` puts the copy in the current frame's region when it fits. */
+static Value splice_builtin_slice(Value src, Value startv, Value endv, int in_frame) {
+    ObjArray *from;
+    ObjArray *oa;
+    int start;
+    int end;
+    int count;
+    if (src.type != VAL_OBJECT || !src.object) return value_number(0.0);
+    from = (ObjArray *)src.object;
+    start = (int)startv.number;
+    end = (int)endv.number;
+    if (start < 0) start = 0;
+    if (end > from->count) end = from->count;
+    if (end < start) end = start;
+    count = end - start;
+    if (count < 0 || !splice_array_capacity_valid((size_t)count) || !splice_count_fits((size_t)count, sizeof(Value))) {
+        SPLICE_FAIL("ARRAY_OOM");
+    }
+    oa = in_frame ? splice_frame_array((size_t)count) : NULL;
+    if (!oa) {
+        oa = (ObjArray *)malloc(sizeof(ObjArray));
+        if (!oa) SPLICE_FAIL("ARRAY_OOM");
+        oa->type = OBJ_ARRAY;
+        oa->capacity = count;
+        oa->items = count > 0 ? (Value *)malloc(sizeof(Value) * (size_t)count) : NULL;
+        if (count > 0 && !oa->items) SPLICE_FAIL("ARRAY_OOM");
+    }
+    oa->count = count;
+    for (int i = 0; i < count; i++) oa->items[i] = from->items[start + i];
+    return (Value){ VAL_OBJECT, 0.0, NULL, oa };
+}
+
 static Value call_builtin_or_native(const char *name, int argc, Value *argv) {
 #if SPLICE_EMBED
 #define splice_sleep_ms(ms) SPLICE_EMBED_DELAY_MS(ms)
@@ -82,35 +141,12 @@ static Value call_builtin_or_native(const char *name, int argc, Value *argv) {
 
     if (strcmp(name, "len") == 0) {
         if (argc < 1) return value_number(0.0);
-        if (argv[0].type == VAL_STRING) return value_number((double)strlen(argv[0].string ? argv[0].string : ""));
-        if (argv[0].type == VAL_OBJECT && argv[0].object) {
-            ObjArray *oa = (ObjArray *)argv[0].object;
-            if (oa->type == OBJ_ARRAY || oa->type == OBJ_TUPLE) return value_number((double)oa->count);
-        }
-        return value_number(0.0);
+        return splice_builtin_len(argv[0]);
     }
 
     if (strcmp(name, "append") == 0) {
-        Value target;
-        Value val;
-        ObjArray *oa;
         if (argc < 2) return value_number(0.0);
-        target = argv[0];
-        val = argv[1];
-        if (target.type != VAL_OBJECT || !target.object) SPLICE_FAIL("APPEND_TARGET");
-        oa = (ObjArray *)target.object;
-        if (oa->type != OBJ_ARRAY) SPLICE_FAIL("APPEND_TARGET");
-        if (oa->count >= oa->capacity && !splice_array_reserve(oa, (size_t)oa->count + 1u)) {
-            SPLICE_FAIL("ARRAY_OOM");
-        }
-        if (val.type == VAL_STRING) {
-            Value copy = val;
-            copy.string = splice_strdup_owned(val.string);
-            oa->items[oa->count++] = copy;
-        } else {
-            oa->items[oa->count++] = val;
-        }
-        return value_number((double)oa->count);
+        return splice_builtin_append(argv[0], argv[1]);
     }
 
     if (strcmp(name, "sin") == 0) {
@@ -186,31 +222,8 @@ static Value call_builtin_or_native(const char *name, int argc, Value *argv) {
         return value_number(argv[0].number + (argv[1].number - argv[0].number) * argv[2].number);
     }
     if (strcmp(name, "slice") == 0) {
-        ObjArray *src;
-        ObjArray *oa;
-        int start;
-        int end;
-        int count;
-        if (argc < 3 || argv[0].type != VAL_OBJECT || !argv[0].object) return value_number(0.0);
-        src = (ObjArray *)argv[0].object;
-        start = (int)argv[1].number;
-        end = (int)argv[2].number;
-        if (start < 0) start = 0;
-        if (end > src->count) end = src->count;
-        if (end < start) end = start;
-        count = end - start;
-        oa = (ObjArray *)malloc(sizeof(ObjArray));
-        if (!oa) SPLICE_FAIL("ARRAY_OOM");
-        oa->type = OBJ_ARRAY;
-        oa->count = count;
-        oa->capacity = count;
-        if (count < 0 || !splice_array_capacity_valid((size_t)count) || !splice_count_fits((size_t)count, sizeof(Value))) {
-            SPLICE_FAIL("ARRAY_OOM");
-        }
-        oa->items = count > 0 ? (Value *)malloc(sizeof(Value) * (size_t)count) : NULL;
-        if (count > 0 && !oa->items) SPLICE_FAIL("ARRAY_OOM");
-        for (int i = 0; i < count; i++) oa->items[i] = src->items[start + i];
-        return (Value){ VAL_OBJECT, 0.0, NULL, oa };
+        if (argc < 3) return value_number(0.0);
+        return splice_builtin_slice(argv[0], argv[1], argv[2], 0);
     }
     if (strcmp(name, "split") == 0) {
         ObjArray *oa;
@@ -0,0 +1,138 @@
+/*
+ * Execution profile, written by `Splice <file.spc> --profile-out <file>` for
+ * spbuild --profile-in. Counters are indexed by code address: a conditional
+ * jump counts how often it ran and was taken, a taken backward jump counts an
+ * iteration of the loop whose header it targets, and a call site counts its
+ * calls and the types its arguments arrived with. spbuild maps the addresses
+ * back onto the program, which is why the code hash goes into the file too.
+ */
+
+#define SPLICE_PROFILE_MAX_ARGS 8
+
+#define PROFILE_TYPE_NUMBER 1u
+#define PROFILE_TYPE_STRING 2u
+#define PROFILE_TYPE_ARRAY 4u
+
+typedef struct {
+    const char *out_path;
+    uint64_t *executed;
+    uint64_t *taken;
+    uint64_t *iterations;
+    uint64_t *calls;
+    uint8_t *arg_types;
+    uint64_t *func_calls;
+} SpliceProfile;
+
+static SpliceProfile g_profile;
+
+static void splice_profile_request(const char *out_path) {
+    g_profile.out_path = out_path;
+}
+
+static void splice_profile_free(void) {
+    free(g_profile.executed);
+    free(g_profile.taken);
+    free(g_profile.iterations);
+    free(g_profile.calls);
+    free(g_profile.arg_types);
+    free(g_profile.func_calls);
+    g_profile.executed = g_profile.taken = g_profile.iterations = g_profile.calls = g_profile.func_calls = NULL;
+    g_profile.arg_types = NULL;
+}
+
+/* Returns the profile to fill while running `p`, or NULL when none was requested. */
+static SpliceProfile *splice_profile_begin(const BytecodeProgram *p) {
+    size_t slots = (size_t)p->code_size + 1u;
+    size_t funcs = p->func_count ? (size_t)p->func_count : 1u;
+
+    if (!g_profile.out_path) return NULL;
+    if (splice_mul_overflows_size(slots, SPLICE_PROFILE_MAX_ARGS)) SPLICE_FAIL("PROFILE_OOM");
+    g_profile.executed = (uint64_t *)splice_calloc_checked(slots, sizeof(uint64_t));
+    g_profile.taken = (uint64_t *)splice_calloc_checked(slots, sizeof(uint64_t));
+    g_profile.iterations = (uint64_t *)splice_calloc_checked(slots, sizeof(uint64_t));
+    g_profile.calls = (uint64_t *)splice_calloc_checked(slots, sizeof(uint64_t));
+    g_profile.arg_types = (uint8_t *)splice_calloc_checked(slots * SPLICE_PROFILE_MAX_ARGS, sizeof(uint8_t));
+    g_profile.func_calls = (uint64_t *)splice_calloc_checked(funcs, sizeof(uint64_t));
+    if (!g_profile.executed || !g_profile.taken || !g_profile.iterations || !g_profile.calls ||
+        !g_profile.arg_types || !g_profile.func_calls) {
+        SPLICE_FAIL("PROFILE_OOM");
+    }
+    return &g_profile;
+}
+
+/* `at` is the jump's own address and `target` its operand. */
+static inline void splice_profile_jump(SpliceProfile *prof, uint32_t at, uint32_t target, int conditional, int taken) {
+    if (conditional) {
+        prof->executed[at]++;
+        if (taken) prof->taken[at]++;
+    }
+    if (taken && target <= at) prof->iterations[target]++;
+}
+
+static void splice_profile_call(SpliceProfile *prof, const BytecodeProgram *p, uint32_t at,
+                                const FunctionEntry *fn, int argc, const Value *args) {
+    uint8_t *types = prof->arg_types + (size_t)at * SPLICE_PROFILE_MAX_ARGS;
+
+    prof->calls[at]++;
+    if (fn) prof->func_calls[fn - p->funcs]++;
+    for (int i = 0; i < argc && i < SPLICE_PROFILE_MAX_ARGS; i++) {
+        if (args[i].type == VAL_STRING) types[i] |= PROFILE_TYPE_STRING;
+        else if (args[i].type == VAL_OBJECT) types[i] |= PROFILE_TYPE_ARRAY;
+        else types[i] |= PROFILE_TYPE_NUMBER;
+    }
+}
+
+/* FNV-1a over the code section; spbuild hashes the code it generates the same way. */
+static uint32_t splice_code_hash(const unsigned char *code, uint32_t size) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < size; i++) {
+        h ^= code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Writes the profile gathered while running `p` and releases the counters. */
+static void splice_profile_finish(const BytecodeProgram *p) {
+#if !SPLICE_EMBED
+    FILE *f;
+
+    if (!g_profile.executed) return;
+    f = fopen(g_profile.out_path, "w");
+    if (!f) {
+        fprintf(stderr, "[ERROR] cannot write profile %s\n", g_profile.out_path);
+        splice_profile_free();
+        return;
+    }
+    fprintf(f, "splice-profile 1\n");
+    fprintf(f, "code %u %08x\n", (unsigned)p->code_size, (unsigned)splice_code_hash(p->code, p->code_size));
+    for (uint16_t i = 0; i < p->func_count; i++) {
+        if (p->funcs[i].symbol >= p->symbol_count) continue;
+        fprintf(f, "func %s %llu\n", p->symbols[p->funcs[i].symbol], (unsigned long long)g_profile.func_calls[i]);
+    }
+    for (uint32_t at = 0; at <= p->code_size; at++) {
+        if (g_profile.executed[at]) {
+            fprintf(f, "branch %u %llu %llu\n", (unsigned)at, (unsigned long long)g_profile.executed[at],
+                    (unsigned long long)g_profile.taken[at]);
+        }
+        if (g_profile.iterations[at]) {
+            fprintf(f, "loop %u %llu\n", (unsigned)at, (unsigned long long)g_profile.iterations[at]);
+        }
+        if (g_profile.calls[at]) {
+            const uint8_t *types = g_profile.arg_types + (size_t)at * SPLICE_PROFILE_MAX_ARGS;
+            fprintf(f, "call %u %llu", (unsigned)at, (unsigned long long)g_profile.calls[at]);
+            for (int i = 0; i < SPLICE_PROFILE_MAX_ARGS && types[i]; i++) {
+                fputc(' ', f);
+                if (types[i] & PROFILE_TYPE_NUMBER) fputc('n', f);
+                if (types[i] & PROFILE_TYPE_STRING) fputc('s', f);
+                if (types[i] & PROFILE_TYPE_ARRAY) fputc('a', f);
+            }
+            fputc('\n', f);
+        }
+    }
+    fclose(f);
+#else
+    (void)p;
+#endif
+    splice_profile_free();
+}
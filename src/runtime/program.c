@@ -86,6 +86,7 @@ static int load_program(const unsigned char *data, size_t size, BytecodeProgram
             if (!out->funcs[i].params) return 0;
             for (uint16_t j = 0; j < out->funcs[i].param_count; j++) {
                 out->funcs[i].params[j] = rd_u16(data, size, &pos);
+                if (out->funcs[i].params[j] >= out->symbol_count) return 0;
             }
         }
     }
@@ -77,6 +77,13 @@ int splice_embed_input_read(void);
 #ifndef SPLICE_MAX_ALLOC_SIZE
 #define SPLICE_MAX_ALLOC_SIZE (16u * 1024u * 1024u)
 #endif
+#ifndef SPLICE_FRAME_REGION_SIZE
+#if SPLICE_EMBED
+#define SPLICE_FRAME_REGION_SIZE 2048u
+#else
+#define SPLICE_FRAME_REGION_SIZE 65536u
+#endif
+#endif
 
 typedef enum { VAL_NUMBER, VAL_STRING, VAL_OBJECT } ValueType;
 
@@ -154,7 +161,6 @@ struct ASTNode {
 #define VM_STACK_MAX 1024
 #define VAR_STACK_MAX 32
 #define CALLSTACK_MAX 64
-#define VM_ARG_MAX 64
 
 typedef enum {
     CONST_NUMBER = 0,
@@ -201,6 +207,7 @@ static char *splice_strdup_owned(const char *s);
 static Value value_number(double n);
 static Value value_string(const char *s);
 static int value_truthy(Value v);
+static Value splice_string_concat(Value a, Value b);
 static int value_eq(Value a, Value b);
 static void splice_print_value(Value v);
 
@@ -211,17 +218,30 @@ static double rd_double(const unsigned char *data, size_t size, size_t *pos);
 static char *rd_str(const unsigned char *data, size_t size, size_t *pos);
 
 static int splice_array_reserve(ObjArray *oa, size_t min_capacity);
+static ObjArray *splice_frame_array(size_t capacity);
+static Value splice_builtin_slice(Value src, Value startv, Value endv, int in_frame);
+static int splice_vec_arg_count(Value progv);
+static Value splice_vec_map(const char *prog, const Value *args);
+static int splice_vec_guard(const Value *args, int arrays);
+static Value splice_reduce(OpCode op, const Value *args);
 static void splice_reset_vm(void);
 static void free_program(BytecodeProgram *p);
 static int load_program(const unsigned char *data, size_t size, BytecodeProgram *out);
 static inline FunctionEntry *find_function(const BytecodeProgram *p, uint16_t symbol_idx);
+static Value splice_builtin_len(Value v);
+static Value splice_builtin_append(Value target, Value val);
 static Value call_builtin_or_native(const char *name, int argc, Value *argv);
 static Value splice_load_variable(BytecodeProgram *prog, uint16_t idx);
 static void splice_store_variable(BytecodeProgram *prog, uint16_t idx, Value v);
 static void splice_incdec_variable(BytecodeProgram *prog, uint16_t idx, double delta);
 static void splice_iadd_variable(BytecodeProgram *prog, uint16_t dst, uint16_t src);
-static inline void vm_push_fast(int *sp, Value v);
-static inline Value vm_pop_fast(int *sp);
+static Value splice_variable_value(const BytecodeProgram *prog, int depth, uint16_t idx);
+static Value *splice_variable_ref(BytecodeProgram *prog, int depth, uint16_t idx);
+static Value splice_arith(uint8_t op, Value a, Value b);
+static inline void vm_push_fast(int *sp, Value *tos, Value v);
+static inline Value vm_pop_fast(int *sp, Value *tos);
+static inline Value vm_take_second_fast(int *sp);
+static inline uint8_t fetch_u8_fast(const BytecodeProgram *p, uint32_t *ip);
 static inline uint16_t fetch_u16_fast(const BytecodeProgram *p, uint32_t *ip);
 static inline uint32_t fetch_u32_fast(const BytecodeProgram *p, uint32_t *ip);
 static int splice_execute_bytecode(const unsigned char *data, size_t size);
@@ -232,6 +252,8 @@ static int splice_execute_bytecode(const unsigned char *data, size_t size);
 #include "functions.c"
 #include "varibles.c"
 #include "program.c"
+#include "profile.c"
+#include "vector.c"
 #include "execute.c"
 
 #endif
@@ -15,6 +15,17 @@ static Value value_string(const char *s) {
     return v;
 }
 
+static Value splice_string_concat(Value a, Value b) {
+    size_t la = strlen(a.string ? a.string : "");
+    size_t lb = strlen(b.string ? b.string : "");
+    char *s = (char *)splice_malloc_bytes(la + lb + 1u);
+    if (!s) SPLICE_FAIL("OOM");
+    memcpy(s, a.string ? a.string : "", la);
+    memcpy(s + la, b.string ? b.string : "", lb);
+    s[la + lb] = 0;
+    return value_string(s);
+}
+
 static int value_eq(Value a, Value b) {
     if (a.type == VAL_STRING && b.type == VAL_STRING) {
         const char *as = a.string ? a.string : "";
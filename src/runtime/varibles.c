@@ -76,3 +76,31 @@ static void splice_iadd_variable(BytecodeProgram *prog, uint16_t dst, uint16_t s
         }
     }
 }
+
+/* Depth is passed in because the interpreter keeps it in a local while running. */
+static Value splice_variable_value(const BytecodeProgram *prog, int depth, uint16_t idx) {
+    if (depth > 0) {
+        size_t frame = (size_t)depth - 1u;
+        size_t off = frame * prog->symbol_count + idx;
+        if (prog->frame_stamp[off] == vm_frame_epoch[frame]) return prog->frame_values[off];
+    }
+    return prog->global_used[idx] ? prog->global_values[idx] : value_number(0.0);
+}
+
+/* Resolves a variable for read-modify-write, creating it as 0 the way OP_STORE would. */
+static Value *splice_variable_ref(BytecodeProgram *prog, int depth, uint16_t idx) {
+    if (depth > 0) {
+        size_t frame = (size_t)depth - 1u;
+        size_t off = frame * prog->symbol_count + idx;
+        if (prog->frame_stamp[off] == vm_frame_epoch[frame]) return &prog->frame_values[off];
+        if (prog->global_used[idx]) return &prog->global_values[idx];
+        prog->frame_stamp[off] = vm_frame_epoch[frame];
+        prog->frame_values[off] = value_number(0.0);
+        return &prog->frame_values[off];
+    }
+    if (!prog->global_used[idx]) {
+        prog->global_used[idx] = 1;
+        prog->global_values[idx] = value_number(0.0);
+    }
+    return &prog->global_values[idx];
+}
@@ -0,0 +1,283 @@
+/*
+ * Whole-loop array kernels, emitted by spbuild for loops it recognizes.
+ *
+ * OP_VEC_MAP stores `f(sources[i]..., scalars..., i)` into dst[i] for every i
+ * a `for` loop would visit. `f` is a postfix program in a string: a digit
+ * for the number of source arrays, one for the number of scalars, then one
+ * character per step. 'A'+k pushes source k's element, 'a'+k scalar k, 'i'
+ * the index, and + - * / combine the top two entries. Elements are processed
+ * in blocks of SPLICE_VEC_BLOCK, one step at a time over plain double
+ * arrays, so the compiler can use the target's vector unit (SSE/AVX, NEON).
+ *
+ * OP_REDUCE_SUM, OP_REDUCE_PRODUCT, OP_REDUCE_MIN, OP_REDUCE_MAX and OP_DOT
+ * fold the same range of one array (two for OP_DOT) into an accumulator and
+ * return exactly what the scalar loop would leave in it. They run under an
+ * OP_VEC_GUARD that performs the checks up front.
+ */
+
+#define SPLICE_VEC_BLOCK 64
+#define SPLICE_VEC_MAX_DEPTH 8
+#define SPLICE_VEC_MAX_ARRAYS 4
+#define SPLICE_VEC_MAX_SCALARS 8
+#define SPLICE_VEC_LANES 4
+#define SPLICE_VEC_EXACT 9007199254740992.0 /* 2^53 */
+
+/* Parses the header and checks every step; the stack never underflows and ends with one entry. */
+static int splice_vec_program(const char *prog, int *arrays, int *scalars) {
+    int depth = 0;
+
+    if (!prog || prog[0] < '0' || prog[0] > '0' + SPLICE_VEC_MAX_ARRAYS ||
+        prog[1] < '0' || prog[1] > '0' + SPLICE_VEC_MAX_SCALARS) {
+        return 0;
+    }
+    *arrays = prog[0] - '0';
+    *scalars = prog[1] - '0';
+    for (const char *op = prog + 2; *op; op++) {
+        if ((*op >= 'A' && *op < 'A' + *arrays) || (*op >= 'a' && *op < 'a' + *scalars) || *op == 'i') depth++;
+        else if (*op == '+' || *op == '-' || *op == '*' || *op == '/') depth--;
+        else return 0;
+        if (depth < 1 || depth > SPLICE_VEC_MAX_DEPTH) return 0;
+    }
+    return depth == 1;
+}
+
+/* Stack entries under the program string: start, end, destination, sources, scalars. -1 if malformed. */
+static int splice_vec_arg_count(Value progv) {
+    int arrays;
+    int scalars;
+
+    if (progv.type != VAL_STRING || !splice_vec_program(progv.string, &arrays, &scalars)) return -1;
+    return 3 + arrays + scalars;
+}
+
+/*
+ * Number of indices a loop from `startv` to `endv` visits, with the first in
+ * `first`; -1 unless both are numbers and the start a non-negative integer.
+ */
+static int splice_vec_range(Value startv, Value endv, int *first) {
+    double start;
+    double last;
+
+    if (startv.type != VAL_NUMBER || endv.type != VAL_NUMBER || endv.number != endv.number) return -1;
+    start = startv.number;
+    if (!(start >= 0.0) || start != floor(start) || start >= (double)INT_MAX) return -1;
+    *first = (int)start;
+    if (start > endv.number) return 0;
+    last = floor(endv.number);
+    if (last >= (double)INT_MAX) return -1;
+    return (int)last - *first + 1;
+}
+
+/* The array in `v` if items [first, first + n) exist, and are numbers when `numbers` is set. */
+static ObjArray *splice_vec_span(Value v, int first, int n, int numbers) {
+    ObjArray *oa;
+
+    if (v.type != VAL_OBJECT || !v.object) return NULL;
+    oa = (ObjArray *)v.object;
+    if (n > oa->count - first) return NULL;
+    if (numbers) {
+        for (int i = 0; i < n; i++) {
+            if (oa->items[first + i].type != VAL_NUMBER) return NULL;
+        }
+    }
+    return oa;
+}
+
+/*
+ * Returns the value the loop leaves in its variable, or -1 without touching
+ * anything when the loop must run as written: the start is not a
+ * non-negative integer, an index is out of range or a value is not a number.
+ */
+static Value splice_vec_map(const char *prog, const Value *args) {
+    double reg[SPLICE_VEC_MAX_DEPTH][SPLICE_VEC_BLOCK];
+    ObjArray *src[SPLICE_VEC_MAX_ARRAYS];
+    double scalar[SPLICE_VEC_MAX_SCALARS];
+    ObjArray *dst;
+    int arrays;
+    int scalars;
+    int first;
+    int n;
+
+    splice_vec_program(prog, &arrays, &scalars);
+    n = splice_vec_range(args[0], args[1], &first);
+    if (n < 0) return value_number(-1.0);
+    if (n == 0) return args[0];
+
+    dst = splice_vec_span(args[2], first, n, 0);
+    if (!dst) return value_number(-1.0);
+    for (int k = 0; k < arrays; k++) {
+        src[k] = splice_vec_span(args[3 + k], first, n, 1);
+        if (!src[k]) return value_number(-1.0);
+    }
+    for (int k = 0; k < scalars; k++) {
+        if (args[3 + arrays + k].type != VAL_NUMBER) return value_number(-1.0);
+        scalar[k] = args[3 + arrays + k].number;
+    }
+
+    for (int base = 0; base < n; base += SPLICE_VEC_BLOCK) {
+        int m = n - base < SPLICE_VEC_BLOCK ? n - base : SPLICE_VEC_BLOCK;
+        int at = first + base;
+        int sp = 0;
+
+        for (const char *op = prog + 2; *op; op++) {
+            if (*op == '+' || *op == '-' || *op == '*' || *op == '/') {
+                double *l = reg[sp - 2];
+                const double *r = reg[sp - 1];
+                sp--;
+                switch (*op) {
+                    case '+': for (int j = 0; j < m; j++) l[j] += r[j]; break;
+                    case '-': for (int j = 0; j < m; j++) l[j] -= r[j]; break;
+                    case '*': for (int j = 0; j < m; j++) l[j] *= r[j]; break;
+                    default: for (int j = 0; j < m; j++) l[j] /= r[j]; break;
+                }
+            } else {
+                double *r = reg[sp++];
+                if (*op == 'i') {
+                    for (int j = 0; j < m; j++) r[j] = (double)(at + j);
+                } else if (*op >= 'a') {
+                    double v = scalar[*op - 'a'];
+                    for (int j = 0; j < m; j++) r[j] = v;
+                } else {
+                    const Value *items = src[*op - 'A']->items + at;
+                    for (int j = 0; j < m; j++) r[j] = items[j].number;
+                }
+            }
+        }
+        {
+            Value *out = dst->items + at;
+            for (int j = 0; j < m; j++) out[j] = value_number(reg[0][j]);
+        }
+    }
+    return value_number((double)first + (double)n);
+}
+
+/*
+ * OP_VEC_GUARD: true when a reduction over args (accumulator, start, end,
+ * then `arrays` arrays) can run, i.e. the accumulator is a number and the
+ * checks of splice_vec_map pass for every array.
+ */
+static int splice_vec_guard(const Value *args, int arrays) {
+    int first;
+    int n;
+
+    if (args[0].type != VAL_NUMBER) return 0;
+    n = splice_vec_range(args[1], args[2], &first);
+    if (n < 0) return 0;
+    for (int k = 0; k < arrays; k++) {
+        if (n > 0 && !splice_vec_span(args[3 + k], first, n, 1)) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Sums `acc + x[0]*y[0] + ...`, or `acc + x[0] + ...` without `y`, in loop
+ * order. Lanes are only summed separately when every term and the
+ * accumulator are integers whose magnitudes add up to less than 2^53, so no
+ * partial sum rounds whatever the order; otherwise the sum is redone in
+ * order. Lanes start at -0.0, the value that leaves any term unchanged,
+ * so even the sign of a zero result matches.
+ */
+static double splice_reduce_add(double acc, const Value *x, const Value *y, int n) {
+    double lane[SPLICE_VEC_LANES];
+    double mag = fabs(acc);
+    int exact = acc == floor(acc);
+    int j = 0;
+
+    for (int k = 0; k < SPLICE_VEC_LANES; k++) lane[k] = -0.0;
+    lane[0] = acc;
+    for (; j + SPLICE_VEC_LANES <= n; j += SPLICE_VEC_LANES) {
+        for (int k = 0; k < SPLICE_VEC_LANES; k++) {
+            double v = y ? x[j + k].number * y[j + k].number : x[j + k].number;
+            lane[k] += v;
+            mag += fabs(v);
+            exact &= v == floor(v);
+        }
+    }
+    for (; j < n; j++) {
+        double v = y ? x[j].number * y[j].number : x[j].number;
+        lane[0] += v;
+        mag += fabs(v);
+        exact &= v == floor(v);
+    }
+    if (exact && mag < SPLICE_VEC_EXACT) return (lane[0] + lane[1]) + (lane[2] + lane[3]);
+
+    {
+        /* volatile keeps -ffast-math builds (build.sh) from reordering the sum or fusing a * b + s. */
+        volatile double seq = acc;
+        for (j = 0; j < n; j++) {
+            volatile double v = y ? x[j].number * y[j].number : x[j].number;
+            seq = seq + v;
+        }
+        return seq;
+    }
+}
+
+/*
+ * `if (x[i] > acc) { acc = x[i]; }` over the range, or with < when
+ * `want_max` is 0. The lanes find the same extreme in any order; only which
+ * of 0.0 and -0.0 is kept depends on it, so a zero result is redone in order.
+ */
+static double splice_reduce_extreme(double acc, const Value *x, int n, int want_max) {
+    double lane[SPLICE_VEC_LANES];
+    double best;
+    int j = 0;
+
+    if (acc != acc) return acc; /* nothing compares beyond NaN */
+    for (int k = 0; k < SPLICE_VEC_LANES; k++) lane[k] = acc;
+    for (; j + SPLICE_VEC_LANES <= n; j += SPLICE_VEC_LANES) {
+        for (int k = 0; k < SPLICE_VEC_LANES; k++) {
+            double v = x[j + k].number;
+            if (want_max) lane[k] = v > lane[k] ? v : lane[k];
+            else lane[k] = v < lane[k] ? v : lane[k];
+        }
+    }
+    for (; j < n; j++) {
+        double v = x[j].number;
+        if (want_max ? v > lane[0] : v < lane[0]) lane[0] = v;
+    }
+    best = lane[0];
+    for (int k = 1; k < SPLICE_VEC_LANES; k++) {
+        if (want_max ? lane[k] > best : lane[k] < best) best = lane[k];
+    }
+    if (best != 0.0) return best;
+
+    {
+        /* volatile keeps the compare and store; -ffast-math would otherwise use maxsd/minsd here too. */
+        volatile double seq = acc;
+        for (j = 0; j < n; j++) {
+            double v = x[j].number;
+            if (want_max ? v > seq : v < seq) seq = v;
+        }
+        return seq;
+    }
+}
+
+/*
+ * Runs the reduction `op` over args (accumulator, start, end, arrays). Only
+ * emitted under a passing OP_VEC_GUARD; the range is checked again so a
+ * stray call returns the accumulator instead of reading out of bounds.
+ */
+static Value splice_reduce(OpCode op, const Value *args) {
+    const Value *x;
+    const Value *y = NULL;
+    double acc = args[0].number;
+    int first;
+    int n = splice_vec_range(args[1], args[2], &first);
+
+    if (n <= 0 || !splice_vec_span(args[3], first, n, 0) || (op == OP_DOT && !splice_vec_span(args[4], first, n, 0))) {
+        return value_number(acc);
+    }
+    x = ((ObjArray *)args[3].object)->items + first;
+    if (op == OP_DOT) y = ((ObjArray *)args[4].object)->items + first;
+    switch (op) {
+        case OP_REDUCE_SUM: return value_number(splice_reduce_add(acc, x, NULL, n));
+        case OP_DOT: return value_number(splice_reduce_add(acc, x, y, n));
+        case OP_REDUCE_MIN: return value_number(splice_reduce_extreme(acc, x, n, 0));
+        case OP_REDUCE_MAX: return value_number(splice_reduce_extreme(acc, x, n, 1));
+        default: {
+            volatile double seq = acc; /* in order, as in splice_reduce_add */
+            for (int j = 0; j < n; j++) seq = seq * x[j].number;
+            return value_number(seq);
+        }
+    }
+}